@@ -0,0 +1,105 @@
+#define _DEFAULT_SOURCE
+#include "../src/lexer/lexer.h"
+#include "../src/utils/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS 5
+
+// Every allocation made by the lexer goes through these wrappers, the binary
+// is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+static i64 allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Lex a file BENCH_RUNS times and print its row, the fastest run is kept
+ * @param file_location
+ */
+static void bench_file(const char *file_location) {
+  SourceFile *source = load_source(file_location);
+  if (source == NULL) {
+    fprintf(stderr, "FileError: file %s could not be read\n", file_location);
+    exit(EXIT_FAILURE);
+  }
+  double best = 0;
+  i64 tokens_count = 0, run_allocations = 0;
+
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    i64 allocations_before = allocations;
+    double start = now();
+
+    Lexer *lexer = create_lexer(file_location, source->data, source->length);
+    TokenBuffer *tokens = lexer ? tokenizer(lexer) : NULL;
+    if (tokens == NULL) {
+      fprintf(stderr, "MallocError: No memory to allocate\n");
+      exit(EXIT_FAILURE);
+    }
+
+    double elapsed = now() - start;
+    run_allocations = allocations - allocations_before;
+    tokens_count = tokens->length;
+    if (run == 0 || elapsed < best)
+      best = elapsed;
+    free_token_buffer(tokens), free_lexer(lexer);
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  double megabytes = source->length / (1024.0 * 1024.0);
+  printf("%-40s %9.1f %9.1f %11.2f %12lu %10lu %12.1f\n", file_location,
+         megabytes, megabytes / best, tokens_count / best / 1e6, tokens_count,
+         run_allocations, usage.ru_maxrss / 1024.0);
+  fflush(stdout);
+  free_source(source);
+}
+
+int main(int argc, char *argv[]) {
+  printf("%-40s %9s %9s %11s %12s %10s %12s\n", "file", "MB", "MB/s",
+         "Mtokens/s", "tokens", "allocs", "peak RSS MB");
+
+  // Each file runs in its own process so peak RSS is measured per file
+  for (int i = 1; i < argc; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      bench_file(argv[i]);
+      exit(EXIT_SUCCESS);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      fprintf(stderr, "BenchError: lexing %s failed\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t i64;
+
+static const char *words[] = {
+    "alpha", "beta_1",  "vector3", "len",    "index", "count", "x",
+    "y",     "matrix",  "buffer",  "node",   "value", "tmp2",  "result",
+    "int",   "foreach", "return",  "string", "i64",   "while", "struct",
+};
+
+static const char *operators[] = {
+    "+",  "++", "+=", "-",  "--", "-=", "*",  "*=", "/",  "/=", "%",
+    "%=", "**", "!",  "!=", "||", "|",  "&&", "&",  "$",  "^",  "~",
+    "==", "<",  "<<", ">>", ">",  "<=", ">=", "=",  ":=", ":",  "=>",
+};
+
+static const char *separators[] = {"{", "}", "[", "]", "(", ")", ";", ",", "."};
+
+static const char *prose[] = {
+    "the", "lexer", "skips", "this", "comment", "text", "quickly", "while",
+    "it",  "counts", "lines", "and", "columns", "for", "every", "byte",
+};
+
+static i64 state = 0x9E3779B97F4A7C15;
+
+/**
+ * xorshift64, the corpus must be the same on every run
+ * @return next pseudo random number
+ */
+static i64 next_random(void) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+#define PICK(table) table[next_random() % (sizeof(table) / sizeof(*table))]
+
+static void identifier_line(FILE *out) {
+  for (int i = 0; i < 10; i++)
+    fprintf(out, "%s ", PICK(words));
+  fputs(";\n", out);
+}
+
+static void operator_line(FILE *out) {
+  for (int i = 0; i < 12; i++)
+    fprintf(out, "%s%s", PICK(operators), PICK(separators));
+  fputs("\n", out);
+}
+
+static void comment_line(FILE *out) {
+  if (next_random() % 2) {
+    fputs("// ", out);
+    for (int i = 0; i < 12; i++)
+      fprintf(out, "%s ", PICK(prose));
+    fputs("\n", out);
+  } else {
+    fputs("/* ", out);
+    for (int i = 0; i < 30; i++)
+      fprintf(out, "%s%s", PICK(prose), i % 10 == 9 ? "\n   " : " ");
+    fputs("*/\n", out);
+  }
+  fprintf(out, "%s = %s;\n", PICK(words), PICK(words));
+}
+
+static void literal_line(FILE *out) {
+  fputs("x := \"", out);
+  for (int i = 0; i < 8; i++)
+    fprintf(out, "%s ", PICK(prose));
+  fprintf(out, "\"; c := '%c'; n := %lu; f := %lu.%lu;\n",
+          (char)('a' + next_random() % 26), next_random() % 100000,
+          next_random() % 1000, next_random() % 1000);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <identifier|operator|comment|literal> "
+                    "<megabytes> <output>\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  void (*line)(FILE *) = NULL;
+  if (strcmp(argv[1], "identifier") == 0)
+    line = identifier_line;
+  else if (strcmp(argv[1], "operator") == 0)
+    line = operator_line;
+  else if (strcmp(argv[1], "comment") == 0)
+    line = comment_line;
+  else if (strcmp(argv[1], "literal") == 0)
+    line = literal_line;
+  else {
+    fprintf(stderr, "Unknown corpus kind %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *out = fopen(argv[3], "w");
+  if (out == NULL) {
+    fprintf(stderr, "FileError: file %s could not be created\n", argv[3]);
+    return EXIT_FAILURE;
+  }
+
+  long size = atol(argv[2]) * 1024 * 1024;
+  while (ftell(out) < size)
+    line(out);
+  fclose(out);
+  return EXIT_SUCCESS;
+}
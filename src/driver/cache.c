@@ -0,0 +1,359 @@
+#define _DEFAULT_SOURCE
+#include "cache.h"
+#include "../utils/hash.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_ALIGNMENT 8
+
+// Offset of every section of an entry, each one padded to CACHE_ALIGNMENT
+typedef struct {
+  i64 types;
+  i64 offsets;
+  i64 lengths;
+  i64 number_tokens;
+  i64 numbers;
+  i64 decoded_tokens;
+  i64 decoded;
+  i64 decoded_data;
+  i64 lines;
+  i64 nodes;
+  i64 extra;
+  i64 size;
+} CacheLayout;
+
+static i64 align(i64 size) {
+  return (size + CACHE_ALIGNMENT - 1) & ~(i64)(CACHE_ALIGNMENT - 1);
+}
+
+static CacheLayout cache_layout(const CacheHeader *header) {
+  CacheLayout layout;
+  layout.types = sizeof(CacheHeader);
+  layout.offsets = layout.types + align(sizeof(i8) * header->tokens_length);
+  layout.lengths = layout.offsets + align(sizeof(i32) * header->tokens_length);
+  layout.number_tokens =
+      layout.lengths + align(sizeof(i32) * header->tokens_length);
+  layout.numbers =
+      layout.number_tokens + align(sizeof(i32) * header->numbers_length);
+  layout.decoded_tokens =
+      layout.numbers + align(sizeof(Number) * header->numbers_length);
+  layout.decoded =
+      layout.decoded_tokens + align(sizeof(i32) * header->decoded_length);
+  layout.decoded_data =
+      layout.decoded + align(sizeof(PackedString) * header->decoded_length);
+  layout.lines = layout.decoded_data + align(header->decoded_size);
+  layout.nodes = layout.lines + align(sizeof(i32) * header->lines_length);
+  layout.extra = layout.nodes + align(sizeof(Node) * header->nodes_length);
+  layout.size = layout.extra + align(sizeof(NodeId) * header->extra_length);
+  return layout;
+}
+
+/**
+ * Build the location of an entry
+ * @param directory
+ * @param hash of the source
+ * @param suffix appended to the entry name
+ * @return the location, to free, NULL if there is no memory left
+ */
+static char *entry_location(const char *directory, i64 hash,
+                            const char *suffix) {
+  i64 size = strlen(directory) + 1 + 16 + strlen(CACHE_EXTENSION) +
+             strlen(suffix) + 1;
+  char *location = malloc(size);
+  if (location == NULL)
+    return NULL;
+  snprintf(location, size, "%s/%016lx%s%s", directory, hash, CACHE_EXTENSION,
+           suffix);
+  return location;
+}
+
+/**
+ * Hash an entry, its header included with checksum taken as 0
+ * @param data the whole entry
+ * @param size
+ * @return the checksum
+ */
+static i64 entry_checksum(const char *data, i64 size) {
+  CacheHeader header;
+  memcpy(&header, data, sizeof(CacheHeader));
+  header.checksum = 0;
+  i64 seed = hash_bytes(&header, sizeof(CacheHeader), 0);
+  return hash_bytes(data + sizeof(CacheHeader), size - sizeof(CacheHeader),
+                    seed);
+}
+
+/**
+ * Create the cache directory if it doesn't exist yet
+ * @param directory
+ * @return true if the directory is usable, false with errno set otherwise
+ */
+i8 create_cache(const char *directory) {
+  struct stat info;
+  if (mkdir(directory, 0777) == 0)
+    return 1;
+  if (errno != EEXIST || stat(directory, &info) != 0)
+    return 0;
+  if (!S_ISDIR(info.st_mode)) {
+    errno = ENOTDIR;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Check an entry header against the source it should describe. Counts are
+ * bounded before the layout is computed from them so it can't overflow
+ * @param header
+ * @param hash
+ * @param length of the source
+ * @param size of the entry
+ * @return true if the entry can be read
+ */
+static i8 valid_header(const CacheHeader *header, i64 hash, i64 length,
+                       i64 size) {
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      header->node_size != sizeof(Node) || header->hash != hash ||
+      header->source_length != length)
+    return 0;
+  if (header->tokens_length == 0 || header->tokens_length > length + 1 ||
+      header->numbers_length > header->tokens_length ||
+      header->decoded_length > header->tokens_length ||
+      header->decoded_size > length ||
+      header->lines_length > length || header->nodes_length > size ||
+      header->extra_length > size)
+    return 0;
+  if (header->nodes_length == 0
+          ? header->extra_length != 0 || header->root != NO_NODE
+          : header->root >= header->nodes_length)
+    return 0;
+  return cache_layout(header).size == size;
+}
+
+/**
+ * Load the tokens, and the tree when there is one, of a source from the
+ * cache. The entry is memory mapped, checked, then copied out so the result
+ * is owned like a freshly lexed and parsed one. Any entry that doesn't
+ * describe the source is rejected
+ * @param directory
+ * @param hash of the source
+ * @param source the tokens will point into
+ * @param length of the source
+ * @param tokens set to the tokens on success
+ * @param ast set to the tree, NULL when the entry only holds tokens
+ * @return true on success, false if there is no usable entry
+ */
+i8 cache_load(const char *directory, i64 hash, const char *source,
+              i64 length, TokenBuffer **tokens, Ast **ast) {
+  *tokens = NULL;
+  *ast = NULL;
+
+  char *location = entry_location(directory, hash, "");
+  if (location == NULL)
+    return 0;
+  int fd = open(location, O_RDONLY);
+  free(location);
+  if (fd < 0)
+    return 0;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(CacheHeader)) {
+    close(fd);
+    return 0;
+  }
+  i64 size = info.st_size;
+  const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return 0;
+
+  CacheHeader header;
+  memcpy(&header, data, sizeof(CacheHeader));
+  if (!valid_header(&header, hash, length, size) ||
+      entry_checksum(data, size) != header.checksum)
+    goto error;
+
+  // The checksum only catches damage, an entry of another build or a hash
+  // collision must not lead out of bounds either, see read_token_stream
+  CacheLayout layout = cache_layout(&header);
+  const i8 *types = (const i8 *)(data + layout.types);
+  const i32 *offsets = (const i32 *)(data + layout.offsets);
+  const i32 *lengths = (const i32 *)(data + layout.lengths);
+  if (types[header.tokens_length - 1] != TK_EOF)
+    goto error;
+  for (i64 i = 0; i < header.tokens_length; i++) {
+    if (types[i] >= TOKEN_TYPE_COUNT ||
+        (i64)offsets[i] + lengths[i] > length)
+      goto error;
+    // create_token strips their quotes
+    if ((types[i] == STRING_LITERAL || types[i] == CHAR_LITERAL) &&
+        lengths[i] < 2)
+      goto error;
+  }
+  // Numbers and decoded literals are looked up by binary search on their
+  // token
+  const i32 *number_tokens = (const i32 *)(data + layout.number_tokens);
+  for (i64 i = 0; i < header.numbers_length; i++)
+    if (number_tokens[i] >= header.tokens_length ||
+        (i > 0 && number_tokens[i] <= number_tokens[i - 1]))
+      goto error;
+  const i32 *decoded_tokens = (const i32 *)(data + layout.decoded_tokens);
+  const PackedString *decoded = (const PackedString *)(data + layout.decoded);
+  for (i64 i = 0; i < header.decoded_length; i++)
+    if (decoded_tokens[i] >= header.tokens_length ||
+        (i > 0 && decoded_tokens[i] <= decoded_tokens[i - 1]) ||
+        (i64)decoded[i].offset + decoded[i].length > header.decoded_size)
+      goto error;
+
+  *tokens = create_token_buffer(source, header.tokens_length);
+  if (*tokens == NULL)
+    goto error;
+  memcpy((*tokens)->types, types, sizeof(i8) * header.tokens_length);
+  memcpy((*tokens)->offsets, offsets, sizeof(i32) * header.tokens_length);
+  memcpy((*tokens)->lengths, lengths, sizeof(i32) * header.tokens_length);
+  (*tokens)->length = header.tokens_length;
+  if (!append_numbers(*tokens, number_tokens,
+                      (const Number *)(data + layout.numbers),
+                      header.numbers_length, 0) ||
+      !append_packed(*tokens, decoded_tokens, decoded,
+                     data + layout.decoded_data, header.decoded_length,
+                     header.decoded_size))
+    goto error;
+  LineTable lines = {.offsets = (i32 *)(data + layout.lines),
+                     .length = header.lines_length};
+  if (!line_table_append(&(*tokens)->lines, &lines))
+    goto error;
+
+  if (header.nodes_length > 0) {
+    *ast = create_ast(header.nodes_length);
+    if (*ast == NULL)
+      goto error;
+    memcpy((*ast)->nodes, data + layout.nodes,
+           sizeof(Node) * header.nodes_length);
+    (*ast)->length = header.nodes_length;
+    if (header.extra_length > 0) {
+      (*ast)->extra = malloc(sizeof(NodeId) * header.extra_length);
+      if ((*ast)->extra == NULL)
+        goto error;
+      memcpy((*ast)->extra, data + layout.extra,
+             sizeof(NodeId) * header.extra_length);
+      (*ast)->extra_length = (*ast)->extra_capacity = header.extra_length;
+    }
+    (*ast)->root = header.root;
+    if (!valid_ast(*ast, header.tokens_length))
+      goto error;
+  }
+
+  munmap((void *)data, size);
+  return 1;
+
+error:
+  if (*tokens != NULL)
+    free_token_buffer(*tokens), *tokens = NULL;
+  if (*ast != NULL)
+    free_ast(*ast), *ast = NULL;
+  munmap((void *)data, size);
+  return 0;
+}
+
+static i8 write_all(int fd, const char *data, i64 size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    data += n, size -= n;
+  }
+  return 1;
+}
+
+/**
+ * Store the tokens of a source, with its tree if there is one, replacing
+ * any entry of the same source. The entry is written to a temporary file
+ * renamed over the old one, so readers never see a partial entry
+ * @param directory
+ * @param hash of the source
+ * @param length of the source
+ * @param tokens
+ * @param ast NULL to only store the tokens
+ * @return true on success, false if the entry couldn't be written
+ */
+i8 cache_store(const char *directory, i64 hash, i64 length,
+               const TokenBuffer *tokens, const Ast *ast) {
+  CacheHeader header = {.version = CACHE_VERSION,
+                        .byte_order = CACHE_BYTE_ORDER,
+                        .node_size = sizeof(Node),
+                        .hash = hash,
+                        .source_length = length,
+                        .tokens_length = tokens->length,
+                        .numbers_length = tokens->numbers_length,
+                        .decoded_length = tokens->decoded_length,
+                        .decoded_size = decoded_size(tokens),
+                        .lines_length = tokens->lines.length};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  if (ast != NULL) {
+    header.nodes_length = ast->length;
+    header.extra_length = ast->extra_length;
+    header.root = ast->root;
+  }
+
+  // Zeroed so the padding between sections is the same on every write
+  CacheLayout layout = cache_layout(&header);
+  char *data = calloc(1, layout.size);
+  if (data == NULL)
+    return 0;
+  memcpy(data + layout.types, tokens->types, sizeof(i8) * tokens->length);
+  memcpy(data + layout.offsets, tokens->offsets, sizeof(i32) * tokens->length);
+  memcpy(data + layout.lengths, tokens->lengths, sizeof(i32) * tokens->length);
+  if (tokens->numbers_length > 0) {
+    memcpy(data + layout.number_tokens, tokens->number_tokens,
+           sizeof(i32) * tokens->numbers_length);
+    memcpy(data + layout.numbers, tokens->numbers,
+           sizeof(Number) * tokens->numbers_length);
+  }
+  if (tokens->decoded_length > 0) {
+    memcpy(data + layout.decoded_tokens, tokens->decoded_tokens,
+           sizeof(i32) * tokens->decoded_length);
+    pack_decoded(tokens, (PackedString *)(data + layout.decoded),
+                 data + layout.decoded_data);
+  }
+  if (tokens->lines.length > 0)
+    memcpy(data + layout.lines, tokens->lines.offsets,
+           sizeof(i32) * tokens->lines.length);
+  if (ast != NULL) {
+    memcpy(data + layout.nodes, ast->nodes, sizeof(Node) * ast->length);
+    if (ast->extra_length > 0)
+      memcpy(data + layout.extra, ast->extra,
+             sizeof(NodeId) * ast->extra_length);
+  }
+  memcpy(data, &header, sizeof(CacheHeader));
+  header.checksum = entry_checksum(data, layout.size);
+  memcpy(data, &header, sizeof(CacheHeader));
+
+  i8 stored = 0;
+  char *location = entry_location(directory, hash, "");
+  char *temporary = entry_location(directory, hash, ".XXXXXX");
+  int fd = location && temporary ? mkstemp(temporary) : -1;
+  if (fd >= 0) {
+    stored = write_all(fd, data, layout.size);
+    stored = close(fd) == 0 && stored;
+    stored = stored && rename(temporary, location) == 0;
+    if (!stored)
+      unlink(temporary);
+  }
+
+  free(location);
+  free(temporary);
+  free(data);
+  return stored;
+}
@@ -0,0 +1,48 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "../helper.h"
+#include "../lexer/token.h"
+#include "../parser/ast.h"
+
+// Entries hold the tokens and the syntax tree of a source, they are named
+// after the hash of the source. Bump CACHE_VERSION whenever the layout or
+// the lexer or parser output changes so older entries are ignored
+#define CACHE_MAGIC "MKCC"
+#define CACHE_VERSION 5
+#define CACHE_EXTENSION ".mkc"
+
+// Entries are only read back by the build that wrote them: they are in the
+// byte order and with the Node layout of the writer
+typedef struct {
+  char magic[4];
+  i32 version;
+  i32 byte_order;
+  i32 node_size;
+
+  i64 hash;
+  i64 source_length;
+  // Hash of the whole entry, this field taken as 0
+  i64 checksum;
+
+  i64 tokens_length;
+  i64 numbers_length;
+  // Literals with escape sequences and the size of their decoded values
+  i64 decoded_length;
+  i64 decoded_size;
+  i64 lines_length;
+  // 0 when the entry only holds tokens
+  i64 nodes_length;
+  i64 extra_length;
+  i64 root;
+} CacheHeader;
+
+i8 create_cache(const char *directory);
+
+i8 cache_load(const char *directory, i64 hash, const char *source,
+              i64 length, TokenBuffer **tokens, Ast **ast);
+
+i8 cache_store(const char *directory, i64 hash, i64 length,
+               const TokenBuffer *tokens, const Ast *ast);
+
+#endif
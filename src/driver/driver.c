@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE
+#include "driver.h"
+#include "../lexer/parallel.h"
+#include "../utils/hash.h"
+#include "cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  Project *project;
+  Arena *arena;
+  atomic_uint_fast64_t *next;
+  // Threads each file is split across, see tokenizer_parallel
+  i64 chunk_threads;
+} Worker;
+
+/**
+ * Create an empty project, files are added with add_source_path
+ * @return the project, NULL if there is no memory left
+ */
+Project *create_project(void) {
+  Project *project = malloc(sizeof(Project));
+  if (project == NULL)
+    return NULL;
+
+  project->symbols = create_symbol_table();
+  if (project->symbols == NULL) {
+    free(project);
+    return NULL;
+  }
+  project->files = NULL;
+  project->length = project->capacity = 0;
+  project->worker_arenas = NULL;
+  project->workers = 0;
+  arena_init(&project->paths);
+  project->cache_directory = NULL;
+  return project;
+}
+
+/**
+ * Append a file to the project
+ * @param project
+ * @param file_location copied into the project
+ * @return the new file, NULL if there is no memory left
+ */
+static FileResult *push_file(Project *project, const char *file_location) {
+  if (project->length == project->capacity) {
+    i64 capacity = project->capacity ? project->capacity * 2 : 64;
+    FileResult *grown =
+        realloc(project->files, sizeof(FileResult) * capacity);
+    if (grown == NULL)
+      return NULL;
+    project->files = grown;
+    project->capacity = capacity;
+  }
+
+  char *copy = arena_strndup(&project->paths, file_location,
+                             strlen(file_location));
+  if (copy == NULL)
+    return NULL;
+
+  FileResult *file = &project->files[project->length++];
+  file->file_location = copy;
+  file->source = NULL;
+  file->tokens = NULL;
+  file->ast = NULL;
+  file->hash = 0;
+  file->diagnostics = NULL;
+  file->diagnostics_length = 0;
+  file->error = 0;
+  return file;
+}
+
+static i8 has_source_extension(const char *name) {
+  i64 length = strlen(name), extension = strlen(SOURCE_EXTENSION);
+  return length > extension &&
+         strcmp(name + length - extension, SOURCE_EXTENSION) == 0;
+}
+
+static int compare_files(const void *a, const void *b) {
+  return strcmp(((const FileResult *)a)->file_location,
+                ((const FileResult *)b)->file_location);
+}
+
+/**
+ * Add every source file below path, hidden entries and links to
+ * directories are ignored
+ * @param project
+ * @param path
+ * @return true on success, false if there is no memory left
+ */
+static i8 walk_directory(Project *project, const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    FileResult *file = push_file(project, path);
+    if (file == NULL)
+      return 0;
+    file->error = errno;
+    return 1;
+  }
+
+  i8 ok = 1;
+  i64 path_length = strlen(path);
+  struct dirent *entry;
+  while (ok && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    i64 name_length = strlen(entry->d_name);
+    char *child = malloc(path_length + name_length + 2);
+    if (child == NULL) {
+      ok = 0;
+      break;
+    }
+    memcpy(child, path, path_length);
+    child[path_length] = '/';
+    memcpy(child + path_length + 1, entry->d_name, name_length + 1);
+
+    // Links are followed to files only, one to a directory could loop
+    struct stat info;
+    int found = lstat(child, &info);
+    i8 link = found == 0 && S_ISLNK(info.st_mode);
+    if (link)
+      found = stat(child, &info);
+    if (found == 0) {
+      if (S_ISDIR(info.st_mode)) {
+        if (!link)
+          ok = walk_directory(project, child);
+      } else if (S_ISREG(info.st_mode) && has_source_extension(entry->d_name))
+        ok = push_file(project, child) != NULL;
+    }
+    free(child);
+  }
+
+  closedir(dir);
+  return ok;
+}
+
+/**
+ * Add a file, or every source file inside a directory, to the project.
+ * Directory files are sorted so the result order doesn't depend on the file
+ * system. Unreadable paths are kept and reported through FileResult::error
+ * @param project
+ * @param path
+ * @return true on success, false if there is no memory left
+ */
+i8 add_source_path(Project *project, const char *path) {
+  struct stat info;
+  if (strcmp(path, "-") == 0 || stat(path, &info) != 0 ||
+      !S_ISDIR(info.st_mode))
+    return push_file(project, path) != NULL;
+
+  i64 first = project->length;
+  if (!walk_directory(project, path))
+    return 0;
+  qsort(project->files + first, project->length - first, sizeof(FileResult),
+        compare_files);
+  return 1;
+}
+
+/**
+ * Load and lex a single file. A file whose source has an entry in the
+ * project cache is not lexed, its tokens and tree come from the entry.
+ * Nothing here touches state shared with the other workers
+ * @param project
+ * @param file
+ * @param arena worker arena, receives the file diagnostics
+ * @param chunk_threads threads a large file is split across
+ */
+static void lex_file(const Project *project, FileResult *file, Arena *arena,
+                     i64 chunk_threads) {
+  file->source = load_source(file->file_location);
+  if (file->source == NULL) {
+    file->error = errno;
+    return;
+  }
+
+  const char *cache = project->cache_directory;
+  if (cache != NULL) {
+    file->hash = hash_bytes(file->source->data, file->source->length, 0);
+    if (cache_load(cache, file->hash, file->source->data,
+                   file->source->length, &file->tokens, &file->ast))
+      return;
+  }
+
+  Lexer *lexer = create_lexer(file->file_location, file->source->data,
+                              file->source->length);
+  if (lexer == NULL) {
+    file->error = file->source->length > TOKEN_MAX_OFFSET ? EFBIG : ENOMEM;
+    return;
+  }
+
+  file->tokens = tokenizer_parallel(lexer, chunk_threads);
+  if (file->tokens == NULL)
+    file->error = ENOMEM;
+  // Files with errors are lexed again every time to report them
+  else if (cache != NULL && lexer->diagnostics.length == 0)
+    cache_store(cache, file->hash, file->source->length, file->tokens, NULL);
+
+  Diagnostics *diagnostics = &lexer->diagnostics;
+  if (diagnostics->length > 0) {
+    file->diagnostics =
+        arena_alloc(arena, sizeof(Diagnostic) * diagnostics->length);
+    if (file->diagnostics == NULL)
+      file->error = ENOMEM;
+    else {
+      memcpy(file->diagnostics, diagnostics->items,
+             sizeof(Diagnostic) * diagnostics->length);
+      file->diagnostics_length = diagnostics->length;
+    }
+  }
+  free_lexer(lexer);
+}
+
+static void *run_worker(void *data) {
+  Worker *worker = data;
+  Project *project = worker->project;
+
+  while (1) {
+    i64 index = atomic_fetch_add(worker->next, 1);
+    if (index >= project->length)
+      break;
+    FileResult *file = &project->files[index];
+    lex_file(project, file, worker->arena, worker->chunk_threads);
+    // The symbol table is the only state the workers share
+    if (file->tokens != NULL && !intern_tokens(project->symbols, file->tokens))
+      file->error = ENOMEM;
+  }
+  return NULL;
+}
+
+/**
+ * Lex every file of the project on a pool of worker threads. Each worker
+ * takes the next file not lexed yet until there is none left. With fewer
+ * files than threads, the spare threads split large files into chunks
+ * @param project
+ * @param threads pool size, 0 to use one thread per online core
+ * @return true on success, false if the pool couldn't be created
+ */
+i8 lex_project(Project *project, i64 threads) {
+  if (threads == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cores > 0 ? cores : 1;
+  }
+  i64 pool = threads;
+  if (threads > project->length)
+    threads = project->length ? project->length : 1;
+
+  Worker *workers = malloc(sizeof(Worker) * threads);
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+  project->worker_arenas = malloc(sizeof(Arena) * threads);
+  if (workers == NULL || ids == NULL || project->worker_arenas == NULL) {
+    free(workers), free(ids);
+    free(project->worker_arenas), project->worker_arenas = NULL;
+    return 0;
+  }
+  project->workers = threads;
+
+  atomic_uint_fast64_t next = 0;
+  for (i64 i = 0; i < threads; i++) {
+    arena_init(&project->worker_arenas[i]);
+    workers[i].project = project;
+    workers[i].arena = &project->worker_arenas[i];
+    workers[i].next = &next;
+    workers[i].chunk_threads = pool / threads;
+  }
+
+  // Worker 0 runs on the calling thread, as does any worker whose thread
+  // can't be started
+  i8 *started = calloc(threads, sizeof(i8));
+  for (i64 i = 1; i < threads && started != NULL; i++)
+    started[i] = pthread_create(&ids[i], NULL, run_worker, &workers[i]) == 0;
+  run_worker(&workers[0]);
+  for (i64 i = 1; i < threads && started != NULL; i++)
+    if (started[i])
+      pthread_join(ids[i], NULL);
+
+  free(started), free(ids), free(workers);
+  return 1;
+}
+
+void free_project(Project *project) {
+  for (i64 i = 0; i < project->length; i++) {
+    FileResult *file = &project->files[i];
+    if (file->tokens != NULL)
+      free_token_buffer(file->tokens);
+    if (file->ast != NULL)
+      free_ast(file->ast);
+    if (file->source != NULL)
+      free_source(file->source);
+  }
+
+  for (i64 i = 0; i < project->workers; i++)
+    arena_free(&project->worker_arenas[i]);
+  free(project->worker_arenas);
+  free(project->files);
+  arena_free(&project->paths);
+  free_symbol_table(project->symbols);
+  free(project);
+}
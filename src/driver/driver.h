@@ -0,0 +1,56 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "../helper.h"
+#include "../lexer/lexer.h"
+#include "../parser/ast.h"
+#include "../utils/arena.h"
+#include "../utils/intern.h"
+#include "../utils/utils.h"
+
+#define SOURCE_EXTENSION ".monkc"
+
+typedef struct {
+  const char *file_location;
+  SourceFile *source;
+  TokenBuffer *tokens;
+  // Tree loaded from the cache with the tokens, NULL when it must be parsed
+  Ast *ast;
+  // Hash of the source, set when the project has a cache
+  i64 hash;
+
+  Diagnostic *diagnostics;
+  i64 diagnostics_length;
+
+  // errno when the file couldn't be read or lexed, 0 otherwise
+  int error;
+} FileResult;
+
+typedef struct {
+  FileResult *files;
+  i64 length;
+  i64 capacity;
+
+  // File locations found while walking directories
+  Arena paths;
+
+  // Directory of the token and tree cache, NULL when there is none
+  const char *cache_directory;
+
+  // Identifiers of every file, interned by the workers once a file is lexed
+  SymbolTable *symbols;
+
+  // One arena per worker thread for the per file diagnostics
+  Arena *worker_arenas;
+  i64 workers;
+} Project;
+
+Project *create_project(void);
+
+i8 add_source_path(Project *project, const char *path);
+
+i8 lex_project(Project *project, i64 threads);
+
+void free_project(Project *project);
+
+#endif
@@ -5,6 +5,8 @@
 
 typedef uint_fast8_t if8;
 typedef uint8_t i8;
+typedef uint16_t i16;
+typedef uint32_t i32;
 typedef uint64_t i64;
 
 #endif
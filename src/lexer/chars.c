@@ -0,0 +1,58 @@
+#include "chars.h"
+
+#define DIGIT (START_NUMBER | CHAR_WORD | CHAR_DIGIT | CHAR_HEX_DIGIT)
+#define LETTER (START_IDENTIFIER | CHAR_WORD)
+#define HEX_LETTER (LETTER | CHAR_HEX_DIGIT)
+#define UTF8_LEAD (START_IDENTIFIER | CHAR_UTF8_LEAD)
+
+// Every byte not listed is illegal outside of strings and comments
+const i8 char_classes[256] = {
+    ['0'] = DIGIT, ['1'] = DIGIT, ['2'] = DIGIT, ['3'] = DIGIT, ['4'] = DIGIT,
+    ['5'] = DIGIT, ['6'] = DIGIT, ['7'] = DIGIT, ['8'] = DIGIT, ['9'] = DIGIT,
+    ['a'] = HEX_LETTER, ['b'] = HEX_LETTER, ['c'] = HEX_LETTER,
+    ['d'] = HEX_LETTER, ['e'] = HEX_LETTER, ['f'] = HEX_LETTER,
+    ['A'] = HEX_LETTER, ['B'] = HEX_LETTER, ['C'] = HEX_LETTER,
+    ['D'] = HEX_LETTER, ['E'] = HEX_LETTER, ['F'] = HEX_LETTER,
+    ['g'] = LETTER, ['h'] = LETTER, ['i'] = LETTER, ['j'] = LETTER,
+    ['k'] = LETTER, ['l'] = LETTER, ['m'] = LETTER, ['n'] = LETTER,
+    ['o'] = LETTER, ['p'] = LETTER, ['q'] = LETTER, ['r'] = LETTER,
+    ['s'] = LETTER, ['t'] = LETTER, ['u'] = LETTER, ['v'] = LETTER,
+    ['w'] = LETTER, ['x'] = LETTER, ['y'] = LETTER, ['z'] = LETTER,
+    ['G'] = LETTER, ['H'] = LETTER, ['I'] = LETTER, ['J'] = LETTER,
+    ['K'] = LETTER, ['L'] = LETTER, ['M'] = LETTER, ['N'] = LETTER,
+    ['O'] = LETTER, ['P'] = LETTER, ['Q'] = LETTER, ['R'] = LETTER,
+    ['S'] = LETTER, ['T'] = LETTER, ['U'] = LETTER, ['V'] = LETTER,
+    ['W'] = LETTER, ['X'] = LETTER, ['Y'] = LETTER, ['Z'] = LETTER,
+    // Continues identifiers and splits digits, but starts nothing: _a is an
+    // illegal character then a, as it always lexed
+    ['_'] = CHAR_WORD,
+    ['+'] = START_OPERATOR, ['-'] = START_OPERATOR, ['*'] = START_OPERATOR,
+    ['/'] = START_OPERATOR, ['%'] = START_OPERATOR, ['!'] = START_OPERATOR,
+    ['|'] = START_OPERATOR, ['&'] = START_OPERATOR, ['$'] = START_OPERATOR,
+    ['^'] = START_OPERATOR, ['~'] = START_OPERATOR, ['='] = START_OPERATOR,
+    ['>'] = START_OPERATOR, ['<'] = START_OPERATOR, [':'] = START_OPERATOR,
+    ['?'] = START_OPERATOR,
+    ['{'] = START_SEPARATOR, ['}'] = START_SEPARATOR, ['['] = START_SEPARATOR,
+    [']'] = START_SEPARATOR, ['('] = START_SEPARATOR, [')'] = START_SEPARATOR,
+    [';'] = START_SEPARATOR, [','] = START_SEPARATOR, ['.'] = START_SEPARATOR,
+    ['"'] = START_QUOTE, ['\''] = START_QUOTE,
+    ['\n'] = CHAR_BREAKLINE, ['\r'] = CHAR_BREAKLINE,
+    // 0xC0, 0xC1 and past 0xF4 never start a valid sequence
+    [0xC2] = UTF8_LEAD, [0xC3] = UTF8_LEAD, [0xC4] = UTF8_LEAD,
+    [0xC5] = UTF8_LEAD, [0xC6] = UTF8_LEAD, [0xC7] = UTF8_LEAD,
+    [0xC8] = UTF8_LEAD, [0xC9] = UTF8_LEAD, [0xCA] = UTF8_LEAD,
+    [0xCB] = UTF8_LEAD, [0xCC] = UTF8_LEAD, [0xCD] = UTF8_LEAD,
+    [0xCE] = UTF8_LEAD, [0xCF] = UTF8_LEAD, [0xD0] = UTF8_LEAD,
+    [0xD1] = UTF8_LEAD, [0xD2] = UTF8_LEAD, [0xD3] = UTF8_LEAD,
+    [0xD4] = UTF8_LEAD, [0xD5] = UTF8_LEAD, [0xD6] = UTF8_LEAD,
+    [0xD7] = UTF8_LEAD, [0xD8] = UTF8_LEAD, [0xD9] = UTF8_LEAD,
+    [0xDA] = UTF8_LEAD, [0xDB] = UTF8_LEAD, [0xDC] = UTF8_LEAD,
+    [0xDD] = UTF8_LEAD, [0xDE] = UTF8_LEAD, [0xDF] = UTF8_LEAD,
+    [0xE0] = UTF8_LEAD, [0xE1] = UTF8_LEAD, [0xE2] = UTF8_LEAD,
+    [0xE3] = UTF8_LEAD, [0xE4] = UTF8_LEAD, [0xE5] = UTF8_LEAD,
+    [0xE6] = UTF8_LEAD, [0xE7] = UTF8_LEAD, [0xE8] = UTF8_LEAD,
+    [0xE9] = UTF8_LEAD, [0xEA] = UTF8_LEAD, [0xEB] = UTF8_LEAD,
+    [0xEC] = UTF8_LEAD, [0xED] = UTF8_LEAD, [0xEE] = UTF8_LEAD,
+    [0xEF] = UTF8_LEAD, [0xF0] = UTF8_LEAD, [0xF1] = UTF8_LEAD,
+    [0xF2] = UTF8_LEAD, [0xF3] = UTF8_LEAD, [0xF4] = UTF8_LEAD,
+};
@@ -0,0 +1,38 @@
+#ifndef CHARS_H
+#define CHARS_H
+
+#include "../helper.h"
+
+// Class of every byte: the kind of token it starts in the low bits, then
+// flags. The lexer looks a byte up once instead of going through a chain of
+// comparisons per predicate
+
+// Kind of token a byte starts, whitespace and comments are skipped before
+typedef enum {
+  START_ILLEGAL,
+  START_IDENTIFIER,
+  START_NUMBER,
+  START_OPERATOR,
+  START_SEPARATOR,
+  START_QUOTE,
+} CharStart;
+
+#define CHAR_START_MASK 0x07
+// ASCII letters, digits and '_', the characters of identifiers and suffixes
+#define CHAR_WORD (1 << 3)
+#define CHAR_DIGIT (1 << 4)
+#define CHAR_HEX_DIGIT (1 << 5)
+#define CHAR_BREAKLINE (1 << 6)
+// First byte of a multibyte UTF-8 sequence, only a valid sequence counts as
+// an identifier character
+#define CHAR_UTF8_LEAD (1 << 7)
+
+extern const i8 char_classes[256];
+
+static inline i8 char_class(char c) { return char_classes[(unsigned char)c]; }
+
+static inline CharStart char_start(char c) {
+  return char_class(c) & CHAR_START_MASK;
+}
+
+#endif
@@ -0,0 +1,240 @@
+#include "dump.h"
+#include "escape.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest piece formatted straight into the buffer: an integer, an escape
+#define DUMP_PIECE_MAX 32
+
+/**
+ * Write every byte, retrying short and interrupted writes
+ * @param fd
+ * @param data
+ * @param size
+ * @return false if the write failed
+ */
+static i8 write_all(int fd, const char *data, i64 size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    data += written, size -= written;
+  }
+  return 1;
+}
+
+/**
+ * Create a dump with an empty buffer
+ * @param dump
+ * @param fd every byte is written to
+ * @param format
+ * @return false if there is no memory left
+ */
+i8 token_dump_init(TokenDump *dump, int fd, DumpFormat format) {
+  dump->fd = fd;
+  dump->format = format;
+  dump->length = 0;
+  dump->capacity = TOKEN_DUMP_CAPACITY;
+  dump->failed = 0;
+  dump->buffer = malloc(dump->capacity);
+  return dump->buffer != NULL;
+}
+
+/**
+ * Write out the buffer and empty it. Once a write failed nothing else is
+ * written
+ * @param dump
+ * @return false if a write failed
+ */
+i8 token_dump_flush(TokenDump *dump) {
+  if (!dump->failed && dump->length > 0 &&
+      !write_all(dump->fd, dump->buffer, dump->length))
+    dump->failed = 1;
+  dump->length = 0;
+  return !dump->failed;
+}
+
+/**
+ * Make room for a piece of at most DUMP_PIECE_MAX bytes
+ * @param dump
+ * @return where the piece goes
+ */
+static char *dump_reserve(TokenDump *dump) {
+  if (dump->capacity - dump->length < DUMP_PIECE_MAX)
+    token_dump_flush(dump);
+  return dump->buffer + dump->length;
+}
+
+static void dump_bytes(TokenDump *dump, const char *data, i64 size) {
+  if (dump->capacity - dump->length < size) {
+    token_dump_flush(dump);
+    // Too large to be buffered, written as is
+    if (size > dump->capacity) {
+      if (!dump->failed && !write_all(dump->fd, data, size))
+        dump->failed = 1;
+      return;
+    }
+  }
+  memcpy(dump->buffer + dump->length, data, size);
+  dump->length += size;
+}
+
+#define dump_literal(dump, literal)                                            \
+  dump_bytes(dump, literal, sizeof(literal) - 1)
+
+static void dump_integer(TokenDump *dump, i64 value) {
+  char digits[20];
+  i64 count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+
+  char *out = dump_reserve(dump);
+  memcpy(out, digits + sizeof(digits) - count, count);
+  dump->length += count;
+}
+
+/**
+ * Check for a valid UTF-8 sequence at the start of value without reading
+ * past its end
+ * @param value
+ * @param length bytes left in value
+ * @return length of the sequence, 0 if it isn't valid
+ */
+static i64 utf8_sequence_within(const char *value, i64 length) {
+  char sequence[5] = {0};
+  memcpy(sequence, value, length < 4 ? length : 4);
+  return utf8_sequence_length(sequence, NULL);
+}
+
+/**
+ * Dump a value with its control characters escaped, JSON style, so a token
+ * never spans lines. Bytes past ASCII are copied as they are, except in JSON
+ * where the ones not part of valid UTF-8 are escaped to keep the output valid
+ * @param dump
+ * @param value
+ * @param length
+ * @param json if '"', '\\' and invalid UTF-8 are escaped too
+ */
+static void dump_escaped(TokenDump *dump, const char *value, i64 length,
+                         i8 json) {
+  static const char hex[] = "0123456789abcdef";
+  i64 run = 0;
+  for (i64 i = 0; i < length; i++) {
+    unsigned char c = value[i];
+    if (c >= 0x80 && json) {
+      i64 sequence = utf8_sequence_within(value + i, length - i);
+      if (sequence > 0) {
+        i += sequence - 1;
+        continue;
+      }
+    } else if (c >= 0x20 && (!json || (c != '"' && c != '\\')))
+      continue;
+
+    dump_bytes(dump, value + run, i - run);
+    run = i + 1;
+    char *out = dump_reserve(dump);
+    out[0] = '\\';
+    switch (c) {
+    case '"':
+    case '\\':
+      out[1] = c, dump->length += 2;
+      break;
+    case '\n':
+      out[1] = 'n', dump->length += 2;
+      break;
+    case '\t':
+      out[1] = 't', dump->length += 2;
+      break;
+    case '\r':
+      out[1] = 'r', dump->length += 2;
+      break;
+    default:
+      memcpy(out + 1, "u00", 3);
+      out[4] = hex[c >> 4], out[5] = hex[c & 0xf];
+      dump->length += 6;
+      break;
+    }
+  }
+  dump_bytes(dump, value + run, length - run);
+}
+
+/**
+ * Dump a JSON string, quotes included
+ * @param dump
+ * @param value
+ * @param length
+ */
+static void dump_json_string(TokenDump *dump, const char *value, i64 length) {
+  dump_literal(dump, "\"");
+  dump_escaped(dump, value, length, 1);
+  dump_literal(dump, "\"");
+}
+
+/**
+ * Start the listing of a file, only the text format has a line for it
+ * @param dump
+ * @param file_location
+ */
+void dump_file(TokenDump *dump, const char *file_location) {
+  if (dump->format != DUMP_TEXT)
+    return;
+  dump_bytes(dump, file_location, strlen(file_location));
+  dump_literal(dump, " ↴\n");
+}
+
+/**
+ * Format a token into the buffer, the text format is the one of print_token
+ * @param dump
+ * @param file_location of the token, only used by JSON Lines
+ * @param token
+ */
+void dump_token(TokenDump *dump, const char *file_location,
+                const Token *token) {
+  i64 length;
+  const char *name = token_type_name(token->type, &length);
+
+  if (dump->format == DUMP_JSON_LINES) {
+    dump_literal(dump, "{\"file\":");
+    dump_json_string(dump, file_location, strlen(file_location));
+    dump_literal(dump, ",\"type\":\"");
+    dump_bytes(dump, name, length);
+    dump_literal(dump, "\",\"value\":");
+    dump_json_string(dump, token->value, token->length);
+    dump_literal(dump, ",\"start\":");
+    dump_integer(dump, token->pos.start);
+    dump_literal(dump, ",\"end\":");
+    dump_integer(dump, token->pos.end);
+    dump_literal(dump, ",\"line\":");
+    dump_integer(dump, token->pos.line);
+    dump_literal(dump, ",\"column\":");
+    dump_integer(dump, token->pos.column);
+    dump_literal(dump, "}\n");
+    return;
+  }
+
+  dump_literal(dump, "(");
+  dump_bytes(dump, name, length);
+  dump_literal(dump, ", ");
+  // Decoded literals can hold breaklines and other control characters
+  dump_escaped(dump, token->value, token->length, 0);
+  dump_literal(dump, ")  -> [ Start: ");
+  dump_integer(dump, token->pos.start);
+  dump_literal(dump, ", End: ");
+  dump_integer(dump, token->pos.end);
+  dump_literal(dump, " ] [ Line: ");
+  dump_integer(dump, token->pos.line);
+  dump_literal(dump, ", Column: ");
+  dump_integer(dump, token->pos.column);
+  dump_literal(dump, " ]\n");
+}
+
+void token_dump_free(TokenDump *dump) {
+  free(dump->buffer), dump->buffer = NULL;
+}
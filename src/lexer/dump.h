@@ -0,0 +1,40 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "../helper.h"
+#include "token.h"
+
+// Bytes formatted before they are written out at once
+#define TOKEN_DUMP_CAPACITY (1 << 20)
+
+typedef enum {
+  // The print_token listing, each file preceded by its location
+  DUMP_TEXT,
+  // One JSON object per token and line, with the file location in each
+  DUMP_JSON_LINES,
+} DumpFormat;
+
+// Token listing formatted into one buffer, written out by a single write
+// whenever it is full
+typedef struct {
+  int fd;
+  DumpFormat format;
+  char *buffer;
+  i64 length;
+  i64 capacity;
+  // Set by the first failed write, errno tells why
+  i8 failed;
+} TokenDump;
+
+i8 token_dump_init(TokenDump *dump, int fd, DumpFormat format);
+
+void dump_file(TokenDump *dump, const char *file_location);
+
+void dump_token(TokenDump *dump, const char *file_location,
+                const Token *token);
+
+i8 token_dump_flush(TokenDump *dump);
+
+void token_dump_free(TokenDump *dump);
+
+#endif
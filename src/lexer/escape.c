@@ -0,0 +1,168 @@
+#include "escape.h"
+#include <string.h>
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    return (c | 0x20) - 'a' + 10;
+  return -1;
+}
+
+/**
+ * Validate the UTF-8 sequence at p. Overlong forms, surrogates and code
+ * points past CODE_POINT_MAX are rejected. Never reads past a '\0' since it
+ * can't be a continuation byte
+ * @param p
+ * @param code set to the code point of a valid sequence, may be NULL
+ * @return length of the sequence, 0 if it isn't valid
+ */
+i64 utf8_sequence_length(const char *p, int64_t *code) {
+  const unsigned char *s = (const unsigned char *)p;
+  i64 length, value, min;
+  if (s[0] < 0x80)
+    length = 1, value = s[0], min = 0;
+  else if ((s[0] & 0xE0) == 0xC0)
+    length = 2, value = s[0] & 0x1F, min = 0x80;
+  else if ((s[0] & 0xF0) == 0xE0)
+    length = 3, value = s[0] & 0x0F, min = 0x800;
+  else if ((s[0] & 0xF8) == 0xF0)
+    length = 4, value = s[0] & 0x07, min = 0x10000;
+  else
+    return 0;
+
+  for (i64 i = 1; i < length; i++) {
+    if ((s[i] & 0xC0) != 0x80)
+      return 0;
+    value = value << 6 | (s[i] & 0x3F);
+  }
+  if (value < min || value > CODE_POINT_MAX ||
+      (value >= SURROGATE_FIRST && value <= SURROGATE_LAST))
+    return 0;
+  if (code != NULL)
+    *code = value;
+  return length;
+}
+
+/**
+ * Write the UTF-8 form of a valid code point
+ * @param code
+ * @param out receives up to 4 bytes
+ * @return number of bytes written
+ */
+i64 encode_utf8(int64_t code, char *out) {
+  if (code < 0x80) {
+    out[0] = code;
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = 0xC0 | code >> 6;
+    out[1] = 0x80 | (code & 0x3F);
+    return 2;
+  }
+  if (code < 0x10000) {
+    out[0] = 0xE0 | code >> 12;
+    out[1] = 0x80 | (code >> 6 & 0x3F);
+    out[2] = 0x80 | (code & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | code >> 18;
+  out[1] = 0x80 | (code >> 12 & 0x3F);
+  out[2] = 0x80 | (code >> 6 & 0x3F);
+  out[3] = 0x80 | (code & 0x3F);
+  return 4;
+}
+
+/**
+ * Read the escape sequence starting at a backslash: \n \t \r \0 \\ \" \',
+ * \x followed by two hex digits up to 7F, or \u{...} with one to six hex
+ * digits naming a code point that isn't a surrogate. An invalid sequence
+ * still ends where a valid one would, only hex digits and braces are taken
+ * past its first character so it never hides a closing quote. The source
+ * must be '\0' terminated
+ * @param source
+ * @param index of the backslash
+ * @param code set to the code point, -1 if the sequence isn't valid
+ * @return index of the first character after the sequence
+ */
+i64 read_escape(const char *source, i64 index, int64_t *code) {
+  i64 i = index + 1;
+  *code = -1;
+  switch (source[i]) {
+  case 'n':
+    *code = '\n';
+    return i + 1;
+  case 't':
+    *code = '\t';
+    return i + 1;
+  case 'r':
+    *code = '\r';
+    return i + 1;
+  case '0':
+    *code = '\0';
+    return i + 1;
+  case '\\':
+  case '"':
+  case '\'':
+    *code = source[i];
+    return i + 1;
+
+  case 'x': {
+    int high = hex_value(source[i + 1]);
+    if (high < 0)
+      return i + 1;
+    int low = hex_value(source[i + 2]);
+    if (low < 0)
+      return i + 2;
+    // Larger bytes would make the string invalid UTF-8
+    if (high < 8)
+      *code = high << 4 | low;
+    return i + 3;
+  }
+
+  case 'u': {
+    if (source[i + 1] != '{')
+      return i + 1;
+    i64 value = 0, digits = 0;
+    for (i += 2; hex_value(source[i]) >= 0; i++, digits++)
+      if (value <= CODE_POINT_MAX)
+        value = value << 4 | hex_value(source[i]);
+    if (source[i] != '}')
+      return i;
+    if (digits > 0 && digits <= 6 && value <= CODE_POINT_MAX &&
+        (value < SURROGATE_FIRST || value > SURROGATE_LAST))
+      *code = value;
+    return i + 1;
+  }
+
+  case '\0':
+    return i;
+  default:
+    return i + 1;
+  }
+}
+
+/**
+ * Decode the body of a literal whose escape sequences were all validated by
+ * read_escape. The result is never longer than the body
+ * @param body between the quotes
+ * @param length
+ * @param out receives the value, at least length bytes
+ * @return length of the value
+ */
+i64 decode_escapes(const char *body, i64 length, char *out) {
+  i64 written = 0, i = 0;
+  while (i < length) {
+    i64 run = i;
+    while (i < length && body[i] != '\\')
+      i++;
+    memcpy(out + written, body + run, i - run);
+    written += i - run;
+    if (i == length)
+      break;
+    int64_t code;
+    i = read_escape(body, i, &code);
+    written += encode_utf8(code, out + written);
+  }
+  return written;
+}
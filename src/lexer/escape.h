@@ -0,0 +1,19 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "../helper.h"
+
+// Largest code point, and the surrogates UTF-8 can't hold
+#define CODE_POINT_MAX 0x10FFFF
+#define SURROGATE_FIRST 0xD800
+#define SURROGATE_LAST 0xDFFF
+
+i64 utf8_sequence_length(const char *p, int64_t *code);
+
+i64 encode_utf8(int64_t code, char *out);
+
+i64 read_escape(const char *source, i64 index, int64_t *code);
+
+i64 decode_escapes(const char *body, i64 length, char *out);
+
+#endif
@@ -0,0 +1,112 @@
+#include "incremental.h"
+#include <stdlib.h>
+
+// Smallest growth of the string pool worth compacting it for
+#define RELEX_COMPACT_MIN (64 * 1024)
+
+static i64 token_end(const TokenBuffer *tokens, i64 index) {
+  return (i64)tokens->offsets[index] + tokens->lengths[index];
+}
+
+/**
+ * Find the first token the edit may change. The lexer never looks further
+ * than two characters after a token, for "1..2" or "1e+5", so a token ending
+ * at least two characters before the edit offset lexes the same and the lexer
+ * can restart at its end
+ * @param tokens
+ * @param offset
+ * @return index of the first token ending at or after offset - 1
+ */
+static i64 find_restart(const TokenBuffer *tokens, i64 offset) {
+  i64 low = 0, high = tokens->length - 1;
+  while (low < high) {
+    i64 middle = low + (high - low) / 2;
+    if (token_end(tokens, middle) + 1 < offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+/**
+ * Bring a token buffer up to date with an edit of its source. Tokens are
+ * lexed again from the last one the edit can't change until a new token ends
+ * where an old one did past the edit, the lexer only depends on its position
+ * so every following token is the same, only shifted. Lexing the whole
+ * edited source gives the same tokens.
+ * Diagnostics are not collected, errors stay visible as TK_ERROR tokens
+ * @param tokens lexed from the source before the edit, the whole buffer
+ * must be rebuilt with tokenizer() when this fails
+ * @param source the edited source, which must have a '\0' at source[length]
+ * @param length
+ * @param edit
+ * @return true on success, false if there is no memory left or if the source
+ * is larger than TOKEN_MAX_OFFSET
+ */
+i8 relex_tokens(TokenBuffer *tokens, const char *source, i64 length,
+                SourceEdit edit) {
+  if (length > TOKEN_MAX_OFFSET ||
+      !line_table_edit(&tokens->lines, source, edit.offset, edit.removed,
+                       edit.inserted))
+    return 0;
+
+  i64 restart = find_restart(tokens, edit.offset);
+  i64 start = restart ? token_end(tokens, restart - 1) : 0;
+  TokenBuffer *fresh = create_token_buffer(source, 16);
+  Lexer *lexer =
+      create_chunk_lexer(NULL, source, &tokens->lines, start, length);
+  if (fresh == NULL || lexer == NULL)
+    goto error;
+  // Decoded straight into the pool of the buffer, the values of the tokens
+  // replaced stay there until it is compacted
+  lexer->strings = &tokens->strings;
+
+  // Old tokens are compared in the coordinates of the edited source, an old
+  // token at or past the end of the edit is shifted by inserted - removed.
+  // Without a sync point, e.g. when the edit removed the '\0' that ended the
+  // old lex, the rest of the source is lexed again up to TK_EOF
+  i64 old = restart, edit_end = edit.offset + edit.inserted;
+  while (1) {
+    Token token = lexer_next_token(lexer);
+    if (lexer->out_of_memory || !append_token(fresh, token))
+      goto error;
+    if (token.type == TK_EOF) {
+      old = tokens->length;
+      break;
+    }
+    if (token.pos.end < edit_end)
+      continue;
+
+    i64 end = token.pos.end + edit.removed - edit.inserted;
+    while (old < tokens->length && token_end(tokens, old) < end)
+      old++;
+    if (old < tokens->length && token_end(tokens, old) == end &&
+        tokens->types[old] != TK_EOF) {
+      old++;
+      break;
+    }
+  }
+
+  i64 count = fresh->length;
+  if (!replace_tokens(tokens, restart, old, fresh))
+    goto error;
+  for (i64 i = restart + count; i < tokens->length; i++)
+    tokens->offsets[i] = tokens->offsets[i] - edit.removed + edit.inserted;
+  tokens->source = source;
+  // Once the pool doubled the compaction cost is amortized over the edits
+  // that grew it. Without memory left for it the pool just stays larger
+  if (arena_used(&tokens->strings) >
+      2 * tokens->strings_compacted + RELEX_COMPACT_MIN)
+    compact_strings(tokens);
+
+  free_token_buffer(fresh), free_lexer(lexer);
+  return 1;
+
+error:
+  if (fresh != NULL)
+    free_token_buffer(fresh);
+  if (lexer != NULL)
+    free_lexer(lexer);
+  return 0;
+}
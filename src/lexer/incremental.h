@@ -0,0 +1,16 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "lexer.h"
+
+// removed characters starting at offset were replaced by inserted ones
+typedef struct {
+  i64 offset;
+  i64 removed;
+  i64 inserted;
+} SourceEdit;
+
+i8 relex_tokens(TokenBuffer *tokens, const char *source, i64 length,
+                SourceEdit edit);
+
+#endif
@@ -0,0 +1,78 @@
+#include "keyword.h"
+#include <string.h>
+
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 8
+#define KEYWORD_TABLE_SIZE 128
+
+typedef struct {
+  const char *name;
+  i64 length;
+  TokenType type;
+} Keyword;
+
+/**
+ * Perfect hash over the keyword set. Every keyword lands on its own slot, so a
+ * lookup is one hash plus one memcmp. If a keyword is added, the table below
+ * has to be regenerated so that the slots stay collision free
+ * @param value
+ * @param length
+ * @return slot inside keywords table
+ */
+static inline i64 keyword_hash(const unsigned char *value, i64 length) {
+  return (length + value[0] + 7 * value[1] + 9 * value[length - 1]) &
+         (KEYWORD_TABLE_SIZE - 1);
+}
+
+// clang-format off
+static const Keyword keywords[KEYWORD_TABLE_SIZE] = {
+  [0] = {"double", 6, DOUBLE},
+  [1] = {"continue", 8, CONTINUE},
+  [2] = {"int", 3, INT},
+  [5] = {"const", 5, CONST},
+  [7] = {"void", 4, VOID},
+  [16] = {"f32", 3, F32},
+  [19] = {"i32", 3, I32},
+  [24] = {"long", 4, LONG},
+  [25] = {"return", 6, RETURN},
+  [27] = {"case", 4, CASE},
+  [30] = {"foreach", 7, FOREACH},
+  [31] = {"false", 5, FALSE},
+  [35] = {"true", 4, TRUE},
+  [38] = {"f16", 3, F16},
+  [41] = {"i16", 3, I16},
+  [55] = {"f64", 3, F64},
+  [57] = {"struct", 6, STRUCT},
+  [58] = {"i64", 3, I64},
+  [64] = {"enum", 4, ENUM},
+  [65] = {"char", 4, CHAR},
+  [68] = {"string", 6, STRING},
+  [72] = {"break", 5, BREAK},
+  [75] = {"if", 2, IF},
+  [80] = {"boolean", 7, BOOLEAN},
+  [86] = {"do", 2, DO},
+  [93] = {"from", 4, FROM},
+  [95] = {"typeof", 6, TYPEOF},
+  [97] = {"while", 5, WHILE},
+  [98] = {"switch", 6, SWITCH},
+  [104] = {"f8", 2, F8},
+  [106] = {"else", 4, ELSE},
+  [107] = {"i8", 2, I8},
+  [110] = {"sizeof", 6, SIZEOF},
+  [113] = {"null", 4, TK_NULL},
+  [115] = {"float", 5, FLOAT},
+  [116] = {"for", 3, FOR},
+  [126] = {"import", 6, IMPORT},
+};
+// clang-format on
+
+TokenType lookup_keyword(const char *value, i64 length) {
+  if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
+    return IDENTIFIER;
+
+  const Keyword *keyword =
+      &keywords[keyword_hash((const unsigned char *)value, length)];
+  if (keyword->length != length || memcmp(keyword->name, value, length) != 0)
+    return IDENTIFIER;
+  return keyword->type;
+}
@@ -0,0 +1,15 @@
+#ifndef KEYWORD_H
+#define KEYWORD_H
+
+#include "token.h"
+#include "../helper.h"
+
+/**
+ * Classify an already scanned identifier
+ * @param value start of the identifier inside the source
+ * @param length identifier length
+ * @return the keyword token type, or IDENTIFIER if it is not a keyword
+ */
+TokenType lookup_keyword(const char *value, i64 length);
+
+#endif
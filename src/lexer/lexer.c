@@ -1,69 +1,86 @@
 #include "lexer.h"
+#include "chars.h"
+#include "escape.h"
+#include "keyword.h"
+#include "number.h"
+#include "scan.h"
 #include "token.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static void throw_lexer_error(char *error_name, char *details, Position *pos) {
-  fprintf(stderr, "Error on file \"%s\" at line %ld and column %ld\n%s: %s.\n",
-          pos->file_location, pos->line, pos->column, error_name, details);
-  exit(EXIT_FAILURE);
+static const char *diagnostic_kind_string(DiagnosticKind kind) {
+  switch (kind) {
+  case ILLEGAL_CHARACTER:
+    return "IllegalCharacter";
+  case UNMATCHED_STRING:
+    return "UnmatchedString";
+  case LEXICAL_ERROR:
+    return "LexicalError";
+  case SYNTAX_ERROR:
+    return "SyntaxError";
+  case TYPE_ERROR:
+    return "TypeError";
+  case UNSUPPORTED_FEATURE:
+    return "UnsupportedFeature";
+  case RUNTIME_ERROR:
+    return "RuntimeError";
+  default:
+    return "UNKNOW";
+  }
 }
 
 /**
- * Get current lexer character
+ * Record a lexer error, lexing goes on after it. If there is no memory left to
+ * record it the lexer is flagged out of memory
  * @param lexer
- * @return Current lexer character
- */
-static char get_current_char(Lexer *lexer) {
-  return lexer->source[lexer->pos->index];
-}
-
-/**
- * Checks if the character is alphanumeric
- * @param char
- * @return true if the character is alphanumeric, false otherwise
+ * @param kind
+ * @param details
+ * @param pos where the error happened, only its index is used
  */
-i8 is_alphanumeric(char c) {
-  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
-      (c >= '0' && c <= '9'))
-    return 1;
-  return 0;
+static void report_lexer_error(Lexer *lexer, DiagnosticKind kind,
+                               const char *details, Position *pos) {
+  Diagnostic diagnostic = {.pos = *pos, .kind = kind, .details = details};
+  line_table_lookup(&lexer->lines, pos->index, &diagnostic.pos.line,
+                    &diagnostic.pos.column);
+  if (!append_diagnostic(&lexer->diagnostics, diagnostic))
+    lexer->out_of_memory = 1;
 }
 
 /**
- * Checks if the character is new line
- * @param character
- * @return true if the character is a new line, false otherwise
+ * Append a diagnostic, growing the buffer when it is full
+ * @param diagnostics
+ * @param diagnostic
+ * @return true on success, false if there is no memory left
  */
-static i8 is_breakline(char character) {
-  if (character == '\n' || character == '\r')
-    return 1;
-  return 0;
+i8 append_diagnostic(Diagnostics *diagnostics, Diagnostic diagnostic) {
+  if (diagnostics->length == diagnostics->capacity) {
+    i64 capacity = diagnostics->capacity ? diagnostics->capacity * 2 : 16;
+    Diagnostic *grown =
+        realloc(diagnostics->items, sizeof(Diagnostic) * capacity);
+    if (grown == NULL)
+      return 0;
+    diagnostics->items = grown;
+    diagnostics->capacity = capacity;
+  }
+  diagnostics->items[diagnostics->length++] = diagnostic;
+  return 1;
 }
 
-/**
- * Checks if the character is a blank, tabulation or new line
- * @param character
- * @return true if the character is a new line, tabulation or blank, false
- * otherwise
- */
-static i8 is_whitespace(char character) {
-  if (character == ' ' || character == 10 || character == '\t' ||
-      is_breakline(character))
-    return 1;
-  return 0;
+void print_diagnostic(Diagnostic *diagnostic) {
+  fprintf(stderr, "Error on file \"%s\" at line %ld and column %ld\n%s: %s.\n",
+          diagnostic->pos.file_location, diagnostic->pos.line,
+          diagnostic->pos.column, diagnostic_kind_string(diagnostic->kind),
+          diagnostic->details);
 }
 
 /**
- * Checks if the character is a digit
- * @param character
- * @return true if the character is a digit, false otherwise
+ * Get current lexer character
+ * @param lexer
+ * @return Current lexer character
  */
-static i8 is_digit(char character) {
-  if (character >= '0' && character <= '9')
-    return 1;
-  return 0;
+static char get_current_char(Lexer *lexer) {
+  return lexer->source[lexer->pos.index];
 }
 
 /**
@@ -72,127 +89,51 @@ static i8 is_digit(char character) {
  * @return true if lexer is at end, false otherwise
  */
 static i8 is_at_end(Lexer *lexer) {
-  if (lexer->pos->index >= lexer->length || get_current_char(lexer) == EOF ||
-      get_current_char(lexer) == '\0')
-    return 1;
-  return 0;
-}
-
-/**
- * Verify if character is a operator
- * @param char
- * @return int
- */
-static i8 is_operator(char c) {
-  switch (c) {
-  case '+':
-  case '-':
-  case '*':
-  case '/':
-  case '%':
-  case '!':
-  case '|':
-  case '&':
-  case '$':
-  case '^':
-  case '~':
-  case '=':
-  case '>':
-  case '<':
-  case ':':
-  case '?':
-    return 1;
-  default:
-    return 0;
-  }
-}
-
-/**
- * Verify if character is a separator
- * @param char
- * @return int
- */
-static i8 is_separator(char c) {
-  switch (c) {
-  case '{':
-  case '}':
-  case '[':
-  case ']':
-  case '(':
-  case ')':
-  case ';':
-  case ',':
-  case '.':
-    return 1;
-  default:
-    return 0;
-  }
-}
-
-static i8 is_string(char c) {
-  if (c == '"' || c == '\'')
+  if (lexer->pos.index >= lexer->length || get_current_char(lexer) == '\0')
     return 1;
   return 0;
 }
 
 /**
- * Update lexer line and column
- * @param lexer
- * */
-static void next_position(Lexer *lexer) {
-  lexer->pos->column++;
-  if (is_breakline(get_current_char(lexer)))
-    lexer->pos->column = 0, lexer->pos->line++;
-}
-
-/**
- * Copy lexer position
+ * Bring the lexer line and column up to date with its index. Tokens start in
+ * increasing order, so the line cursor only moves forward
  * @param lexer
- * @return A current position copy
  * */
-static Position *copy_position(Lexer *lexer) {
-  Position *pos = (Position *)malloc(sizeof(Position));
-  if (pos == NULL) {
-    fprintf(stderr, "MallocError: No memory to allocate\n");
-    exit(EXIT_FAILURE);
-  }
-  pos->index = lexer->pos->index;
-  pos->column = lexer->pos->column;
-  pos->line = lexer->pos->line;
-  pos->file_location = lexer->pos->file_location;
-  return pos;
+static void update_position(Lexer *lexer) {
+  const LineTable *lines = &lexer->lines;
+  i64 index = lexer->pos.index, cursor = lexer->line_cursor;
+  while (cursor < lines->length && lines->offsets[cursor] <= index)
+    cursor++;
+
+  lexer->line_cursor = cursor;
+  lexer->pos.line = cursor + 1;
+  lexer->pos.column = cursor ? index - lines->offsets[cursor - 1] : index + 1;
 }
 
 static TokenPosition create_token_position(Lexer *lexer) {
-  TokenPosition pos = {.column = lexer->pos->column,
-                       .line = lexer->pos->line,
-                       .start = lexer->pos->index,
-                       .end = lexer->pos->index + 1};
+  update_position(lexer);
+  TokenPosition pos = {.column = lexer->pos.column,
+                       .line = lexer->pos.line,
+                       .start = lexer->pos.index,
+                       .end = lexer->pos.index + 1};
   return pos;
 }
 
-/**
- * Swap lexer position
- * @param Lexer *lexer,
- * @param Position *to_swap
- * */
-static void swap_lexer_position(Lexer *lexer, Position *to_swap) {
-  lexer->character = lexer->source[to_swap->index];
-  free(lexer->pos), lexer->pos = to_swap;
-}
-
+#ifdef LEXER_DEBUG
 /**
  * Print current lexer position line/column
  * @param lexer
  * */
 static void debug_lexer_position(Lexer *lexer) {
+  update_position(lexer);
   printf("\n=========[ DEBUG LEXER ]=========\n");
   char c = get_current_char(lexer);
   printf(" [ Char: %c | asciicode: %d ]\n\n", c, c);
-  printf(" [Index: %ld | Line: %ld | Column: %ld ]\n", lexer->pos->index,
-         lexer->pos->line, lexer->pos->column);
+  printf(" [Index: %ld | Line: %ld | Column: %ld ]\n", lexer->pos.index,
+         lexer->pos.line, lexer->pos.column);
   printf("=================================\n\n");
 }
+#endif
 
 /**
  * Checks the next character whitout update current lexer position
@@ -200,7 +141,7 @@ static void debug_lexer_position(Lexer *lexer) {
  * @return next character if is at the and return EOF
  */
 static char peek(Lexer *lexer) {
-  i64 i = lexer->pos->index;
+  i64 i = lexer->pos.index;
   if (i++ >= lexer->length)
     return EOF;
   return lexer->source[i];
@@ -211,76 +152,37 @@ static char peek(Lexer *lexer) {
  * @param lexer
  */
 static void next(Lexer *lexer) {
-  lexer->pos->index++;
+  if (lexer->pos.index >= lexer->length)
+    return;
+  lexer->pos.index++;
   if (is_at_end(lexer))
     lexer->character = EOF;
   else
-    lexer->character = lexer->source[lexer->pos->index];
-  next_position(lexer);
+    lexer->character = lexer->source[lexer->pos.index];
 }
 
 /**
- * Copy a slice of string
+ * Move the lexer forward to index
  * @param lexer
- * @param start
- * @param end
- * @return a copy of sliced string
+ * @param index must not be behind the current position nor past the length
  */
-static char *cut_string(Lexer *lexer, i64 start, i64 end) {
-  i64 length = end - start + 1;
-  char *value = calloc(sizeof(char), length + 1);
-  if (value == NULL) {
-    fprintf(stderr, "MallocError: No memory to allocate\n");
-    exit(EXIT_FAILURE);
-  }
-  memcpy(value, lexer->source + start, length);
-  value[length] = '\0';
-  return value;
+static void advance_to(Lexer *lexer, i64 index) {
+  if (index <= lexer->pos.index)
+    return;
+  lexer->pos.index = index;
+  lexer->character = is_at_end(lexer) ? EOF : lexer->source[index];
 }
 
 /**
- * Matches lexer state with a sequence of characters. Either current states
- * matches, or not. Also if the match has been successful, it keeps the lexer's
- * position. Otherwise, it reverts the lexer to its original state
- * @param pattern
+ * Create a token over the source text between pos.start and pos.end
  * @param lexer
- * @return true of matches, 0 otherwise
+ * @param type
+ * @param pos
+ * @return the token
  */
-static i8 match(const char *pattern, Lexer *lexer) {
-  if (get_current_char(lexer) != pattern[0])
-    return 0;
-  Position *p = copy_position(lexer);
-
-  size_t start = p->index;
-  size_t len = strlen(pattern);
-  char *value = NULL;
-
-  for (i64 i = 0; i < len; i++) {
-    if (get_current_char(lexer) != pattern[i]) {
-      swap_lexer_position(lexer, p);
-      return 0;
-    }
-
-    size_t end = lexer->pos->index;
-    char *value = cut_string(lexer, start, end);
-    if (i + 1 == len && strcmp(value, pattern) == 0)
-      break;
-
-    free(value), value = NULL;
-    next(lexer);
-  }
-
-  if (value != NULL)
-    free(value);
-
-  char c = peek(lexer);
-  if (!is_whitespace(c) && !is_separator(c)) {
-    swap_lexer_position(lexer, p);
-    return 0;
-  }
-
-  free(p);
-  return 1;
+static Token create_lexer_token(Lexer *lexer, TokenType type,
+                                TokenPosition pos) {
+  return create_token(lexer->source, type, pos);
 }
 
 /**
@@ -288,556 +190,820 @@ static i8 match(const char *pattern, Lexer *lexer) {
  * @param lexer
  */
 static void skip_whitespace(Lexer *lexer) {
-  while (is_whitespace(get_current_char(lexer)))
-    next(lexer);
+  LEXER_STAT(i64 start = lexer->pos.index);
+  advance_to(lexer,
+             scan_whitespace(lexer->source, lexer->pos.index, lexer->length));
+  LEXER_STAT(lexer->stats.whitespace_bytes += lexer->pos.index - start);
 }
 
 /**
  * Skip whitespaces and comments
  * @param lexer
+ * @param unclosed set to the position of a comment that is never closed
+ * @return true if a comment is never closed, false otherwise
  */
-static void skip(Lexer *lexer) {
+static i8 skip(Lexer *lexer, TokenPosition *unclosed) {
+  Position start;
   skip_whitespace(lexer);
 
-  if (get_current_char(lexer) == '*' && peek(lexer) == '/')
-    goto error_not_opened_comment;
-
-  Position *pos = copy_position(lexer);
-
   // Comments
   while (get_current_char(lexer) == '/' &&
          (peek(lexer) == '/' || peek(lexer) == '*')) {
+    LEXER_STAT(i64 comment_start = lexer->pos.index);
     // Single line comments
     if (get_current_char(lexer) == '/' && peek(lexer) == '/') {
-      while (1) {
-        if (is_breakline(peek(lexer)) || is_at_end(lexer))
-          break;
-        next(lexer);
-      }
+      // Stop right before the breakline, or at the end
+      i64 end = scan_line_end(lexer->source, lexer->pos.index + 1,
+                              lexer->length);
+      i8 breakline = char_class(lexer->source[end]) & CHAR_BREAKLINE;
+      advance_to(lexer, breakline ? end - 1 : end);
     }
 
     // Multiline comments
     if (get_current_char(lexer) == '/' && peek(lexer) == '*') {
-      while (1) {
-        if (get_current_char(lexer) == '*' && peek(lexer) == '/') {
-          next(lexer);
-          break;
-        }
-        if (is_at_end(lexer))
-          goto error_unclosed_comment;
-        next(lexer);
-      }
+      start = lexer->pos;
+      *unclosed = create_token_position(lexer);
+      advance_to(lexer, scan_comment_end(lexer->source, lexer->pos.index + 1,
+                                         lexer->length));
+      if (is_at_end(lexer))
+        goto error_unclosed_comment;
+      next(lexer);
     }
 
     next(lexer);
+    LEXER_STAT(lexer->stats.comment_bytes +=
+               lexer->pos.index - comment_start);
     skip_whitespace(lexer);
   }
-
-  free(pos);
-  return;
-
-error_not_opened_comment:
-  throw_lexer_error(
-      "UnmatchedString",
-      "Ending of comment \"*/\" is present but the beginning is not",
-      lexer->pos);
+  return 0;
 
 error_unclosed_comment:
-  throw_lexer_error(
-      "UnmatchedString",
-      "Beginning of comment \"/*\" is present but the ending is not", pos);
+  report_lexer_error(
+      lexer, UNMATCHED_STRING,
+      "Beginning of comment \"/*\" is present but the ending is not", &start);
+  unclosed->end = lexer->pos.index;
+  return 1;
 }
 
-static Token *tokenize_operator(Lexer *lexer) {
-  char current_char[2];
-  current_char[0] = get_current_char(lexer);
-  current_char[1] = '\0';
+/**
+ * Create an error token over the characters between pos.start and pos.end,
+ * the error itself must have been reported already
+ * @param lexer
+ * @param pos
+ * @return the error token
+ */
+static Token create_error_token(Lexer *lexer, TokenPosition pos) {
+  return create_token(lexer->source, TK_ERROR, pos);
+}
 
+static Token tokenize_operator(Lexer *lexer) {
   char next_char = peek(lexer);
-  char value[3];
-  value[0] = *current_char;
-  value[1] = next_char;
-  value[2] = '\0';
 
   TokenPosition pos = create_token_position(lexer);
-  switch (*current_char) {
+  switch (get_current_char(lexer)) {
   case '+':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_PLUS, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_PLUS, pos);
     } else if (next_char == '+') {
       next(lexer);
       pos.end++;
-      return create_token(value, INCREMENT, pos);
+      return create_lexer_token(lexer, INCREMENT, pos);
     } else
-      return create_token(current_char, PLUS, pos);
+      return create_lexer_token(lexer, PLUS, pos);
 
   case '-':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_MINUS, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_MINUS, pos);
     } else if (next_char == '-') {
       next(lexer);
       pos.end++;
-      return create_token(value, DECREMENT, pos);
+      return create_lexer_token(lexer, DECREMENT, pos);
     } else
-      return create_token(current_char, MINUS, pos);
+      return create_lexer_token(lexer, MINUS, pos);
 
   case '*':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_MULTIPLY, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_MULTIPLY, pos);
     } else if (next_char == '*') {
       next(lexer);
       pos.end++;
-      return create_token(value, POWER, pos);
+      return create_lexer_token(lexer, POWER, pos);
     } else
-      return create_token(current_char, MULTIPLY, pos);
+      return create_lexer_token(lexer, MULTIPLY, pos);
 
   case '/':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_DIVIDE, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_DIVIDE, pos);
     } else
-      return create_token(current_char, DIVIDE, pos);
+      return create_lexer_token(lexer, DIVIDE, pos);
 
   case '%':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_MODULE, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_MODULE, pos);
     } else
-      return create_token(current_char, MODULE, pos);
+      return create_lexer_token(lexer, MODULE, pos);
 
   case '!':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, NOT_EQUAL, pos);
+      return create_lexer_token(lexer, NOT_EQUAL, pos);
     } else
-      return create_token(current_char, NOT, pos);
+      return create_lexer_token(lexer, NOT, pos);
 
   case '|':
     if (next_char == '|') {
       next(lexer);
       pos.end++;
-      return create_token(value, OR, pos);
+      return create_lexer_token(lexer, OR, pos);
     } else
-      return create_token(current_char, OR_TYPE, pos);
+      return create_lexer_token(lexer, OR_TYPE, pos);
 
   case '&':
     if (next_char == '&') {
       next(lexer);
       pos.end++;
-      return create_token(value, AND, pos);
+      return create_lexer_token(lexer, AND, pos);
     }
-    return create_token(current_char, BITWISE_AND, pos);
+    return create_lexer_token(lexer, BITWISE_AND, pos);
 
   case '$':
-    return create_token(current_char, BITWISE_OR, pos);
+    return create_lexer_token(lexer, BITWISE_OR, pos);
 
   case '^':
-    return create_token(current_char, BITWISE_XOR, pos);
+    return create_lexer_token(lexer, BITWISE_XOR, pos);
 
   case '~':
-    return create_token(current_char, BITWISE_NOT, pos);
+    return create_lexer_token(lexer, BITWISE_NOT, pos);
 
   case '=':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, EQUAL, pos);
+      return create_lexer_token(lexer, EQUAL, pos);
     } else if (next_char == '>') {
       next(lexer);
       pos.end++;
-      return create_token(value, RETURN_OPERATOR, pos);
+      return create_lexer_token(lexer, RETURN_OPERATOR, pos);
     } else
-      return create_token(current_char, ASSIGNMENT_OPERATOR, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_OPERATOR, pos);
 
   case '<':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, LESS_EQUAL, pos);
+      return create_lexer_token(lexer, LESS_EQUAL, pos);
     } else if (next_char == '<') {
       next(lexer);
       pos.end++;
-      return create_token(value, LEFT_SHIFT, pos);
+      return create_lexer_token(lexer, LEFT_SHIFT, pos);
     } else
-      return create_token(current_char, LESS_THEN, pos);
+      return create_lexer_token(lexer, LESS_THEN, pos);
 
   case '>':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, GREATER_EQUAL, pos);
+      return create_lexer_token(lexer, GREATER_EQUAL, pos);
     } else if (next_char == '>') {
       next(lexer);
       pos.end++;
-      return create_token(value, RIGHT_SHIFT, pos);
+      return create_lexer_token(lexer, RIGHT_SHIFT, pos);
     } else
-      return create_token(current_char, GREATER_THEN, pos);
+      return create_lexer_token(lexer, GREATER_THEN, pos);
 
   case ':':
     if (next_char == '=') {
       next(lexer);
       pos.end++;
-      return create_token(value, ASSIGNMENT_MUTABLE, pos);
+      return create_lexer_token(lexer, ASSIGNMENT_MUTABLE, pos);
     } else
-      return create_token(current_char, TYPE_DECLARATION, pos);
+      return create_lexer_token(lexer, TYPE_DECLARATION, pos);
 
   default:
-    return create_token(current_char, TERNARY_OPERATOR, pos);
+    return create_lexer_token(lexer, TERNARY_OPERATOR, pos);
   }
 }
 
-static Token *tokenize_separator(Lexer *lexer) {
-  char value[2];
-  value[0] = get_current_char(lexer);
-  value[1] = '\0';
-
+static Token tokenize_separator(Lexer *lexer) {
   TokenPosition pos = create_token_position(lexer);
-  switch (value[0]) {
+  switch (get_current_char(lexer)) {
   case '{':
-    return create_token(value, LCBRACKETS, pos);
+    return create_lexer_token(lexer, LCBRACKETS, pos);
   case '}':
-    return create_token(value, RCBRACKETS, pos);
+    return create_lexer_token(lexer, RCBRACKETS, pos);
   case '[':
-    return create_token(value, LBRACKETS, pos);
+    return create_lexer_token(lexer, LBRACKETS, pos);
   case ']':
-    return create_token(value, RBRACKETS, pos);
+    return create_lexer_token(lexer, RBRACKETS, pos);
   case '(':
-    return create_token(value, LPARENTESES, pos);
+    return create_lexer_token(lexer, LPARENTESES, pos);
   case ')':
-    return create_token(value, RPARENTESES, pos);
+    return create_lexer_token(lexer, RPARENTESES, pos);
   case ';':
-    return create_token(value, SEMICOLON, pos);
+    return create_lexer_token(lexer, SEMICOLON, pos);
   case ',':
-    return create_token(value, COMMA, pos);
+    return create_lexer_token(lexer, COMMA, pos);
   default:
     if (peek(lexer) == '.') {
       next(lexer);
       pos.end++;
-      return create_token("..", SPREAD, pos);
+      return create_lexer_token(lexer, SPREAD, pos);
     }
-    return create_token(value, DOT, pos);
+    return create_lexer_token(lexer, DOT, pos);
   }
 }
 
-static Token *tokenize_keyword_identifier(Lexer *lexer) {
-  char c = get_current_char(lexer);
-  if (is_digit(c) || is_operator(c) || is_separator(c) || is_whitespace(c) ||
-      !is_alphanumeric(c) || is_at_end(lexer))
-    return NULL;
-
-  TokenPosition pos = create_token_position(lexer);
-
-  if (match("break", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("break", BREAK, pos);
-  } else if (match("boolean", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("boolean", BOOLEAN, pos);
+/**
+ * Skip the characters of an identifier: ASCII letters, digits, '_' and
+ * valid UTF-8 sequences
+ * @param lexer
+ * @param index
+ * @return index of the first character past them
+ */
+static i64 scan_word(Lexer *lexer, i64 index) {
+  const char *source = lexer->source;
+  while (index < lexer->length) {
+    i8 classes = char_class(source[index]);
+    if (classes & CHAR_WORD)
+      index++;
+    else if (classes & CHAR_UTF8_LEAD) {
+      i64 length = utf8_sequence_length(source + index, NULL);
+      if (length == 0 || index + length > lexer->length)
+        break;
+      index += length;
+    } else
+      break;
   }
+  return index;
+}
 
-  else if (match("const", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("const", CONST, pos);
-  } else if (match("char", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("char", CHAR, pos);
-  } else if (match("case", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("case", CASE, pos);
-  } else if (match("continue", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("continue", CONTINUE, pos);
-  }
+/**
+ * Report the current character as illegal
+ * @param lexer
+ * @return an error token over it
+ */
+static Token tokenize_illegal(Lexer *lexer) {
+#ifdef LEXER_DEBUG
+  debug_lexer_position(lexer);
+#endif
+  report_lexer_error(lexer, ILLEGAL_CHARACTER, "Illegal character",
+                     &lexer->pos);
+  return create_error_token(lexer, create_token_position(lexer));
+}
 
-  else if (match("double", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("double", DOUBLE, pos);
-  } else if (match("do", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("do", DO, pos);
-  }
+/**
+ * Scan a whole identifier and then classify it against the keyword table, so
+ * every identifier is read exactly once
+ * @param lexer
+ * @return keyword or identifier token
+ */
+static Token tokenize_keyword_identifier(Lexer *lexer) {
+  TokenPosition pos = create_token_position(lexer);
+  pos.end = scan_word(lexer, pos.start);
+  // A UTF-8 lead byte that doesn't start a valid sequence
+  if (pos.end == pos.start)
+    return tokenize_illegal(lexer);
+  advance_to(lexer, pos.end - 1);
+
+  TokenType type =
+      lookup_keyword(lexer->source + pos.start, pos.end - pos.start);
+  LEXER_STAT(lexer->stats.keyword_probes++;
+             lexer->stats.keyword_misses += type == IDENTIFIER);
+  return create_lexer_token(lexer, type, pos);
+}
 
-  else if (match("enum", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("enum", ENUM, pos);
-  }
-  /*
-  else if (match("eof", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("eof", TK_EOF, pos);
-
-  }*/
-  else if (match("else", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("else", ELSE, pos);
-  }
+/**
+ * Character at index, '\0' past the end of the lexer
+ * @param lexer
+ * @param index
+ * @return the character
+ */
+static char char_at(Lexer *lexer, i64 index) {
+  return index < lexer->length ? lexer->source[index] : '\0';
+}
 
-  else if (match("float", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("float", FLOAT, pos);
-  } else if (match("for", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("for", FOR, pos);
-  } else if (match("foreach", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("foreach", FOREACH, pos);
-  } else if (match("f8", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("f8", F8, pos);
-  } else if (match("f16", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("f16", F16, pos);
-  } else if (match("f32", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("f32", F32, pos);
-  } else if (match("f64", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("f64", F64, pos);
-  } else if (match("false", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("false", FALSE, pos);
-  } else if (match("from", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("from", FROM, pos);
+static i8 is_base_digit(char c, i8 base) {
+  switch (base) {
+  case 2:
+    return c == '0' || c == '1';
+  case 8:
+    return c >= '0' && c <= '7';
+  case 16:
+    return char_class(c) & CHAR_HEX_DIGIT;
+  default:
+    return char_class(c) & CHAR_DIGIT;
   }
+}
 
-  else if (match("if", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("if", IF, pos);
-  } else if (match("import", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("import", IMPORT, pos);
-  } else if (match("int", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("int", INT, pos);
-  } else if (match("i8", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("i8", I8, pos);
-  } else if (match("i16", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("i16", I16, pos);
-  } else if (match("i32", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("i32", I32, pos);
-  } else if (match("i64", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("i64", I64, pos);
+/**
+ * Scan digits of a base, each digit separator '_' must be followed by a digit
+ * @param lexer
+ * @param index of the first digit
+ * @param base
+ * @param separator set to the index of a misplaced separator, if any
+ * @return index past the last digit, the misplaced separator if any
+ */
+static i64 scan_digits(Lexer *lexer, i64 index, i8 base, i64 *separator) {
+  while (1) {
+    char c = char_at(lexer, index);
+    if (c == '_' && !is_base_digit(char_at(lexer, index + 1), base)) {
+      *separator = index;
+      return index;
+    }
+    if (c != '_' && !is_base_digit(c, base))
+      return index;
+    index++;
   }
+}
 
-  else if (match("long", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("long", LONG, pos);
-  }
+/**
+ * Read the type suffix of a numeric literal
+ * @param suffix
+ * @param length
+ * @return the suffix, NUMBER_UNTYPED if it is not one
+ */
+static NumberSuffix read_number_suffix(const char *suffix, i64 length) {
+  static const char *suffixes[] = {
+      [NUMBER_I8] = "i8",   [NUMBER_I16] = "i16", [NUMBER_I32] = "i32",
+      [NUMBER_I64] = "i64", [NUMBER_F32] = "f32", [NUMBER_F64] = "f64",
+  };
+  for (i64 i = NUMBER_I8; i <= NUMBER_F64; i++)
+    if ((i64)strlen(suffixes[i]) == length &&
+        memcmp(suffixes[i], suffix, length) == 0)
+      return i;
+  return NUMBER_UNTYPED;
+}
 
-  else if (match("null", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("null", TK_NULL, pos);
+/**
+ * Lex a numeric literal: decimal with an optional fraction and exponent, or
+ * binary, octal or hexadecimal after a 0b, 0o or 0x prefix. Digits can be
+ * split by '_' and a type suffix can follow. The value is decoded right away
+ * into the token
+ * @param lexer
+ * @return the literal token, an error token if it is malformed
+ */
+static Token tokenize_numeric(Lexer *lexer) {
+  TokenPosition pos = create_token_position(lexer);
+  TokenType type = INT_LITERAL;
+  const char *error = NULL;
+  // No separator can be misplaced at the start of the literal
+  i64 separator = pos.start, index = pos.start;
+
+  i8 base = 10;
+  if (char_at(lexer, index) == '0') {
+    switch (char_at(lexer, index + 1)) {
+    case 'b':
+    case 'B':
+      base = 2, type = BINARY_LITERAL;
+      break;
+    case 'o':
+    case 'O':
+      base = 8, type = OCT_LITERAL;
+      break;
+    case 'x':
+    case 'X':
+      base = 16, type = HEX_LITERAL;
+      break;
+    }
   }
 
-  else if (match("return", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("return", RETURN, pos);
+  if (base != 10) {
+    i64 digits = index + 2;
+    index = scan_digits(lexer, digits, base, &separator);
+    if (index == digits || char_at(lexer, digits) == '_')
+      error = "Expected digits after the base prefix";
+  } else {
+    index = scan_digits(lexer, index, 10, &separator);
+    // A second dot starts a spread
+    if (char_at(lexer, index) == '.' && char_at(lexer, index + 1) != '.') {
+      type = FLOAT_LITERAL;
+      index = scan_digits(lexer, index + 1, 10, &separator);
+    }
+    char c = char_at(lexer, index);
+    if (separator == pos.start && (c == 'e' || c == 'E')) {
+      i64 exponent = index + 1;
+      c = char_at(lexer, exponent);
+      if (c == '+' || c == '-')
+        exponent++;
+      if (char_class(char_at(lexer, exponent)) & CHAR_DIGIT) {
+        type = FLOAT_LITERAL;
+        index = scan_digits(lexer, exponent, 10, &separator);
+      }
+    }
   }
-
-  else if (match("sizeof", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("sizeof", SIZEOF, pos);
-  } else if (match("struct", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("struct", STRUCT, pos);
-  } else if (match("string", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("string", STRING, pos);
-  } else if (match("switch", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("switch", SWITCH, pos);
+  if (separator != pos.start)
+    error = "Digit separator \"_\" must be between two digits";
+
+  i64 value_end = index;
+  NumberSuffix suffix = NUMBER_UNTYPED;
+  i64 suffix_end = scan_word(lexer, index);
+  if (error == NULL && suffix_end > index) {
+    index = suffix_end;
+    suffix =
+        read_number_suffix(lexer->source + value_end, index - value_end);
+    if (suffix == NUMBER_UNTYPED)
+      error = "Doesn't belong within 0-9 range";
+    else if (suffix < NUMBER_F32 && type == FLOAT_LITERAL)
+      error = "Integer type suffix on a float literal";
+    else if (suffix >= NUMBER_F32 && type != INT_LITERAL &&
+             type != FLOAT_LITERAL)
+      error = "Float type suffix on a binary, octal or hexadecimal literal";
+    else if (suffix >= NUMBER_F32)
+      type = FLOAT_LITERAL;
   }
-
-  else if (match("typeof", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("typeof", TYPEOF, pos);
-  } else if (match("true", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("true", TRUE, pos);
+  if (error == NULL && char_at(lexer, index) == '.' &&
+      char_at(lexer, index + 1) != '.')
+    error = "Doesn't belong within 0-9 range";
+
+  if (error != NULL) {
+    Position at = lexer->pos;
+    at.index = separator != pos.start ? separator : value_end;
+    report_lexer_error(lexer, LEXICAL_ERROR, error, &at);
+    while ((index = scan_word(lexer, index)) < lexer->length &&
+           lexer->source[index] == '.')
+      index++;
+    advance_to(lexer, index - 1);
+    pos.end = index;
+    return create_error_token(lexer, pos);
   }
 
-  else if (match("void", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("void", VOID, pos);
-  }
+  advance_to(lexer, index - 1);
+  pos.end = index;
+  Token token = create_lexer_token(lexer, type, pos);
+  decode_number(lexer->source + pos.start, value_end - pos.start, type,
+                &token.number);
+  token.number.suffix = suffix;
+  return token;
+}
 
-  else if (match("while", lexer)) {
-    pos.end = lexer->pos->index;
-    return create_token("while", WHILE, pos);
+/**
+ * Point a literal with escape sequences at its value, decoded into the string
+ * pool. Without a pool the token keeps the raw characters
+ * @param lexer
+ * @param token over the body of the literal
+ */
+static void decode_literal(Lexer *lexer, Token *token) {
+  if (lexer->strings == NULL)
+    return;
+  char *value = arena_alloc(lexer->strings, token->length);
+  if (value == NULL) {
+    lexer->out_of_memory = 1;
+    return;
   }
-
-  i64 start = lexer->pos->index;
-  while (is_alphanumeric(peek(lexer)) || peek(lexer) == '_')
-    next(lexer);
-
-  if (!is_alphanumeric(c) && !is_whitespace(c) && !is_operator(c) &&
-      !is_separator(c))
-    throw_lexer_error("SpellingError",
-                      "Identifier must start with a letter or _ and cannot "
-                      "have any special character",
-                      lexer->pos);
-  i64 end = lexer->pos->index;
-
-  char *value = cut_string(lexer, start, end);
-  pos.end = lexer->pos->index == pos.start ? lexer->pos->index + 1
-                                           : lexer->pos->index;
-  return create_token(value, IDENTIFIER, pos);
+  LEXER_STAT(lexer->stats.decoded_strings++);
+  token->length = decode_escapes(token->value, token->length, value);
+  token->value = value;
 }
 
-static Token *tokenize_numeric(Lexer *lexer) {
-  i64 start = lexer->pos->index;
-  int dot_count = 0;
-
+/**
+ * Lex a char literal: an escape sequence or a single UTF-8 character between
+ * quotes, its code point is the integer of the token number
+ * @param lexer
+ * @return the token, an error token if the literal is malformed
+ */
+static Token tokenize_char(Lexer *lexer) {
   TokenPosition pos = create_token_position(lexer);
-  while (is_digit(peek(lexer)) || peek(lexer) == '.') {
-    if (peek(lexer) == '.') {
-      dot_count++;
-    }
-    next(lexer);
+  i64 body = pos.start + 1;
+  i64 end = scan_char_end(lexer->source, body, lexer->length);
+  i8 closed = end < lexer->length && lexer->source[end] == '\'';
+  // Unclosed literals are reported at their quote, the others at the body
+  Position at = lexer->pos;
+  if (closed)
+    at.index = body;
+
+  int64_t code = -1;
+  const char *error = NULL;
+  if (!closed)
+    error = "ending of character is not present but the beginning is present";
+  else if (end == body)
+    error = "Empty character literal";
+  else if (lexer->source[body] == '\\') {
+    read_escape(lexer->source, body, &code);
+    if (code < 0)
+      error = "Invalid escape sequence";
+  } else if (utf8_sequence_length(lexer->source + body, &code) != end - body)
+    error = "Invalid UTF-8 character";
+
+  pos.end = end + closed;
+  advance_to(lexer, pos.end - 1);
+  if (error != NULL) {
+    report_lexer_error(lexer, closed ? LEXICAL_ERROR : UNMATCHED_STRING, error,
+                       &at);
+    return create_error_token(lexer, pos);
   }
-  i64 end = lexer->pos->index;
 
-  if (is_alphanumeric(peek(lexer)) || dot_count > 1)
-    throw_lexer_error("LexicalError", "Doesn't belong within 0-9 range",
-                      lexer->pos);
-
-  char *value = cut_string(lexer, start, end);
-  pos.end = lexer->pos->index == pos.start ? lexer->pos->index + 1
-                                           : lexer->pos->index;
-  if (dot_count == 1)
-    return create_token(value, FLOAT_LITERAL, pos);
-  return create_token(value, INT_LITERAL, pos);
+  Token token = create_lexer_token(lexer, CHAR_LITERAL, pos);
+  token.number.integer = code;
+  if (lexer->source[body] == '\\')
+    decode_literal(lexer, &token);
+  return token;
 }
 
-static Token *tokenize_strings(Lexer *lexer) {
-  Position *p = copy_position(lexer);
+/**
+ * Lex a string literal. Its body is checked a vector at a time up to the
+ * next quote, backslash or byte past ASCII, each escape sequence and UTF-8
+ * character is then validated on its own. A string without escape sequences
+ * stays a slice of the source, the others are decoded once into the pool
+ * @param lexer
+ * @return the token, an error token if the literal is malformed
+ */
+static Token tokenize_string(Lexer *lexer) {
+  Position start_pos = lexer->pos;
   TokenPosition pos = create_token_position(lexer);
+  const char *source = lexer->source;
+  i8 escaped = 0, invalid = 0;
 
-  if (get_current_char(lexer) == '\'') {
-    char value[2];
-    value[0] = peek(lexer);
-    value[1] = '\0';
+  i64 i = pos.start + 1;
+  while (1) {
+    i = scan_string_special(source, i, lexer->length);
+    if (i >= lexer->length || source[i] == '"' || source[i] == '\0')
+      break;
 
-    next(lexer);
-    if (peek(lexer) == '\'') {
-      free(p), next(lexer);
-      pos.end = lexer->pos->index;
-      return create_token(value, CHAR_LITERAL, pos);
+    i64 at = i;
+    const char *error;
+    if (source[i] == '\\') {
+      int64_t code;
+      escaped = 1;
+      i = read_escape(source, i, &code);
+      if (code >= 0)
+        continue;
+      error = "Invalid escape sequence";
+    } else {
+      i64 sequence = utf8_sequence_length(source + i, NULL);
+      i += sequence ? sequence : 1;
+      if (sequence)
+        continue;
+      error = "Invalid UTF-8 character";
     }
-    throw_lexer_error(
-        "UnmatchedString",
-        "ending of character is not present but the beginning is present", p);
+    // Reported once, the literal becomes a single error token
+    if (!invalid) {
+      Position position = start_pos;
+      position.index = at;
+      report_lexer_error(lexer, LEXICAL_ERROR, error, &position);
+    }
+    invalid = 1;
   }
 
-  next(lexer);
-  i64 start = lexer->pos->index;
-  while (get_current_char(lexer) != '"') {
-    next(lexer);
-    if (is_at_end(lexer))
-      throw_lexer_error(
-          "UnmatchedString",
-          "ending of string is not present but the beginning is present", p);
+  if (i >= lexer->length || source[i] != '"') {
+    advance_to(lexer, i);
+    report_lexer_error(
+        lexer, UNMATCHED_STRING,
+        "ending of string is not present but the beginning is present",
+        &start_pos);
+    pos.end = lexer->pos.index;
+    return create_error_token(lexer, pos);
   }
-  i64 end = lexer->pos->index - 1;
-  free(p);
 
-  pos.end = lexer->pos->index;
-  char *value = cut_string(lexer, start, end);
-  return create_token(value, STRING_LITERAL, pos);
+  advance_to(lexer, i);
+  pos.end = i + 1;
+  if (invalid)
+    return create_error_token(lexer, pos);
+  Token token = create_lexer_token(lexer, STRING_LITERAL, pos);
+  if (escaped)
+    decode_literal(lexer, &token);
+  return token;
 }
 
-static void append_token(TokensList *tokens, Token *token) {
-  i64 length = strlen(token->value);
-
-  Token *node = (Token *)malloc(sizeof(*token));
-  node->type = token->type;
-  node->value = malloc(length + 1);
-  node->pos = token->pos;
-
-  node->value[length] = '\0';
-  memcpy(node->value, token->value, length);
-
-  node->prev = node->next = NULL;
-  if (tokens->head == NULL) {
-    tokens->tail = tokens->head = node;
-  } else {
-    tokens->tail->next = node;
-    node->prev = tokens->tail;
-    tokens->tail = node;
-  }
-  free(token);
+static Token tokenize_strings(Lexer *lexer) {
+  if (get_current_char(lexer) == '\'')
+    return tokenize_char(lexer);
+  return tokenize_string(lexer);
 }
 
-Lexer *create_lexer(const char *file_location, const char *source) {
+/**
+ * Allocate a lexer at the start of source, without its line table
+ * @param file_location
+ * @param source
+ * @param length
+ * @return the lexer, NULL if there is no memory left
+ */
+static Lexer *alloc_lexer(const char *file_location, const char *source,
+                          i64 length) {
   Lexer *lexer = (Lexer *)malloc(sizeof(Lexer));
-  Position *pos = (Position *)malloc(sizeof(Position));
-  if (lexer == NULL || pos == NULL) {
-    fprintf(stderr, "MallocError: No memory to allocate\n");
-    exit(EXIT_FAILURE);
-  }
-
-  const i64 length = strlen(source);
+  if (lexer == NULL)
+    return NULL;
+  LEXER_STAT(memset(&lexer->stats, 0, sizeof(LexerStats)));
 
   lexer->length = length;
   lexer->source = source;
   lexer->character = source[0];
+  lexer->strings = NULL;
+  lexer->lookahead_start = lexer->lookahead_count = 0;
+  lexer->diagnostics.items = NULL;
+  lexer->diagnostics.length = lexer->diagnostics.capacity = 0;
+  lexer->out_of_memory = 0;
+  line_table_init(&lexer->lines);
+  lexer->shared_lines = 0;
+  lexer->line_cursor = 0;
+
+  lexer->pos = (Position){
+      .file_location = file_location, .index = 0, .line = 1, .column = 1};
+  return lexer;
+}
+
+/**
+ * Create a lexer over source and index its breaklines
+ * @param file_location
+ * @param source buffer that must have a '\0' at source[length]
+ * @param length at most TOKEN_MAX_OFFSET
+ * @return the lexer, NULL if there is no memory left or if the source is too
+ * large
+ */
+Lexer *create_lexer(const char *file_location, const char *source,
+                    i64 length) {
+  if (length > TOKEN_MAX_OFFSET)
+    return NULL;
+  Lexer *lexer = alloc_lexer(file_location, source, length);
+  if (lexer == NULL)
+    return NULL;
+  LEXER_STAT(i64 start = lexer_stats_clock());
+  if (!line_table_scan(&lexer->lines, source, length)) {
+    free_lexer(lexer);
+    return NULL;
+  }
+  LEXER_STAT(lexer->stats.phase_time[PHASE_LINES] +=
+             lexer_stats_clock() - start);
+  return lexer;
+}
 
-  pos->index = 0;
-  pos->line = 1;
-  pos->column = 1;
-  pos->file_location = file_location;
-  lexer->pos = pos;
+/**
+ * Create a lexer over the part of a source between start and end, sharing an
+ * existing line table of the whole source so lines and columns come out
+ * absolute
+ * @param file_location
+ * @param source
+ * @param lines must outlive the lexer
+ * @param start must be between two tokens
+ * @param end
+ * @return the lexer, NULL if there is no memory left
+ */
+Lexer *create_chunk_lexer(const char *file_location, const char *source,
+                          const LineTable *lines, i64 start, i64 end) {
+  Lexer *lexer = alloc_lexer(file_location, source, end);
+  if (lexer == NULL)
+    return NULL;
+  lexer->lines = *lines;
+  lexer->shared_lines = 1;
+  lexer_reset(lexer, start);
   return lexer;
 }
 
+/**
+ * Move the lexer to index, dropping any lookahead. The caller vouches that
+ * index is between two tokens
+ * @param lexer
+ * @param index
+ */
+void lexer_reset(Lexer *lexer, i64 index) {
+  LEXER_STAT(lexer->stats.resets++);
+  lexer->pos.index = index;
+  lexer->character = is_at_end(lexer) ? EOF : lexer->source[index];
+  lexer->lookahead_start = lexer->lookahead_count = 0;
+  lexer->line_cursor = line_table_count(&lexer->lines, index);
+  update_position(lexer);
+}
+
 void free_lexer(Lexer *lexer) {
-  free(lexer->pos), lexer->pos = NULL;
+  LEXER_STAT(lexer_stats_merge(&lexer->stats));
+  free(lexer->diagnostics.items), lexer->diagnostics.items = NULL;
+  if (!lexer->shared_lines)
+    line_table_free(&lexer->lines);
   free(lexer), lexer = NULL;
 }
 
-TokensList *tokenizer(Lexer *lexer) {
-  TokensList *tokens = (TokensList *)malloc(sizeof(TokensList));
-  tokens->head = tokens->tail = NULL;
-
-  Token *token = NULL;
-  while (!is_at_end(lexer)) {
-    skip(lexer);
+/**
+ * Lex the token starting at the current lexer position
+ * @param lexer
+ * @return next token, TK_EOF once the source is exhausted
+ */
+static Token lex_token(Lexer *lexer) {
+  LEXER_STAT(i64 start = lexer_stats_clock());
+  TokenPosition unclosed;
+  i8 skipped = skip(lexer, &unclosed);
+  LEXER_STAT(i64 skipped_at = lexer_stats_clock();
+             lexer->stats.phase_time[PHASE_SKIP] += skipped_at - start);
+  if (skipped) {
+    LEXER_STAT(lexer->stats.tokens[TK_ERROR]++);
+    return create_error_token(lexer, unclosed);
+  }
+  if (is_at_end(lexer)) {
+    TokenPosition pos = create_token_position(lexer);
+    pos.end = pos.start;
+    LEXER_STAT(lexer->stats.tokens[TK_EOF]++);
+    return create_lexer_token(lexer, TK_EOF, pos);
+  }
 
+  Token token;
+  char c = get_current_char(lexer);
+  switch (char_start(c)) {
+  case START_IDENTIFIER:
     token = tokenize_keyword_identifier(lexer);
-    if (token) {
-      append_token(tokens, token);
-    } else if (is_operator(get_current_char(lexer))) {
-      append_token(tokens, tokenize_operator(lexer));
-    } else if (is_separator(get_current_char(lexer))) {
-      append_token(tokens, tokenize_separator(lexer));
-    } else if (is_digit(get_current_char(lexer))) {
-      append_token(tokens, tokenize_numeric(lexer));
-    } else if (is_string(get_current_char(lexer))) {
-      append_token(tokens, tokenize_strings(lexer));
-    } else if (is_at_end(lexer))
-      break;
-    else {
-      debug_lexer_position(lexer);
-      throw_lexer_error("IllegalCharacter", "Illegal character", lexer->pos);
-    }
+    break;
+  case START_NUMBER:
+    token = tokenize_numeric(lexer);
+    break;
+  case START_OPERATOR:
+    if (c == '*' && peek(lexer) == '/') {
+      report_lexer_error(
+          lexer, UNMATCHED_STRING,
+          "Ending of comment \"*/\" is present but the beginning is not",
+          &lexer->pos);
+      TokenPosition pos = create_token_position(lexer);
+      pos.end++;
+      token = create_error_token(lexer, pos);
+      next(lexer);
+    } else
+      token = tokenize_operator(lexer);
+    break;
+  case START_SEPARATOR:
+    token = tokenize_separator(lexer);
+    break;
+  case START_QUOTE:
+    token = tokenize_strings(lexer);
+    break;
+  default:
+    token = tokenize_illegal(lexer);
+    break;
+  }
 
-    next(lexer);
+  next(lexer);
+  LEXER_STAT(lexer->stats.tokens[token.type]++;
+             lexer->stats.phase_time[PHASE_SCAN] +=
+             lexer_stats_clock() - skipped_at);
+  return token;
+}
+
+/**
+ * Pull the next token, consuming it
+ * @param lexer
+ * @return next token, TK_EOF forever once the source is exhausted
+ */
+Token lexer_next_token(Lexer *lexer) {
+  if (lexer->lookahead_count == 0)
+    return lex_token(lexer);
+
+  Token token = lexer->lookahead[lexer->lookahead_start];
+  lexer->lookahead_start = (lexer->lookahead_start + 1) % LEXER_LOOKAHEAD;
+  lexer->lookahead_count--;
+  return token;
+}
+
+/**
+ * Look at an upcoming token without consuming it
+ * @param lexer
+ * @param n distance from the next token, must be lower than LEXER_LOOKAHEAD
+ * @return the n-th upcoming token
+ */
+Token lexer_peek_token(Lexer *lexer, i8 n) {
+  while (lexer->lookahead_count <= n) {
+    i8 slot = (lexer->lookahead_start + lexer->lookahead_count) %
+              LEXER_LOOKAHEAD;
+    lexer->lookahead[slot] = lex_token(lexer);
+    lexer->lookahead_count++;
   }
+  return lexer->lookahead[(lexer->lookahead_start + n) % LEXER_LOOKAHEAD];
+}
 
-  append_token(tokens, create_token("EOF", TK_EOF, create_token_position(lexer)));
+/**
+ * Lex the whole source. The token buffer gets a copy of the line table,
+ * except from a chunk lexer whose caller owns the whole one
+ * @param lexer
+ * @return every token up to TK_EOF, NULL if there is no memory left
+ */
+TokenBuffer *tokenizer(Lexer *lexer) {
+  TokenBuffer *tokens = create_token_buffer(
+      lexer->source, (lexer->length - lexer->pos.index) / 4);
+  if (tokens == NULL)
+    return NULL;
+  if (!lexer->shared_lines &&
+      !line_table_append(&tokens->lines, &lexer->lines))
+    lexer->out_of_memory = 1;
+  lexer->strings = &tokens->strings;
+
+  Token token;
+  do {
+    token = lexer_next_token(lexer);
+    LEXER_STAT(i64 start = lexer_stats_clock());
+    if (!append_token(tokens, token))
+      lexer->out_of_memory = 1;
+    LEXER_STAT(lexer->stats.phase_time[PHASE_STORE] +=
+               lexer_stats_clock() - start);
+  } while (token.type != TK_EOF && !lexer->out_of_memory);
+
+  if (lexer->out_of_memory) {
+    free_token_buffer(tokens);
+    return NULL;
+  }
   return tokens;
 }
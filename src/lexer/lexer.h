@@ -1,6 +1,7 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "stats.h"
 #include "token.h"
 #include "../helper.h"
 
@@ -11,17 +12,80 @@ typedef struct {
   i64 column;
 } Position;
 
+#define LEXER_LOOKAHEAD 4
+
+typedef enum {
+  ILLEGAL_CHARACTER,
+  UNMATCHED_STRING,
+  LEXICAL_ERROR,
+  SYNTAX_ERROR,
+  TYPE_ERROR,
+  // Valid code the compiler can't translate yet
+  UNSUPPORTED_FEATURE,
+  RUNTIME_ERROR,
+} DiagnosticKind;
+
+typedef struct {
+  Position pos;
+  DiagnosticKind kind;
+  const char *details;
+} Diagnostic;
+
+typedef struct {
+  Diagnostic *items;
+  i64 length;
+  i64 capacity;
+} Diagnostics;
+
 typedef struct {
   const char *source;
   char character;
 
   i64 length;
-  Position *pos;
+  // Kept inline, restore points are plain copies of it
+  Position pos;
+  // Pool for token values that can't be a slice of the source
+  Arena *strings;
+
+  // Tokens already lexed by lexer_peek_token but not consumed yet
+  Token lookahead[LEXER_LOOKAHEAD];
+  i8 lookahead_start;
+  i8 lookahead_count;
+
+  // Breaklines of the whole source, scanned once up front. Line and column
+  // of the current position are only kept up to date at token starts, by a
+  // cursor on the first breakline past the last one
+  LineTable lines;
+  i8 shared_lines;
+  i64 line_cursor;
+
+  // Every error found so far, each one also produced a TK_ERROR token
+  Diagnostics diagnostics;
+  i8 out_of_memory;
+
+#ifdef LEXER_STATS
+  // Added to the process totals by free_lexer
+  LexerStats stats;
+#endif
 } Lexer;
 
-Lexer *create_lexer(const char* file_location, const char *source);
+Lexer *create_lexer(const char *file_location, const char *source,
+                    i64 length);
+
+Lexer *create_chunk_lexer(const char *file_location, const char *source,
+                          const LineTable *lines, i64 start, i64 end);
+
+void lexer_reset(Lexer *lexer, i64 index);
 
 void free_lexer(Lexer *lexer);
 
-TokensList *tokenizer(Lexer *lexer);
+Token lexer_next_token(Lexer *lexer);
+
+Token lexer_peek_token(Lexer *lexer, i8 n);
+
+TokenBuffer *tokenizer(Lexer *lexer);
+
+i8 append_diagnostic(Diagnostics *diagnostics, Diagnostic diagnostic);
+
+void print_diagnostic(Diagnostic *diagnostic);
 #endif
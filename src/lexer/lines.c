@@ -0,0 +1,138 @@
+#include "lines.h"
+#include "scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+void line_table_init(LineTable *lines) {
+  lines->offsets = NULL;
+  lines->length = lines->capacity = 0;
+}
+
+/**
+ * Make room for at least count more breaklines
+ * @param lines
+ * @param count
+ * @return true on success, false if there is no memory left
+ */
+static i8 line_table_reserve(LineTable *lines, i64 count) {
+  if (lines->length + count <= lines->capacity)
+    return 1;
+
+  i64 capacity = lines->capacity ? lines->capacity * 2 : 256;
+  while (capacity < lines->length + count)
+    capacity *= 2;
+  i32 *grown = realloc(lines->offsets, sizeof(i32) * capacity);
+  if (grown == NULL)
+    return 0;
+  lines->offsets = grown;
+  lines->capacity = capacity;
+  return 1;
+}
+
+/**
+ * Record every breakline of a source at once with a vectorized scan
+ * @param lines must be empty
+ * @param source
+ * @param length
+ * @return true on success, false if there is no memory left
+ */
+i8 line_table_scan(LineTable *lines, const char *source, i64 length) {
+  // The lexer never counts a breakline at index 0
+  i64 last = 0, count = count_breaklines(source, 1, length, &last);
+  if (!line_table_reserve(lines, count))
+    return 0;
+  lines->length = find_breaklines(source, 1, length, lines->offsets);
+  return 1;
+}
+
+/**
+ * Append every breakline of from, which must all come after the ones of lines
+ * @param lines
+ * @param from
+ * @return true on success, false if there is no memory left
+ */
+i8 line_table_append(LineTable *lines, const LineTable *from) {
+  if (!line_table_reserve(lines, from->length))
+    return 0;
+  if (from->length > 0)
+    memcpy(lines->offsets + lines->length, from->offsets,
+           sizeof(i32) * from->length);
+  lines->length += from->length;
+  return 1;
+}
+
+/**
+ * Count the breaklines at or before an offset by binary search
+ * @param lines
+ * @param offset
+ * @return index of the first breakline past offset
+ */
+i64 line_table_count(const LineTable *lines, i64 offset) {
+  i64 low = 0, high = lines->length;
+  while (low < high) {
+    i64 middle = low + (high - low) / 2;
+    if (lines->offsets[middle] <= offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+/**
+ * Update the table after removed characters at offset were replaced by
+ * inserted ones. Only the inserted characters are scanned, the breaklines
+ * after them are shifted
+ * @param lines
+ * @param source the edited source
+ * @param offset
+ * @param removed
+ * @param inserted
+ * @return true on success, false if there is no memory left
+ */
+i8 line_table_edit(LineTable *lines, const char *source, i64 offset,
+                   i64 removed, i64 inserted) {
+  // A breakline at index 0 is never recorded, so an edit at offset 0 also
+  // covers the character after it, which may be a breakline that now counts
+  if (offset == 0)
+    removed++, inserted++;
+
+  i64 first = offset ? line_table_count(lines, offset - 1) : 0;
+  i64 last = line_table_count(lines, offset + removed - 1);
+  i64 from = offset ? offset : 1, to = offset + inserted, unused = 0;
+  i64 added = count_breaklines(source, from, to, &unused);
+
+  i64 tail = lines->length - last;
+  if (added > last - first &&
+      !line_table_reserve(lines, added - (last - first)))
+    return 0;
+  if (tail > 0)
+    memmove(lines->offsets + first + added, lines->offsets + last,
+            sizeof(i32) * tail);
+  if (added > 0)
+    find_breaklines(source, from, to, lines->offsets + first);
+  lines->length = first + added + tail;
+  for (i64 i = first + added; i < lines->length; i++)
+    lines->offsets[i] = lines->offsets[i] - removed + inserted;
+  return 1;
+}
+
+/**
+ * Find the line and column of any offset in O(log n), with the lexer
+ * conventions: a breakline is the column 0 of the line it starts
+ * @param lines
+ * @param offset
+ * @param line set to the line of offset
+ * @param column set to the column of offset
+ */
+void line_table_lookup(const LineTable *lines, i64 offset, i64 *line,
+                       i64 *column) {
+  i64 count = line_table_count(lines, offset);
+  *line = count + 1;
+  *column = count ? offset - lines->offsets[count - 1] : offset + 1;
+}
+
+void line_table_free(LineTable *lines) {
+  free(lines->offsets), lines->offsets = NULL;
+  lines->length = lines->capacity = 0;
+}
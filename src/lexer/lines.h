@@ -0,0 +1,31 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include "../helper.h"
+
+// Offsets of the breaklines of a source in increasing order, line n + 1
+// starts right after the n-th one. A breakline at offset 0 is never counted,
+// the lexer doesn't either
+typedef struct {
+  i32 *offsets;
+  i64 length;
+  i64 capacity;
+} LineTable;
+
+void line_table_init(LineTable *lines);
+
+i8 line_table_scan(LineTable *lines, const char *source, i64 length);
+
+i8 line_table_append(LineTable *lines, const LineTable *from);
+
+i64 line_table_count(const LineTable *lines, i64 offset);
+
+i8 line_table_edit(LineTable *lines, const char *source, i64 offset,
+                   i64 removed, i64 inserted);
+
+void line_table_lookup(const LineTable *lines, i64 offset, i64 *line,
+                       i64 *column);
+
+void line_table_free(LineTable *lines);
+
+#endif
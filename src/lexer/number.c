@@ -0,0 +1,257 @@
+#include "number.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Most significant digits a decimal mantissa keeps, 10^19 still fits
+#define MANTISSA_DIGITS 19
+// Largest mantissa and power of ten a double holds exactly
+#define EXACT_MANTISSA (1ULL << 53)
+#define EXACT_POWER 22
+
+static const double powers_of_ten[EXACT_POWER + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline i8 is_decimal_digit(char c) { return c >= '0' && c <= '9'; }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/**
+ * Checks if 8 bytes are all ASCII digits, every lane at once
+ * @param chunk the bytes, first one lowest
+ * @return true if they are all digits
+ */
+static inline i8 is_eight_digits(uint64_t chunk) {
+  return (((chunk + 0x4646464646464646) | (chunk - 0x3030303030303030)) &
+          0x8080808080808080) == 0;
+}
+
+/**
+ * Value of 8 ASCII digits: adjacent digits are merged into pairs, pairs into
+ * quads and quads into the whole number with three multiplications
+ * @param chunk the digits, first one lowest
+ * @return the value
+ */
+static inline uint64_t parse_eight_digits(uint64_t chunk) {
+  const uint64_t mask = 0x000000FF000000FF;
+  const uint64_t mul1 = 100 + (1000000ULL << 32);
+  const uint64_t mul2 = 1 + (10000ULL << 32);
+  chunk -= 0x3030303030303030;
+  chunk = chunk * 10 + (chunk >> 8);
+  return ((chunk & mask) * mul1 + ((chunk >> 16) & mask) * mul2) >> 32;
+}
+
+/**
+ * Read the 8 digits at digits[i] when there are 8 of them in a row
+ * @param digits
+ * @param i
+ * @param end
+ * @param value set to their value
+ * @return true if there were 8 digits
+ */
+static inline i8 read_eight_digits(const char *digits, i64 i, i64 end,
+                                   uint64_t *value) {
+  uint64_t chunk;
+  if (end - i < 8)
+    return 0;
+  memcpy(&chunk, digits + i, sizeof(chunk));
+  if (!is_eight_digits(chunk))
+    return 0;
+  *value = parse_eight_digits(chunk);
+  return 1;
+}
+#else
+static inline i8 read_eight_digits(const char *digits, i64 i, i64 end,
+                                   uint64_t *value) {
+  return 0;
+}
+#endif
+
+static i64 digit_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return c - 'A' + 10;
+}
+
+/**
+ * Decode the digits of a binary, octal or hexadecimal literal
+ * @param digits
+ * @param length
+ * @param bits per digit
+ * @param number
+ */
+static void decode_power_of_two(const char *digits, i64 length, i64 bits,
+                                Number *number) {
+  uint64_t value = 0;
+  for (i64 i = 0; i < length; i++) {
+    if (digits[i] == '_')
+      continue;
+    if (value >> (64 - bits) != 0) {
+      number->overflow = 1;
+      number->integer = UINT64_MAX;
+      return;
+    }
+    value = value << bits | digit_value(digits[i]);
+  }
+  number->integer = value;
+}
+
+/**
+ * Decode a decimal integer, 8 digits at a time while the value is small
+ * enough for 8 more digits not to overflow
+ * @param digits
+ * @param length
+ * @param number
+ */
+static void decode_decimal(const char *digits, i64 length, Number *number) {
+  uint64_t value = 0, eight;
+  i64 i = 0;
+  while (i < length) {
+    if (value < 100000000000ULL && read_eight_digits(digits, i, length, &eight)) {
+      value = value * 100000000 + eight;
+      i += 8;
+      continue;
+    }
+    char c = digits[i++];
+    if (c == '_')
+      continue;
+    uint64_t digit = c - '0';
+    if (value > (UINT64_MAX - digit) / 10) {
+      number->overflow = 1;
+      number->integer = UINT64_MAX;
+      return;
+    }
+    value = value * 10 + digit;
+  }
+  number->integer = value;
+}
+
+/**
+ * Decode a float literal with strtod, on a copy without digit separators
+ * @param digits
+ * @param length
+ * @return the value, correctly rounded
+ */
+static double decode_float_slow(const char *digits, i64 length) {
+  char small[128];
+  char *copy = length < (i64)sizeof(small) ? small : malloc(length + 1);
+  // Out of memory, the first digits give the magnitude at least
+  if (copy == NULL) {
+    copy = small;
+    length = sizeof(small) - 1;
+  }
+
+  i64 copied = 0;
+  for (i64 i = 0; i < length; i++)
+    if (digits[i] != '_')
+      copy[copied++] = digits[i];
+  copy[copied] = '\0';
+  double value = strtod(copy, NULL);
+  if (copy != small)
+    free(copy);
+  return value;
+}
+
+/**
+ * Decode a float literal. The first MANTISSA_DIGITS significant digits are
+ * gathered into an integer mantissa, 8 at a time when they can be, with a
+ * power of ten. When both are exact doubles one multiplication or division
+ * rounds correctly, which is Clinger's fast path. Longer mantissas and larger
+ * exponents go through strtod
+ * @param digits
+ * @param length
+ * @return the value, correctly rounded
+ */
+static double decode_float(const char *digits, i64 length) {
+  uint64_t mantissa = 0, eight;
+  i64 significant = 0, i = 0;
+  // Signed, i64 is not
+  int64_t exponent = 0;
+  i8 fraction = 0, truncated = 0;
+
+  while (i < length) {
+    if (significant + 8 <= MANTISSA_DIGITS &&
+        read_eight_digits(digits, i, length, &eight)) {
+      mantissa = mantissa * 100000000 + eight;
+      // Leading zeros are not significant
+      if (mantissa != 0)
+        significant += 8;
+      exponent -= fraction ? 8 : 0;
+      i += 8;
+      continue;
+    }
+
+    char c = digits[i];
+    if (c == '.')
+      fraction = 1;
+    else if (is_decimal_digit(c)) {
+      if (significant < MANTISSA_DIGITS) {
+        mantissa = mantissa * 10 + (c - '0');
+        significant += mantissa != 0;
+        exponent -= fraction;
+      } else {
+        truncated |= c != '0';
+        exponent += !fraction;
+      }
+    } else if (c != '_')
+      break;
+    i++;
+  }
+
+  if (i < length) {
+    // Exponent, the lexer checked it has digits
+    i++;
+    i8 negative = digits[i] == '-';
+    if (digits[i] == '-' || digits[i] == '+')
+      i++;
+    int64_t value = 0;
+    for (; i < length; i++)
+      if (digits[i] != '_' && value < 100000)
+        value = value * 10 + (digits[i] - '0');
+    exponent += negative ? -value : value;
+  }
+
+  if (truncated || mantissa > EXACT_MANTISSA)
+    return decode_float_slow(digits, length);
+  if (mantissa == 0)
+    return 0;
+  if (exponent < 0 && exponent >= -EXACT_POWER)
+    return (double)mantissa / powers_of_ten[-exponent];
+  if (exponent >= 0 && exponent <= EXACT_POWER)
+    return (double)mantissa * powers_of_ten[exponent];
+  return decode_float_slow(digits, length);
+}
+
+/**
+ * Decode the value of a numeric literal the lexer checked already
+ * @param lexeme the literal, digit separators included, without its type
+ * suffix
+ * @param length
+ * @param type INT_LITERAL, FLOAT_LITERAL, BINARY_LITERAL, OCT_LITERAL or
+ * HEX_LITERAL
+ * @param number set to the value, the suffix is left as it is
+ */
+void decode_number(const char *lexeme, i64 length, TokenType type,
+                   Number *number) {
+  number->overflow = 0;
+  switch (type) {
+  case BINARY_LITERAL:
+    decode_power_of_two(lexeme + 2, length - 2, 1, number);
+    break;
+  case OCT_LITERAL:
+    decode_power_of_two(lexeme + 2, length - 2, 3, number);
+    break;
+  case HEX_LITERAL:
+    decode_power_of_two(lexeme + 2, length - 2, 4, number);
+    break;
+  case FLOAT_LITERAL:
+    number->real = decode_float(lexeme, length);
+    break;
+  default:
+    decode_decimal(lexeme, length, number);
+    break;
+  }
+}
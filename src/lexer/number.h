@@ -0,0 +1,10 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include "../helper.h"
+#include "token.h"
+
+void decode_number(const char *lexeme, i64 length, TokenType type,
+                   Number *number);
+
+#endif
@@ -0,0 +1,227 @@
+#include "parallel.h"
+#include "scan.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const Lexer *parent;
+  i64 start;
+  i64 end;
+
+  TokenBuffer *tokens;
+  Diagnostics diagnostics;
+  i8 out_of_memory;
+} SourceChunk;
+
+/**
+ * Walk the source the way the lexer would see comments, strings and char
+ * literals, and record a split point after the first breakline outside of
+ * them past every chunk boundary, where the lexer is between two tokens
+ * @param source
+ * @param length
+ * @param splits receives chunks + 1 offsets, splits[0] is 0 and the last one
+ * is length
+ * @param chunks wanted number of chunks
+ * @return number of chunks found, at most chunks
+ */
+static i64 find_split_points(const char *source, i64 length, i64 *splits,
+                             i64 chunks) {
+  i64 found = 1, i = 0;
+  i64 target = length / chunks;
+  splits[0] = 0;
+
+  while (i < length && found < chunks) {
+    i8 splitting = i >= target;
+    i = scan_any(source, i, length, splitting ? "/*\"'\n\r" : "/*\"'");
+    if (i >= length)
+      break;
+
+    switch (source[i]) {
+    case '\n':
+    case '\r':
+      if (++i < length) {
+        splits[found++] = i;
+        target = length / chunks * found;
+      }
+      break;
+
+    case '/':
+      if (source[i + 1] == '/')
+        i = scan_line_end(source, i + 1, length);
+      else if (source[i + 1] == '*')
+        i = scan_comment_end(source, i + 1, length) + 2;
+      else
+        i++;
+      break;
+
+    case '*':
+      // "*/" is lexed as one error token, "**" and "*=" as one operator
+      i += source[i + 1] == '/' || source[i + 1] == '*' || source[i + 1] == '='
+               ? 2
+               : 1;
+      break;
+
+    case '"':
+      i = scan_string_end(source, i + 1, length) + 1;
+      break;
+
+    default:
+      // Char literal, its body is never a token start
+      i = scan_char_end(source, i + 1, length);
+      i += i < length && source[i] == '\'';
+      break;
+    }
+  }
+
+  splits[found] = length;
+  return found;
+}
+
+/**
+ * Lex one chunk
+ * @param data SourceChunk to lex
+ * @return NULL
+ */
+static void *lex_chunk(void *data) {
+  SourceChunk *chunk = data;
+  const Lexer *parent = chunk->parent;
+  Lexer *lexer =
+      create_chunk_lexer(parent->pos.file_location, parent->source,
+                         &parent->lines, chunk->start, chunk->end);
+  if (lexer == NULL) {
+    chunk->out_of_memory = 1;
+    return NULL;
+  }
+
+  chunk->tokens = tokenizer(lexer);
+  chunk->out_of_memory = chunk->tokens == NULL;
+  chunk->diagnostics = lexer->diagnostics;
+  lexer->diagnostics.items = NULL;
+  free_lexer(lexer);
+  return NULL;
+}
+
+/**
+ * Concatenate the chunk token streams and diagnostics in order, dropping every
+ * TK_EOF but the last one. Offsets, lines and columns are all absolute
+ * already since every chunk lexer shares the line table of the whole source
+ * @param lexer receives the diagnostics, its line table is copied
+ * @param chunks
+ * @param count
+ * @return the whole token stream, NULL if there is no memory left
+ */
+static TokenBuffer *stitch_chunks(Lexer *lexer, SourceChunk *chunks,
+                                  i64 count) {
+  i64 total = 1;
+  for (i64 i = 0; i < count; i++) {
+    if (chunks[i].out_of_memory)
+      return NULL;
+    total += chunks[i].tokens->length - 1;
+  }
+
+  TokenBuffer *tokens = create_token_buffer(lexer->source, total);
+  if (tokens == NULL)
+    return NULL;
+  if (!line_table_append(&tokens->lines, &lexer->lines)) {
+    free_token_buffer(tokens);
+    return NULL;
+  }
+
+  for (i64 i = 0; i < count; i++) {
+    TokenBuffer *part = chunks[i].tokens;
+    i64 length = i + 1 == count ? part->length : part->length - 1;
+    // The buffer was created with room for every token
+    memcpy(tokens->types + tokens->length, part->types, sizeof(i8) * length);
+    memcpy(tokens->offsets + tokens->length, part->offsets,
+           sizeof(i32) * length);
+    memcpy(tokens->lengths + tokens->length, part->lengths,
+           sizeof(i32) * length);
+    // Numbers and decoded literals are never on the dropped TK_EOF, the
+    // values of the latter move along with the pool
+    if (!append_numbers(tokens, part->number_tokens, part->numbers,
+                        part->numbers_length, tokens->length) ||
+        !append_decoded(tokens, part->decoded_tokens, part->decoded,
+                        part->decoded_length, tokens->length)) {
+      free_token_buffer(tokens);
+      return NULL;
+    }
+    tokens->length += length;
+    arena_merge(&tokens->strings, &part->strings);
+
+    for (i64 j = 0; j < chunks[i].diagnostics.length; j++) {
+      if (!append_diagnostic(&lexer->diagnostics,
+                             chunks[i].diagnostics.items[j])) {
+        free_token_buffer(tokens);
+        return NULL;
+      }
+    }
+  }
+  return tokens;
+}
+
+/**
+ * Lex a source with several threads. The source is split at line starts
+ * outside comments and strings, every chunk is lexed on its own thread and
+ * the results are stitched back, giving exactly the tokens and diagnostics
+ * tokenizer() would. Small sources, and sources holding a '\0' that the
+ * lexer would stop at, are lexed sequentially
+ * @param lexer must be at the start of the source
+ * @param threads
+ * @return every token up to TK_EOF, NULL if there is no memory left
+ */
+TokenBuffer *tokenizer_parallel(Lexer *lexer, i64 threads) {
+  i64 length = lexer->length;
+  i64 chunks = length / PARALLEL_MIN_CHUNK;
+  if (chunks > threads)
+    chunks = threads;
+  if (chunks < 2 || lexer->pos.index != 0 ||
+      memchr(lexer->source, '\0', length) != NULL)
+    return tokenizer(lexer);
+
+  i64 *splits = malloc(sizeof(i64) * (chunks + 1));
+  SourceChunk *parts = calloc(chunks, sizeof(SourceChunk));
+  pthread_t *ids = malloc(sizeof(pthread_t) * chunks);
+  i8 *started = calloc(chunks, sizeof(i8));
+  TokenBuffer *tokens = NULL;
+  if (splits == NULL || parts == NULL || ids == NULL || started == NULL) {
+    lexer->out_of_memory = 1;
+    goto cleanup;
+  }
+
+  chunks = find_split_points(lexer->source, length, splits, chunks);
+  for (i64 i = 0; i < chunks; i++) {
+    parts[i].parent = lexer;
+    parts[i].start = splits[i];
+    parts[i].end = splits[i + 1];
+  }
+
+  // Chunk 0 runs on the calling thread, as does any chunk whose thread can't
+  // be started
+  for (i64 i = 1; i < chunks; i++)
+    started[i] = pthread_create(&ids[i], NULL, lex_chunk, &parts[i]) == 0;
+  lex_chunk(&parts[0]);
+  for (i64 i = 1; i < chunks; i++) {
+    if (started[i])
+      pthread_join(ids[i], NULL);
+    else
+      lex_chunk(&parts[i]);
+  }
+
+  tokens = stitch_chunks(lexer, parts, chunks);
+  if (tokens != NULL) {
+    lexer->strings = &tokens->strings;
+    lexer_reset(lexer, length);
+  } else
+    lexer->out_of_memory = 1;
+
+  for (i64 i = 0; i < chunks; i++) {
+    if (parts[i].tokens != NULL)
+      free_token_buffer(parts[i].tokens);
+    free(parts[i].diagnostics.items);
+  }
+
+cleanup:
+  free(splits), free(parts), free(ids), free(started);
+  return tokens;
+}
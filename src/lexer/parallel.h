@@ -0,0 +1,13 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "lexer.h"
+
+// Sources smaller than two chunks are lexed sequentially
+#ifndef PARALLEL_MIN_CHUNK
+#define PARALLEL_MIN_CHUNK (1024 * 1024)
+#endif
+
+TokenBuffer *tokenizer_parallel(Lexer *lexer, i64 threads);
+
+#endif
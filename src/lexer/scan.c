@@ -0,0 +1,291 @@
+#include "scan.h"
+#include "escape.h"
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+
+typedef __m256i Chunk;
+
+static inline Chunk load_chunk(const char *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline i32 equal_mask(Chunk chunk, char c) {
+  return (i32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c)));
+}
+
+// Bit i is set when chunk[i] isn't ASCII
+static inline i32 high_mask(Chunk chunk) {
+  return (i32)_mm256_movemask_epi8(chunk);
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+
+typedef __m128i Chunk;
+
+static inline Chunk load_chunk(const char *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline i32 equal_mask(Chunk chunk, char c) {
+  return (i32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+}
+
+static inline i32 high_mask(Chunk chunk) {
+  return (i32)_mm_movemask_epi8(chunk);
+}
+#endif
+
+#ifdef SCAN_WIDTH
+#define FULL_MASK ((i32)(((i64)1 << SCAN_WIDTH) - 1))
+
+/**
+ * Bit i is set when chunk[i] is a breakline
+ * @param chunk
+ * @return mask of breaklines
+ */
+static inline i32 breakline_mask(Chunk chunk) {
+  return equal_mask(chunk, '\n') | equal_mask(chunk, '\r');
+}
+#endif
+
+static inline i8 is_breakline(char c) { return c == '\n' || c == '\r'; }
+
+static inline i8 is_whitespace(char c) {
+  return c == ' ' || c == '\t' || is_breakline(c);
+}
+
+/**
+ * Find the first character that isn't a blank, tabulation or new line
+ * @param source
+ * @param from
+ * @param length
+ * @return its index, length if there is none
+ */
+i64 scan_whitespace(const char *source, i64 from, i64 length) {
+  i64 i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= length; i += SCAN_WIDTH) {
+    Chunk chunk = load_chunk(source + i);
+    i32 blank = equal_mask(chunk, ' ') | equal_mask(chunk, '\t') |
+                breakline_mask(chunk);
+    if (blank != FULL_MASK)
+      return i + __builtin_ctz(~blank & FULL_MASK);
+  }
+#endif
+  while (i < length && is_whitespace(source[i]))
+    i++;
+  return i;
+}
+
+/**
+ * Find the end of a single line comment
+ * @param source
+ * @param from
+ * @param length
+ * @return index of the next breakline or '\0', length if there is none
+ */
+i64 scan_line_end(const char *source, i64 from, i64 length) {
+  i64 i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= length; i += SCAN_WIDTH) {
+    Chunk chunk = load_chunk(source + i);
+    i32 mask = breakline_mask(chunk) | equal_mask(chunk, '\0');
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  while (i < length && !is_breakline(source[i]) && source[i] != '\0')
+    i++;
+  return i;
+}
+
+/**
+ * Find the end of a multiline comment
+ * @param source
+ * @param from
+ * @param length
+ * @return index of the '*' that closes the comment or of the next '\0', length
+ * if there is none
+ */
+i64 scan_comment_end(const char *source, i64 from, i64 length) {
+  i64 i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= length; i += SCAN_WIDTH) {
+    Chunk chunk = load_chunk(source + i);
+    i32 mask = equal_mask(chunk, '*') | equal_mask(chunk, '\0');
+    while (mask) {
+      i64 k = i + __builtin_ctz(mask);
+      if (source[k] == '\0' || source[k + 1] == '/')
+        return k;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < length; i++)
+    if (source[i] == '\0' || (source[i] == '*' && source[i + 1] == '/'))
+      return i;
+  return i;
+}
+
+/**
+ * Find the next character of a string literal the lexer has to look at
+ * @param source
+ * @param from
+ * @param length
+ * @param non_ascii also stop at bytes past ASCII
+ * @return index of the next '"', '\\' or '\0', length if there is none
+ */
+static inline i64 scan_string_stop(const char *source, i64 from, i64 length,
+                                   i8 non_ascii) {
+  i64 i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= length; i += SCAN_WIDTH) {
+    Chunk chunk = load_chunk(source + i);
+    i32 mask = equal_mask(chunk, '"') | equal_mask(chunk, '\\') |
+               equal_mask(chunk, '\0');
+    if (non_ascii)
+      mask |= high_mask(chunk);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < length; i++) {
+    char c = source[i];
+    if (c == '"' || c == '\\' || c == '\0' || (non_ascii && c & 0x80))
+      return i;
+  }
+  return i;
+}
+
+/**
+ * Find the next quote, backslash, '\0' or byte past ASCII of a string
+ * literal. Plain ASCII runs are skipped a whole vector at a time
+ * @param source
+ * @param from
+ * @param length
+ * @return its index, length if there is none
+ */
+i64 scan_string_special(const char *source, i64 from, i64 length) {
+  return scan_string_stop(source, from, length, 1);
+}
+
+/**
+ * Find the end of a string literal, skipping escaped characters
+ * @param source
+ * @param from
+ * @param length
+ * @return index of the next unescaped '"' or '\0', length if there is none
+ */
+i64 scan_string_end(const char *source, i64 from, i64 length) {
+  i64 i = scan_string_stop(source, from, length, 0);
+  while (i < length && source[i] == '\\') {
+    // The escaped character can't close the literal, unless it is the end
+    i += source[i + 1] == '\0' ? 1 : 2;
+    i = scan_string_stop(source, i < length ? i : length, length, 0);
+  }
+  return i;
+}
+
+/**
+ * Find the end of the body of a char literal: an escape sequence or a single
+ * character, UTF-8 sequences included. A quote right away is an empty body
+ * @param source
+ * @param from index right after the opening quote
+ * @param length
+ * @return index right after the body, where the closing quote should be
+ */
+i64 scan_char_end(const char *source, i64 from, i64 length) {
+  if (from >= length || source[from] == '\0' || source[from] == '\'')
+    return from;
+
+  i64 end;
+  if (source[from] == '\\') {
+    int64_t code;
+    end = read_escape(source, from, &code);
+  } else {
+    i64 sequence = utf8_sequence_length(source + from, NULL);
+    end = from + (sequence ? sequence : 1);
+  }
+  return end < length ? end : length;
+}
+
+/**
+ * Find the first character that belongs to a small set
+ * @param source
+ * @param from
+ * @param length
+ * @param set characters to look for, '\0' is not allowed inside it
+ * @return index of the first character inside set, length if there is none
+ */
+i64 scan_any(const char *source, i64 from, i64 length, const char *set) {
+  i64 i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= length; i += SCAN_WIDTH) {
+    Chunk chunk = load_chunk(source + i);
+    i32 mask = 0;
+    for (const char *c = set; *c != '\0'; c++)
+      mask |= equal_mask(chunk, *c);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < length; i++)
+    if (strchr(set, source[i]) != NULL && source[i] != '\0')
+      return i;
+  return i;
+}
+
+/**
+ * Count breaklines between from and to
+ * @param source
+ * @param from first index, inclusive
+ * @param to last index, exclusive
+ * @param last set to the index of the last breakline, untouched if none
+ * @return number of breaklines
+ */
+i64 count_breaklines(const char *source, i64 from, i64 to, i64 *last) {
+  i64 lines = 0, i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= to; i += SCAN_WIDTH) {
+    i32 mask = breakline_mask(load_chunk(source + i));
+    if (mask) {
+      lines += __builtin_popcount(mask);
+      *last = i + 31 - __builtin_clz(mask);
+    }
+  }
+#endif
+  for (; i < to; i++)
+    if (is_breakline(source[i]))
+      lines++, *last = i;
+  return lines;
+}
+
+/**
+ * Write the index of every breakline between from and to
+ * @param source
+ * @param from first index, inclusive
+ * @param to last index, exclusive
+ * @param offsets receives the indexes in increasing order, it must have room
+ * for count_breaklines(source, from, to) of them
+ * @return number of breaklines written
+ */
+i64 find_breaklines(const char *source, i64 from, i64 to, i32 *offsets) {
+  i64 count = 0, i = from;
+#ifdef SCAN_WIDTH
+  for (; i + SCAN_WIDTH <= to; i += SCAN_WIDTH) {
+    i32 mask = breakline_mask(load_chunk(source + i));
+    while (mask) {
+      offsets[count++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < to; i++)
+    if (is_breakline(source[i]))
+      offsets[count++] = i;
+  return count;
+}
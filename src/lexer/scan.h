@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "../helper.h"
+
+// Every scan stops at length at the latest and never reads past
+// source[length], which must be the '\0' sentinel
+
+i64 scan_whitespace(const char *source, i64 from, i64 length);
+
+i64 scan_line_end(const char *source, i64 from, i64 length);
+
+i64 scan_comment_end(const char *source, i64 from, i64 length);
+
+i64 scan_string_special(const char *source, i64 from, i64 length);
+
+i64 scan_string_end(const char *source, i64 from, i64 length);
+
+i64 scan_char_end(const char *source, i64 from, i64 length);
+
+i64 scan_any(const char *source, i64 from, i64 length, const char *set);
+
+i64 count_breaklines(const char *source, i64 from, i64 to, i64 *last);
+
+i64 find_breaklines(const char *source, i64 from, i64 to, i32 *offsets);
+
+#endif
@@ -0,0 +1,85 @@
+#define _DEFAULT_SOURCE
+#include "stats.h"
+#include <pthread.h>
+#include <time.h>
+
+#ifdef LEXER_STATS
+// Every lexer adds its own counters here when it is freed
+static LexerStats total;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *phase_names[LEXER_PHASE_COUNT] = {
+    [PHASE_LINES] = "lines",
+    [PHASE_SKIP] = "skip",
+    [PHASE_SCAN] = "scan",
+    [PHASE_STORE] = "store",
+};
+
+/**
+ * Monotonic clock used to time the phases
+ * @return nanoseconds
+ */
+i64 lexer_stats_clock(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * Add the counters of a lexer to the process totals, lexers of every thread
+ * can merge at once
+ * @param stats
+ */
+void lexer_stats_merge(const LexerStats *stats) {
+  pthread_mutex_lock(&total_lock);
+  for (i64 i = 0; i < TOKEN_TYPE_COUNT; i++)
+    total.tokens[i] += stats->tokens[i];
+  total.whitespace_bytes += stats->whitespace_bytes;
+  total.comment_bytes += stats->comment_bytes;
+  total.keyword_probes += stats->keyword_probes;
+  total.keyword_misses += stats->keyword_misses;
+  total.decoded_strings += stats->decoded_strings;
+  total.resets += stats->resets;
+  for (i64 i = 0; i < LEXER_PHASE_COUNT; i++)
+    total.phase_time[i] += stats->phase_time[i];
+  pthread_mutex_unlock(&total_lock);
+}
+#endif
+
+/**
+ * Print the totals of every lexer freed so far. Phase times add up the time
+ * of every thread
+ * @param out
+ * @return false if the lexer was built without LEXER_STATS
+ */
+i8 print_lexer_stats(FILE *out) {
+#ifdef LEXER_STATS
+  pthread_mutex_lock(&total_lock);
+  i64 tokens = 0;
+  for (i64 i = 0; i < TOKEN_TYPE_COUNT; i++)
+    tokens += total.tokens[i];
+
+  fprintf(out, "Lexer stats\n");
+  fprintf(out, "  tokens            %12ld\n", tokens);
+  for (i64 i = 0; i < TOKEN_TYPE_COUNT; i++) {
+    if (total.tokens[i] == 0)
+      continue;
+    i64 length;
+    fprintf(out, "    %-22s%10ld  %5.1f%%\n", token_type_name(i, &length),
+            total.tokens[i], 100.0 * total.tokens[i] / tokens);
+  }
+  fprintf(out, "  whitespace bytes  %12ld\n", total.whitespace_bytes);
+  fprintf(out, "  comment bytes     %12ld\n", total.comment_bytes);
+  fprintf(out, "  keyword probes    %12ld\n", total.keyword_probes);
+  fprintf(out, "  keyword misses    %12ld\n", total.keyword_misses);
+  fprintf(out, "  decoded strings   %12ld\n", total.decoded_strings);
+  fprintf(out, "  resets            %12ld\n", total.resets);
+  for (i64 i = 0; i < LEXER_PHASE_COUNT; i++)
+    fprintf(out, "  %-6s time       %12.3f ms\n", phase_names[i],
+            total.phase_time[i] / 1e6);
+  pthread_mutex_unlock(&total_lock);
+  return 1;
+#else
+  return 0;
+#endif
+}
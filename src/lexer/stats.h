@@ -0,0 +1,50 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "../helper.h"
+#include "token.h"
+#include <stdio.h>
+
+// Lexer counters, only compiled in with -DLEXER_STATS (make STATS=1). Without
+// it LEXER_STAT drops its statements and the lexer is left untouched
+
+#ifdef LEXER_STATS
+typedef enum {
+  // Indexing the breaklines of the source
+  PHASE_LINES,
+  // Skipping whitespace and comments
+  PHASE_SKIP,
+  // Scanning and classifying tokens
+  PHASE_SCAN,
+  // Appending tokens to the token buffer
+  PHASE_STORE,
+  LEXER_PHASE_COUNT,
+} LexerPhase;
+
+typedef struct {
+  i64 tokens[TOKEN_TYPE_COUNT];
+  i64 whitespace_bytes;
+  i64 comment_bytes;
+  // Identifiers looked up in the keyword table, and the ones that weren't
+  // keywords
+  i64 keyword_probes;
+  i64 keyword_misses;
+  // String and char literals with escape sequences, decoded into the pool
+  i64 decoded_strings;
+  // Times a lexer was moved back or elsewhere by lexer_reset
+  i64 resets;
+  i64 phase_time[LEXER_PHASE_COUNT];
+} LexerStats;
+
+#define LEXER_STAT(...) __VA_ARGS__
+
+i64 lexer_stats_clock(void);
+
+void lexer_stats_merge(const LexerStats *stats);
+#else
+#define LEXER_STAT(...)
+#endif
+
+i8 print_lexer_stats(FILE *out);
+
+#endif
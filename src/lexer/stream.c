@@ -0,0 +1,197 @@
+#include "stream.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_STREAM_BYTE_ORDER 0x01020304
+#define TOKEN_STREAM_ALIGNMENT 8
+// Records converted per write
+#define TOKEN_STREAM_CHUNK 1024
+
+static i64 stream_size(const TokenStreamHeader *header) {
+  i64 size = sizeof(TokenStreamHeader) +
+             (sizeof(Number) + sizeof(i32)) * header->numbers_length +
+             sizeof(TokenRecord) * header->tokens_length +
+             (sizeof(i32) + sizeof(PackedString)) * header->decoded_length +
+             sizeof(i32) * header->lines_length + header->decoded_size +
+             header->location_length + 1 + header->source_length + 1;
+  return (size + TOKEN_STREAM_ALIGNMENT - 1) &
+         ~(i64)(TOKEN_STREAM_ALIGNMENT - 1);
+}
+
+/**
+ * Write the tokens of a source as a binary token stream
+ * @param out
+ * @param file_location
+ * @param tokens
+ * @param source_length length of the source the tokens are slices of
+ * @return false if the stream couldn't be written or if there is no memory
+ * left
+ */
+i8 write_token_stream(FILE *out, const char *file_location,
+                      const TokenBuffer *tokens, i64 source_length) {
+  TokenStreamHeader header = {.version = TOKEN_STREAM_VERSION,
+                              .byte_order = TOKEN_STREAM_BYTE_ORDER,
+                              .tokens_length = tokens->length,
+                              .numbers_length = tokens->numbers_length,
+                              .decoded_length = tokens->decoded_length,
+                              .decoded_size = decoded_size(tokens),
+                              .lines_length = tokens->lines.length,
+                              .location_length = strlen(file_location),
+                              .source_length = source_length};
+  memcpy(header.magic, TOKEN_STREAM_MAGIC, sizeof(header.magic));
+  PackedString *decoded =
+      malloc(sizeof(PackedString) * header.decoded_length + 1);
+  char *decoded_data = malloc(header.decoded_size + 1);
+  if (decoded == NULL || decoded_data == NULL) {
+    free(decoded), free(decoded_data);
+    return 0;
+  }
+  pack_decoded(tokens, decoded, decoded_data);
+
+  fwrite(&header, sizeof(TokenStreamHeader), 1, out);
+  fwrite(tokens->numbers, sizeof(Number), tokens->numbers_length, out);
+
+  TokenRecord records[TOKEN_STREAM_CHUNK];
+  memset(records, 0, sizeof(records));
+  for (i64 i = 0; i < tokens->length; i += TOKEN_STREAM_CHUNK) {
+    i64 count = tokens->length - i;
+    if (count > TOKEN_STREAM_CHUNK)
+      count = TOKEN_STREAM_CHUNK;
+    for (i64 j = 0; j < count; j++) {
+      records[j].offset = tokens->offsets[i + j];
+      records[j].length = tokens->lengths[i + j];
+      records[j].type = tokens->types[i + j];
+    }
+    fwrite(records, sizeof(TokenRecord), count, out);
+  }
+
+  fwrite(tokens->number_tokens, sizeof(i32), tokens->numbers_length, out);
+  fwrite(tokens->decoded_tokens, sizeof(i32), tokens->decoded_length, out);
+  fwrite(decoded, sizeof(PackedString), header.decoded_length, out);
+  fwrite(tokens->lines.offsets, sizeof(i32), tokens->lines.length, out);
+  fwrite(decoded_data, 1, header.decoded_size, out);
+  free(decoded), free(decoded_data);
+  fwrite(file_location, 1, header.location_length + 1, out);
+  fwrite(tokens->source, 1, source_length, out);
+
+  // The '\0' after the source, then the padding
+  static const char zeros[TOKEN_STREAM_ALIGNMENT + 1];
+  i64 written = sizeof(TokenStreamHeader) +
+                (sizeof(Number) + sizeof(i32)) * tokens->numbers_length +
+                sizeof(TokenRecord) * tokens->length +
+                (sizeof(i32) + sizeof(PackedString)) * header.decoded_length +
+                sizeof(i32) * tokens->lines.length + header.decoded_size +
+                header.location_length + 1 + source_length;
+  fwrite(zeros, 1, stream_size(&header) - written, out);
+  return !ferror(out);
+}
+
+/**
+ * Read a token stream in place, nothing is copied. Every token record is
+ * checked so the tokens can be used without further checks
+ * @param data start of the stream, 8-byte aligned
+ * @param size bytes available from data, the stream may be followed by
+ * other ones
+ * @param stream set to a view of the stream
+ * @return false if data doesn't start with a valid stream
+ */
+i8 read_token_stream(const char *data, i64 size, TokenStream *stream) {
+  if (size < sizeof(TokenStreamHeader) ||
+      (uintptr_t)data % TOKEN_STREAM_ALIGNMENT != 0)
+    return 0;
+
+  const TokenStreamHeader *header = (const TokenStreamHeader *)data;
+  if (memcmp(header->magic, TOKEN_STREAM_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != TOKEN_STREAM_VERSION ||
+      header->byte_order != TOKEN_STREAM_BYTE_ORDER)
+    return 0;
+  // Bounded first so the size can't overflow
+  if (header->tokens_length > size ||
+      header->numbers_length > header->tokens_length ||
+      header->decoded_length > header->tokens_length ||
+      header->decoded_size > size || header->lines_length > size ||
+      header->location_length > size || header->source_length > size ||
+      header->source_length > TOKEN_MAX_OFFSET ||
+      stream_size(header) > size)
+    return 0;
+
+  stream->numbers = (const Number *)(data + sizeof(TokenStreamHeader));
+  stream->numbers_length = header->numbers_length;
+  stream->records =
+      (const TokenRecord *)(stream->numbers + header->numbers_length);
+  stream->length = header->tokens_length;
+  stream->number_tokens =
+      (const i32 *)(stream->records + header->tokens_length);
+  stream->decoded_tokens = stream->number_tokens + header->numbers_length;
+  stream->decoded = (const PackedString *)(stream->decoded_tokens +
+                                           header->decoded_length);
+  stream->decoded_length = header->decoded_length;
+  stream->lines.offsets = (i32 *)(stream->decoded + header->decoded_length);
+  stream->lines.length = header->lines_length;
+  stream->lines.capacity = 0;
+  stream->decoded_data =
+      (const char *)(stream->lines.offsets + header->lines_length);
+  stream->file_location = stream->decoded_data + header->decoded_size;
+  stream->source = stream->file_location + header->location_length + 1;
+  stream->source_length = header->source_length;
+  stream->size = stream_size(header);
+
+  if (stream->file_location[header->location_length] != '\0' ||
+      stream->source[header->source_length] != '\0')
+    return 0;
+  for (i64 i = 0; i < stream->length; i++) {
+    const TokenRecord *record = &stream->records[i];
+    if (record->type >= TOKEN_TYPE_COUNT ||
+        (i64)record->offset + record->length > stream->source_length)
+      return 0;
+    // create_token strips their quotes
+    if ((record->type == STRING_LITERAL || record->type == CHAR_LITERAL) &&
+        record->length < 2)
+      return 0;
+  }
+  // Numbers and decoded literals are looked up by binary search on their
+  // token
+  for (i64 i = 0; i < stream->numbers_length; i++)
+    if (stream->number_tokens[i] >= stream->length ||
+        (i > 0 && stream->number_tokens[i] <= stream->number_tokens[i - 1]))
+      return 0;
+  for (i64 i = 0; i < stream->decoded_length; i++) {
+    const i32 *decoded_tokens = stream->decoded_tokens;
+    if (decoded_tokens[i] >= stream->length ||
+        (i > 0 && decoded_tokens[i] <= decoded_tokens[i - 1]) ||
+        (i64)stream->decoded[i].offset + stream->decoded[i].length >
+            header->decoded_size)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * Unpack a token of a stream, its line and column are looked up in the line
+ * table of the stream, the number of a numeric or char literal in its
+ * numbers and the value of a literal with escape sequences in its strings
+ * @param stream
+ * @param index
+ * @return the token
+ */
+Token token_stream_get(const TokenStream *stream, i64 index) {
+  const TokenRecord *record = &stream->records[index];
+  TokenPosition pos = {.start = record->offset};
+  pos.end = pos.start + record->length;
+  line_table_lookup(&stream->lines, pos.start, &pos.line, &pos.column);
+  Token token = create_token(stream->source, record->type, pos);
+  if (is_number_type(token.type))
+    token.number = get_number(stream->number_tokens, stream->numbers,
+                              stream->numbers_length, index);
+  if ((token.type == STRING_LITERAL || token.type == CHAR_LITERAL) &&
+      stream->decoded_length > 0) {
+    i64 i = find_token_entry(stream->decoded_tokens, stream->decoded_length,
+                             index);
+    if (i < stream->decoded_length) {
+      token.value = stream->decoded_data + stream->decoded[i].offset;
+      token.length = stream->decoded[i].length;
+    }
+  }
+  return token;
+}
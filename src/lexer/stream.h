@@ -0,0 +1,70 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "../helper.h"
+#include "token.h"
+#include <stdio.h>
+
+// Binary token stream: a header, the numbers of the numeric and char
+// literals, the token records, the token index of each number, the token
+// index and value range of each literal with escape sequences, the line
+// table, then the strings: the decoded values back to back, the file
+// location and the source, the last two each followed by a '\0'. Other token
+// values are slices of the source. Streams are padded to 8 bytes so several
+// can be concatenated. Bump TOKEN_STREAM_VERSION whenever the layout or the
+// meaning of a token type changes
+#define TOKEN_STREAM_MAGIC "MKTS"
+#define TOKEN_STREAM_VERSION 3
+
+// Every field is in the byte order of the writer, byte_order tells readers
+// on another architecture to reject the stream
+typedef struct {
+  char magic[4];
+  i32 version;
+  i32 byte_order;
+  i32 reserved;
+  i64 tokens_length;
+  i64 numbers_length;
+  i64 decoded_length;
+  i64 decoded_size;
+  i64 lines_length;
+  i64 location_length;
+  i64 source_length;
+} TokenStreamHeader;
+
+// 12 bytes, the padding is always zero
+typedef struct {
+  i32 offset;
+  i32 length;
+  i8 type;
+  i8 padding[3];
+} TokenRecord;
+
+// View of a stream in memory, every pointer is into the stream itself
+typedef struct {
+  const char *file_location;
+  const TokenRecord *records;
+  i64 length;
+  const i32 *number_tokens;
+  const Number *numbers;
+  i64 numbers_length;
+  const i32 *decoded_tokens;
+  const PackedString *decoded;
+  i64 decoded_length;
+  const char *decoded_data;
+  // Its offsets are only read
+  LineTable lines;
+  const char *source;
+  i64 source_length;
+  // Bytes of the stream, padding included
+  i64 size;
+} TokenStream;
+
+i8 write_token_stream(FILE *out, const char *file_location,
+                      const TokenBuffer *tokens, i64 source_length);
+
+i8 read_token_stream(const char *data, i64 size, TokenStream *stream);
+
+Token token_stream_get(const TokenStream *stream, i64 index);
+
+#endif
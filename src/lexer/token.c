@@ -1,263 +1,676 @@
 #include "token.h"
-#include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static char *token_type_string(TokenType type) {
-  switch (type) {
-  // case OPERATOR:
-  case PLUS:
-    return "PLUS";
-  case INCREMENT:
-    return "INCREMENT";
-  case ASSIGNMENT_PLUS:
-    return "ASSIGNMENT_PLUS";
-  case MINUS:
-    return "MINUS";
-  case DECREMENT:
-    return "DECREMENT";
-  case ASSIGNMENT_MINUS:
-    return "ASSIGNMENT_MINUS";
-  case MULTIPLY:
-    return "MULTIPLY";
-  case ASSIGNMENT_MULTIPLY:
-    return "ASSIGNMENT_MULTIPLY";
-  case DIVIDE:
-    return "DIVIDE";
-  case ASSIGNMENT_DIVIDE:
-    return "ASSIGNMENT_DIVIDE";
-  case MODULE:
-    return "MODULE";
-  case ASSIGNMENT_MODULE:
-    return "ASSIGNMENT_MODULE";
-  case POWER:
-    return "POWER";
-  case NOT:
-    return "NOT";
-  case NOT_EQUAL:
-    return "NOT_EQUAL";
-  case OR:
-    return "OR";
-  case AND:
-    return "AND";
-  case BITWISE_AND:
-    return "BITWISE_AND";
-  case BITWISE_OR:
-    return "BITWISE_OR";
-  case BITWISE_XOR:
-    return "BITWISE_XOR";
-  case BITWISE_NOT:
-    return "BITWISE_NOT";
-  case EQUAL:
-    return "EQUAL";
-  case LESS_THEN:
-    return "LESS_THEN";
-  case LEFT_SHIFT:
-    return "LEFT_SHIFT";
-  case RIGHT_SHIFT:
-    return "RIGHT_SHIFT";
-  case GREATER_THEN:
-    return "GREATER_THEN";
-  case LESS_EQUAL:
-    return "LESS_EQUAL";
-  case GREATER_EQUAL:
-    return "GREATER_EQUAL";
-  case ASSIGNMENT_OPERATOR:
-    return "ASSIGNMENT_OPERATOR";
-  case ASSIGNMENT_MUTABLE:
-    return "ASSIGNMENT_MUTABLE";
-  case TERNARY_OPERATOR:
-    return "TERNARY_OPERATOR";
-  case RETURN_OPERATOR:
-    return "RETURN_OPERATOR";
-  case OR_TYPE:
-    return "OR_TYPE";
-  case TYPE_DECLARATION:
-    return "TYPE_DECLARATION";
-  case SPREAD:
-    return "SPREAD";
-
-  // case SEPERATOR:
-  case LCBRACKETS:
-    return "LCBRACKETS";
-  case RCBRACKETS:
-    return "RCBRACKETS";
-  case LBRACKETS:
-    return "LBRACKETS";
-  case RBRACKETS:
-    return "RBRACKETS";
-  case LPARENTESES:
-    return "LPARENTESES";
-  case RPARENTESES:
-    return "RPARENTESES";
-  case SEMICOLON:
-    return "SEMICOLON";
-  case COMMA:
-    return "COMMA";
-  case DOT:
-    return "DOT";
-
-  // case LITERAL:
-  case IDENTIFIER:
-    return "IDENTIFIER";
+#define TOKEN_TYPE_NAME(type, name) [type] = {name, sizeof(name) - 1}
+static const struct {
+  const char *name;
+  i64 length;
+} token_type_names[TOKEN_TYPE_COUNT] = {
+    TOKEN_TYPE_NAME(PLUS, "PLUS"),
+    TOKEN_TYPE_NAME(INCREMENT, "INCREMENT"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_PLUS, "ASSIGNMENT_PLUS"),
+    TOKEN_TYPE_NAME(MINUS, "MINUS"),
+    TOKEN_TYPE_NAME(DECREMENT, "DECREMENT"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_MINUS, "ASSIGNMENT_MINUS"),
+    TOKEN_TYPE_NAME(MULTIPLY, "MULTIPLY"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_MULTIPLY, "ASSIGNMENT_MULTIPLY"),
+    TOKEN_TYPE_NAME(DIVIDE, "DIVIDE"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_DIVIDE, "ASSIGNMENT_DIVIDE"),
+    TOKEN_TYPE_NAME(MODULE, "MODULE"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_MODULE, "ASSIGNMENT_MODULE"),
+    TOKEN_TYPE_NAME(POWER, "POWER"),
+    TOKEN_TYPE_NAME(NOT, "NOT"),
+    TOKEN_TYPE_NAME(NOT_EQUAL, "NOT_EQUAL"),
+    TOKEN_TYPE_NAME(OR, "OR"),
+    TOKEN_TYPE_NAME(AND, "AND"),
+    TOKEN_TYPE_NAME(BITWISE_AND, "BITWISE_AND"),
+    TOKEN_TYPE_NAME(BITWISE_OR, "BITWISE_OR"),
+    TOKEN_TYPE_NAME(BITWISE_XOR, "BITWISE_XOR"),
+    TOKEN_TYPE_NAME(BITWISE_NOT, "BITWISE_NOT"),
+    TOKEN_TYPE_NAME(EQUAL, "EQUAL"),
+    TOKEN_TYPE_NAME(LESS_THEN, "LESS_THEN"),
+    TOKEN_TYPE_NAME(LEFT_SHIFT, "LEFT_SHIFT"),
+    TOKEN_TYPE_NAME(RIGHT_SHIFT, "RIGHT_SHIFT"),
+    TOKEN_TYPE_NAME(GREATER_THEN, "GREATER_THEN"),
+    TOKEN_TYPE_NAME(LESS_EQUAL, "LESS_EQUAL"),
+    TOKEN_TYPE_NAME(GREATER_EQUAL, "GREATER_EQUAL"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_OPERATOR, "ASSIGNMENT_OPERATOR"),
+    TOKEN_TYPE_NAME(ASSIGNMENT_MUTABLE, "ASSIGNMENT_MUTABLE"),
+    TOKEN_TYPE_NAME(TERNARY_OPERATOR, "TERNARY_OPERATOR"),
+    TOKEN_TYPE_NAME(RETURN_OPERATOR, "RETURN_OPERATOR"),
+    TOKEN_TYPE_NAME(OR_TYPE, "OR_TYPE"),
+    TOKEN_TYPE_NAME(TYPE_DECLARATION, "TYPE_DECLARATION"),
+    TOKEN_TYPE_NAME(SPREAD, "SPREAD"),
+    TOKEN_TYPE_NAME(LCBRACKETS, "LCBRACKETS"),
+    TOKEN_TYPE_NAME(RCBRACKETS, "RCBRACKETS"),
+    TOKEN_TYPE_NAME(LBRACKETS, "LBRACKETS"),
+    TOKEN_TYPE_NAME(RBRACKETS, "RBRACKETS"),
+    TOKEN_TYPE_NAME(LPARENTESES, "LPARENTESES"),
+    TOKEN_TYPE_NAME(RPARENTESES, "RPARENTESES"),
+    TOKEN_TYPE_NAME(SEMICOLON, "SEMICOLON"),
+    TOKEN_TYPE_NAME(COMMA, "COMMA"),
+    TOKEN_TYPE_NAME(DOT, "DOT"),
+    TOKEN_TYPE_NAME(IDENTIFIER, "IDENTIFIER"),
+    TOKEN_TYPE_NAME(INT_LITERAL, "INT_LITERAL"),
+    TOKEN_TYPE_NAME(FLOAT_LITERAL, "FLOAT_LITERAL"),
+    TOKEN_TYPE_NAME(STRING_LITERAL, "STRING_LITERAL"),
+    TOKEN_TYPE_NAME(CHAR_LITERAL, "CHAR_LITERAL"),
+    TOKEN_TYPE_NAME(BINARY_LITERAL, "BINARY_LITERAL"),
+    TOKEN_TYPE_NAME(OCT_LITERAL, "OCT_LITERAL"),
+    TOKEN_TYPE_NAME(HEX_LITERAL, "HEX_LITERAL"),
+    TOKEN_TYPE_NAME(IF, "IF"),
+    TOKEN_TYPE_NAME(ELSE, "ELSE"),
+    TOKEN_TYPE_NAME(WHILE, "WHILE"),
+    TOKEN_TYPE_NAME(DO, "DO"),
+    TOKEN_TYPE_NAME(FOR, "FOR"),
+    TOKEN_TYPE_NAME(FOREACH, "FOREACH"),
+    TOKEN_TYPE_NAME(CONTINUE, "CONTINUE"),
+    TOKEN_TYPE_NAME(RETURN, "RETURN"),
+    TOKEN_TYPE_NAME(SWITCH, "SWITCH"),
+    TOKEN_TYPE_NAME(CASE, "CASE"),
+    TOKEN_TYPE_NAME(BREAK, "BREAK"),
+    TOKEN_TYPE_NAME(LONG, "LONG"),
+    TOKEN_TYPE_NAME(INT, "INT"),
+    TOKEN_TYPE_NAME(I8, "I8"),
+    TOKEN_TYPE_NAME(I16, "I16"),
+    TOKEN_TYPE_NAME(I32, "I32"),
+    TOKEN_TYPE_NAME(I64, "I64"),
+    TOKEN_TYPE_NAME(FLOAT, "FLOAT"),
+    TOKEN_TYPE_NAME(F8, "F8"),
+    TOKEN_TYPE_NAME(F16, "F16"),
+    TOKEN_TYPE_NAME(F32, "F32"),
+    TOKEN_TYPE_NAME(F64, "F64"),
+    TOKEN_TYPE_NAME(DOUBLE, "F64"),
+    TOKEN_TYPE_NAME(STRING, "STRING"),
+    TOKEN_TYPE_NAME(CHAR, "CHAR"),
+    TOKEN_TYPE_NAME(VOID, "VOID"),
+    TOKEN_TYPE_NAME(BOOLEAN, "BOOLEAN"),
+    TOKEN_TYPE_NAME(TRUE, "TRUE"),
+    TOKEN_TYPE_NAME(FALSE, "FALSE"),
+    TOKEN_TYPE_NAME(CONST, "CONST"),
+    TOKEN_TYPE_NAME(TK_NULL, "TK_NULL"),
+    TOKEN_TYPE_NAME(TYPEOF, "TYPEOF"),
+    TOKEN_TYPE_NAME(SIZEOF, "SIZEOF"),
+    TOKEN_TYPE_NAME(TK_EOF, "EOF"),
+    TOKEN_TYPE_NAME(TK_ERROR, "ERROR"),
+    TOKEN_TYPE_NAME(STRUCT, "STRUCT"),
+    TOKEN_TYPE_NAME(ENUM, "ENUM"),
+    TOKEN_TYPE_NAME(IMPORT, "IMPORT"),
+    TOKEN_TYPE_NAME(FROM, "FROM"),
+};
+#undef TOKEN_TYPE_NAME
+
+/**
+ * Name of a token type, as printed in token listings
+ * @param type
+ * @param length set to the length of the name
+ * @return the name, "UNKNOW" for a value that isn't a token type
+ */
+const char *token_type_name(TokenType type, i64 *length) {
+  if (type >= TOKEN_TYPE_COUNT || token_type_names[type].name == NULL) {
+    *length = sizeof("UNKNOW") - 1;
+    return "UNKNOW";
+  }
+  *length = token_type_names[type].length;
+  return token_type_names[type].name;
+}
 
+/**
+ * Checks if tokens of this type carry a decoded Number
+ * @param type
+ * @return true for numeric literals, false otherwise
+ */
+i8 is_number_type(TokenType type) {
+  switch (type) {
   case INT_LITERAL:
-    return "INT_LITERAL";
-
   case FLOAT_LITERAL:
-    return "FLOAT_LITERAL";
-
-  case STRING_LITERAL:
-    return "STRING_LITERAL";
-
-  case CHAR_LITERAL:
-    return "CHAR_LITERAL";
-
   case BINARY_LITERAL:
-    return "BINARY_LITERAL";
-
   case OCT_LITERAL:
-    return "OCT_LITERAL";
-
   case HEX_LITERAL:
-    return "HEX_LITERAL";
-
-  // case KEYWORD:
-  case IF:
-    return "IF";
-
-  case ELSE:
-    return "ELSE";
-
-  case WHILE:
-    return "WHILE";
-
-  case DO:
-    return "DO";
-
-  case FOR:
-    return "FOR";
-
-  case FOREACH:
-    return "FOREACH";
-
-  case CONTINUE:
-    return "CONTINUE";
-
-  case RETURN:
-    return "RETURN";
-
-  case SWITCH:
-    return "SWITCH";
-
-  case CASE:
-    return "CASE";
-
-  case BREAK:
-    return "BREAK";
-
-  case LONG:
-    return "LONG";
-
-  case INT:
-    return "INT";
-
-  case I8:
-    return "I8";
-
-  case I16:
-    return "I16";
-
-  case I32:
-    return "I32";
-
-  case I64:
-    return "I64";
-
-  case FLOAT:
-    return "FLOAT";
+  case CHAR_LITERAL:
+    return 1;
+  default:
+    return 0;
+  }
+}
 
-  case F8:
-    return "F8";
+/**
+ * Create a token over the source characters between pos.start and pos.end.
+ * String and char literals get their value without the quotes
+ * @param source
+ * @param type
+ * @param pos
+ * @return the token
+ */
+Token create_token(const char *source, TokenType type, TokenPosition pos) {
+  Token token = {.value = source + pos.start,
+                 .length = pos.end - pos.start,
+                 .type = type,
+                 .pos = pos,
+                 .number = {.integer = 0}};
+  switch (type) {
+  case STRING_LITERAL:
+  case CHAR_LITERAL:
+    token.value++, token.length -= 2;
+    break;
+  case TK_EOF:
+    token.value = "EOF", token.length = 3;
+    break;
+  default:
+    break;
+  }
+  return token;
+}
 
-  case F16:
-    return "F16";
+/**
+ * Grow every token array to capacity
+ * @param tokens
+ * @param capacity
+ * @return true on success, false if there is no memory left
+ */
+static i8 resize_token_buffer(TokenBuffer *tokens, i64 capacity) {
+  i8 *types = realloc(tokens->types, sizeof(i8) * capacity);
+  if (types == NULL)
+    return 0;
+  tokens->types = types;
+  i32 *offsets = realloc(tokens->offsets, sizeof(i32) * capacity);
+  if (offsets == NULL)
+    return 0;
+  tokens->offsets = offsets;
+  i32 *lengths = realloc(tokens->lengths, sizeof(i32) * capacity);
+  if (lengths == NULL)
+    return 0;
+  tokens->lengths = lengths;
+
+  tokens->capacity = capacity;
+  return 1;
+}
 
-  case F32:
-    return "F32";
+/**
+ * Make room for count more entries in a side table: an array of token
+ * indexes and an array of values
+ * @param entry_tokens
+ * @param values
+ * @param size of a value
+ * @param length entries in use
+ * @param capacity updated when the arrays grow
+ * @param count
+ * @return true on success, false if there is no memory left
+ */
+static i8 reserve_entries(i32 **entry_tokens, void **values, i64 size,
+                          i64 length, i64 *capacity, i64 count) {
+  length += count;
+  if (length <= *capacity)
+    return 1;
+  i64 grown = *capacity ? *capacity * 2 : 16;
+  if (grown < length)
+    grown = length;
+
+  i32 *indexes = realloc(*entry_tokens, sizeof(i32) * grown);
+  if (indexes == NULL)
+    return 0;
+  *entry_tokens = indexes;
+  void *resized = realloc(*values, size * grown);
+  if (resized == NULL)
+    return 0;
+  *values = resized;
+
+  *capacity = grown;
+  return 1;
+}
 
-  case F64:
-    return "F64";
+static i8 reserve_numbers(TokenBuffer *tokens, i64 count) {
+  return reserve_entries(&tokens->number_tokens, (void **)&tokens->numbers,
+                         sizeof(Number), tokens->numbers_length,
+                         &tokens->numbers_capacity, count);
+}
 
-  case DOUBLE:
-    return "F64";
+static i8 reserve_decoded(TokenBuffer *tokens, i64 count) {
+  return reserve_entries(&tokens->decoded_tokens, (void **)&tokens->decoded,
+                         sizeof(DecodedString), tokens->decoded_length,
+                         &tokens->decoded_capacity, count);
+}
 
-  case STRING:
-    return "STRING";
+/**
+ * Find the first entry of a side table for a token at or after index
+ * @param entry_tokens token index of each entry, in increasing order
+ * @param length
+ * @param index
+ * @return its position in entry_tokens, length if there is none
+ */
+static i64 find_entry(const i32 *entry_tokens, i64 length, i64 index) {
+  i64 low = 0, high = length;
+  while (low < high) {
+    i64 middle = low + (high - low) / 2;
+    if (entry_tokens[middle] < index)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
 
-  case CHAR:
-    return "CHAR";
+/**
+ * Create an empty token buffer
+ * @param source buffer every token is a slice of
+ * @param capacity initial number of tokens, the buffer grows when it is full
+ * @return the token buffer, NULL if there is no memory left
+ */
+TokenBuffer *create_token_buffer(const char *source, i64 capacity) {
+  TokenBuffer *tokens = malloc(sizeof(TokenBuffer));
+  if (tokens == NULL)
+    return NULL;
 
-  case VOID:
-    return "VOID";
+  tokens->source = source;
+  tokens->types = NULL;
+  tokens->offsets = tokens->lengths = NULL;
+  tokens->length = tokens->capacity = 0;
+  tokens->number_tokens = NULL;
+  tokens->numbers = NULL;
+  tokens->numbers_length = tokens->numbers_capacity = 0;
+  tokens->decoded_tokens = NULL;
+  tokens->decoded = NULL;
+  tokens->decoded_length = tokens->decoded_capacity = 0;
+  tokens->symbols = NULL;
+  tokens->symbols_length = 0;
+  line_table_init(&tokens->lines);
+  arena_init(&tokens->strings);
+  tokens->strings_compacted = 0;
+
+  if (!resize_token_buffer(tokens, capacity < 16 ? 16 : capacity)) {
+    free_token_buffer(tokens);
+    return NULL;
+  }
+  return tokens;
+}
 
-  case BOOLEAN:
-    return "BOOLEAN";
+/**
+ * Pack and append a token, growing the buffer when it is full
+ * @param tokens
+ * @param token must lie within the first TOKEN_MAX_OFFSET bytes of the source
+ * @return true on success, false if there is no memory left
+ */
+i8 append_token(TokenBuffer *tokens, Token token) {
+  if (tokens->length == tokens->capacity &&
+      !resize_token_buffer(tokens, tokens->capacity * 2))
+    return 0;
+
+  if (is_number_type(token.type)) {
+    if (!reserve_numbers(tokens, 1))
+      return 0;
+    tokens->number_tokens[tokens->numbers_length] = tokens->length;
+    tokens->numbers[tokens->numbers_length++] = token.number;
+  }
+  // Decoded literals are the ones whose value isn't their body
+  if ((token.type == STRING_LITERAL || token.type == CHAR_LITERAL) &&
+      token.value != tokens->source + token.pos.start + 1) {
+    if (!reserve_decoded(tokens, 1))
+      return 0;
+    tokens->decoded_tokens[tokens->decoded_length] = tokens->length;
+    tokens->decoded[tokens->decoded_length++] =
+        (DecodedString){.value = token.value, .length = token.length};
+  }
 
-  case TRUE:
-    return "TRUE";
+  i64 i = tokens->length++;
+  tokens->types[i] = token.type;
+  tokens->offsets[i] = token.pos.start;
+  tokens->lengths[i] = token.pos.end - token.pos.start;
+  return 1;
+}
 
-  case FALSE:
-    return "FALSE";
+/**
+ * Append numbers of tokens copied into the buffer
+ * @param tokens
+ * @param number_tokens token index of each number, in increasing order
+ * @param numbers
+ * @param length
+ * @param shift added to every token index, they must come out past the
+ * tokens of the numbers already in the buffer
+ * @return true on success, false if there is no memory left
+ */
+i8 append_numbers(TokenBuffer *tokens, const i32 *number_tokens,
+                  const Number *numbers, i64 length, i64 shift) {
+  if (!reserve_numbers(tokens, length))
+    return 0;
+  for (i64 i = 0; i < length; i++)
+    tokens->number_tokens[tokens->numbers_length + i] =
+        number_tokens[i] + shift;
+  if (length > 0)
+    memcpy(tokens->numbers + tokens->numbers_length, numbers,
+           sizeof(Number) * length);
+  tokens->numbers_length += length;
+  return 1;
+}
 
-  case CONST:
-    return "CONST";
+/**
+ * Append decoded literals of tokens copied into the buffer, their values
+ * must live as long as the buffer string pool
+ * @param tokens
+ * @param decoded_tokens token index of each literal, in increasing order
+ * @param decoded
+ * @param length
+ * @param shift added to every token index, see append_numbers
+ * @return true on success, false if there is no memory left
+ */
+i8 append_decoded(TokenBuffer *tokens, const i32 *decoded_tokens,
+                  const DecodedString *decoded, i64 length, i64 shift) {
+  if (!reserve_decoded(tokens, length))
+    return 0;
+  for (i64 i = 0; i < length; i++)
+    tokens->decoded_tokens[tokens->decoded_length + i] =
+        decoded_tokens[i] + shift;
+  if (length > 0)
+    memcpy(tokens->decoded + tokens->decoded_length, decoded,
+           sizeof(DecodedString) * length);
+  tokens->decoded_length += length;
+  return 1;
+}
 
-  case TK_NULL:
-    return "TK_NULL";
+/**
+ * Total size of the decoded literal values
+ * @param tokens
+ * @return the size in bytes
+ */
+i64 decoded_size(const TokenBuffer *tokens) {
+  i64 size = 0;
+  for (i64 i = 0; i < tokens->decoded_length; i++)
+    size += tokens->decoded[i].length;
+  return size;
+}
 
-  case TYPEOF:
-    return "TYPEOF";
+/**
+ * Copy the decoded literal values to a new string pool and free the old one,
+ * values of replaced tokens are left behind. The buffer is unchanged if
+ * there is no memory left
+ * @param tokens
+ * @return true on success, false if there is no memory left
+ */
+i8 compact_strings(TokenBuffer *tokens) {
+  Arena strings;
+  arena_init(&strings);
+  i64 size = decoded_size(tokens);
+  char *data = size > 0 ? arena_alloc(&strings, size) : NULL;
+  if (size > 0 && data == NULL)
+    return 0;
+
+  for (i64 i = 0; i < tokens->decoded_length; i++) {
+    DecodedString *decoded = &tokens->decoded[i];
+    if (decoded->length > 0)
+      memcpy(data, decoded->value, decoded->length);
+    decoded->value = data;
+    data += decoded->length;
+  }
+  arena_free(&tokens->strings);
+  tokens->strings = strings;
+  tokens->strings_compacted = arena_used(&strings);
+  return 1;
+}
 
-  case SIZEOF:
-    return "SIZEOF";
+/**
+ * Lay the decoded literal values out back to back, to write them out
+ * @param tokens
+ * @param packed receives a range of data per literal
+ * @param data receives decoded_size bytes
+ */
+void pack_decoded(const TokenBuffer *tokens, PackedString *packed,
+                  char *data) {
+  i64 offset = 0;
+  for (i64 i = 0; i < tokens->decoded_length; i++) {
+    const DecodedString *decoded = &tokens->decoded[i];
+    memcpy(data + offset, decoded->value, decoded->length);
+    packed[i] = (PackedString){.offset = offset, .length = decoded->length};
+    offset += decoded->length;
+  }
+}
 
-  case TK_EOF:
-    return "EOF";
+/**
+ * Append decoded literals read back from pack_decoded, their values are
+ * copied into the string pool
+ * @param tokens
+ * @param decoded_tokens token index of each literal, in increasing order
+ * @param packed ranges of data, each one within size
+ * @param data
+ * @param length
+ * @param size of data
+ * @return true on success, false if there is no memory left
+ */
+i8 append_packed(TokenBuffer *tokens, const i32 *decoded_tokens,
+                 const PackedString *packed, const char *data, i64 length,
+                 i64 size) {
+  if (length == 0)
+    return 1;
+  if (!reserve_decoded(tokens, length))
+    return 0;
+  char *copy = arena_strndup(&tokens->strings, data, size);
+  if (copy == NULL)
+    return 0;
+  for (i64 i = 0; i < length; i++) {
+    i64 at = tokens->decoded_length++;
+    tokens->decoded_tokens[at] = decoded_tokens[i];
+    tokens->decoded[at] = (DecodedString){.value = copy + packed[i].offset,
+                                          .length = packed[i].length};
+  }
+  return 1;
+}
 
-  case STRUCT:
-    return "STRUCT";
+/**
+ * Splice a side table the way replace_tokens splices the tokens: entries of
+ * the replaced tokens go, the ones of the replacement come in and the ones
+ * after them are shifted. Room for the inserted entries must be reserved
+ * @param entry_tokens
+ * @param values
+ * @param size of a value
+ * @param length entries in use, updated
+ * @param inserted_tokens token index of each entry of the replacement
+ * @param inserted_values
+ * @param inserted
+ * @param from first replaced token
+ * @param to last replaced token, exclusive
+ * @param count tokens in the replacement
+ */
+static void splice_entries(i32 *entry_tokens, void *values, i64 size,
+                           i64 *length, const i32 *inserted_tokens,
+                           const void *inserted_values, i64 inserted,
+                           i64 from, i64 to, i64 count) {
+  i64 first = find_entry(entry_tokens, *length, from);
+  i64 last = find_entry(entry_tokens, *length, to);
+  i64 tail = *length - last;
+  // The tables are NULL until their first entry
+  if (tail > 0) {
+    memmove(entry_tokens + first + inserted, entry_tokens + last,
+            sizeof(i32) * tail);
+    memmove((char *)values + (first + inserted) * size,
+            (char *)values + last * size, size * tail);
+  }
+  for (i64 i = 0; i < inserted; i++)
+    entry_tokens[first + i] = inserted_tokens[i] + from;
+  if (inserted > 0)
+    memcpy((char *)values + first * size, inserted_values, size * inserted);
+  for (i64 i = first + inserted; i < first + inserted + tail; i++)
+    entry_tokens[i] += count - (to - from);
+  *length = first + inserted + tail;
+}
 
-  case ENUM:
-    return "ENUM";
+/**
+ * Replace the tokens between from and to by every token of replacement
+ * @param tokens
+ * @param from first replaced token
+ * @param to last replaced token, exclusive
+ * @param replacement tokens over the same source
+ * @return true on success, false if there is no memory left
+ */
+i8 replace_tokens(TokenBuffer *tokens, i64 from, i64 to,
+                  const TokenBuffer *replacement) {
+  i64 count = replacement->length, tail = tokens->length - to;
+  i64 length = from + count + tail;
+  if (length > tokens->capacity) {
+    i64 capacity = tokens->capacity * 2;
+    if (!resize_token_buffer(tokens, capacity > length ? capacity : length))
+      return 0;
+  }
+  if (!reserve_numbers(tokens, replacement->numbers_length) ||
+      !reserve_decoded(tokens, replacement->decoded_length))
+    return 0;
+
+  splice_entries(tokens->number_tokens, tokens->numbers, sizeof(Number),
+                 &tokens->numbers_length, replacement->number_tokens,
+                 replacement->numbers, replacement->numbers_length, from, to,
+                 count);
+  splice_entries(tokens->decoded_tokens, tokens->decoded,
+                 sizeof(DecodedString), &tokens->decoded_length,
+                 replacement->decoded_tokens, replacement->decoded,
+                 replacement->decoded_length, from, to, count);
+
+  memmove(tokens->types + from + count, tokens->types + to, sizeof(i8) * tail);
+  memmove(tokens->offsets + from + count, tokens->offsets + to,
+          sizeof(i32) * tail);
+  memmove(tokens->lengths + from + count, tokens->lengths + to,
+          sizeof(i32) * tail);
+  // The tokens from there on must be interned again
+  if (tokens->symbols_length > from)
+    tokens->symbols_length = from;
+  memcpy(tokens->types + from, replacement->types, sizeof(i8) * count);
+  memcpy(tokens->offsets + from, replacement->offsets, sizeof(i32) * count);
+  memcpy(tokens->lengths + from, replacement->lengths, sizeof(i32) * count);
+  tokens->length = length;
+  return 1;
+}
 
-  case IMPORT:
-    return "IMPORT";
+/**
+ * Find the side table entry of a token
+ * @param entry_tokens token index of each entry, in increasing order
+ * @param length
+ * @param index of the token
+ * @return its position in entry_tokens, length if the token has none
+ */
+i64 find_token_entry(const i32 *entry_tokens, i64 length, i64 index) {
+  i64 i = find_entry(entry_tokens, length, index);
+  return i < length && entry_tokens[i] == index ? i : length;
+}
 
-  case FROM:
-    return "FROM";
+/**
+ * Look up the number of a numeric or char literal
+ * @param number_tokens token index of each number, in increasing order
+ * @param numbers
+ * @param length
+ * @param index of the token
+ * @return its number, zero if the token has none
+ */
+Number get_number(const i32 *number_tokens, const Number *numbers,
+                  i64 length, i64 index) {
+  i64 i = find_token_entry(number_tokens, length, index);
+  return i == length ? (Number){.integer = 0} : numbers[i];
+}
 
-  default:
-    return "UNKNOW";
+/**
+ * Unpack a token, its line and column are looked up in the line table, the
+ * number of a numeric or char literal in the number arrays and the value of
+ * a literal with escape sequences in the decoded ones
+ * @param tokens
+ * @param index
+ * @return the token
+ */
+Token get_token(const TokenBuffer *tokens, i64 index) {
+  TokenPosition pos = {.start = tokens->offsets[index]};
+  pos.end = pos.start + tokens->lengths[index];
+  line_table_lookup(&tokens->lines, pos.start, &pos.line, &pos.column);
+  Token token = create_token(tokens->source, tokens->types[index], pos);
+  if (is_number_type(token.type))
+    token.number = get_number(tokens->number_tokens, tokens->numbers,
+                              tokens->numbers_length, index);
+  if ((token.type == STRING_LITERAL || token.type == CHAR_LITERAL) &&
+      tokens->decoded_length > 0) {
+    i64 i = find_token_entry(tokens->decoded_tokens, tokens->decoded_length,
+                             index);
+    if (i < tokens->decoded_length) {
+      token.value = tokens->decoded[i].value;
+      token.length = tokens->decoded[i].length;
+    }
   }
+  return token;
 }
 
-Token *create_token(char *value, TokenType type, TokenPosition pos) {
-  Token *token = malloc(sizeof(Token));
-  if (token == NULL)
-    return NULL;
+// Recent names of an intern_tokens call, looked up before the shared table
+// so a name repeated in a file takes the table lock only once
+#define RECENT_SYMBOLS 256
+
+typedef struct {
+  i64 hash;
+  // Token holding the name, NO_SYMBOL when the entry is empty
+  i32 token;
+  i32 symbol;
+} RecentSymbol;
+
+/**
+ * Give every identifier not interned yet its symbol. Tokens appended or
+ * replaced later need another call
+ * @param table shared by every token buffer of the compilation
+ * @param tokens
+ * @return true on success, false if there is no memory left
+ */
+i8 intern_tokens(SymbolTable *table, TokenBuffer *tokens) {
+  i32 *symbols = realloc(tokens->symbols, sizeof(i32) * tokens->length);
+  if (symbols == NULL && tokens->length > 0)
+    return 0;
+  tokens->symbols = symbols;
+
+  RecentSymbol recent[RECENT_SYMBOLS];
+  for (i64 i = 0; i < RECENT_SYMBOLS; i++)
+    recent[i].token = NO_SYMBOL;
+
+  for (i64 i = tokens->symbols_length; i < tokens->length; i++) {
+    symbols[i] = NO_SYMBOL;
+    if (tokens->types[i] != IDENTIFIER)
+      continue;
+
+    const char *name = tokens->source + tokens->offsets[i];
+    i64 length = tokens->lengths[i];
+    i64 hash = symbol_hash(name, length);
+    RecentSymbol *entry = &recent[hash & (RECENT_SYMBOLS - 1)];
+    if (entry->token != NO_SYMBOL && entry->hash == hash &&
+        tokens->lengths[entry->token] == length &&
+        memcmp(tokens->source + tokens->offsets[entry->token], name,
+               length) == 0) {
+      symbols[i] = entry->symbol;
+      continue;
+    }
+
+    symbols[i] = intern_hashed(table, name, length, hash);
+    if (symbols[i] == NO_SYMBOL) {
+      tokens->symbols_length = i;
+      return 0;
+    }
+    *entry = (RecentSymbol){.hash = hash, .token = i, .symbol = symbols[i]};
+  }
+  tokens->symbols_length = tokens->length;
+  return 1;
+}
 
-  token->value = value;
-  token->type = type;
-  token->pos = pos;
-  return token;
+/**
+ * Release the tokens and every token value at once
+ * @param tokens
+ */
+void free_token_buffer(TokenBuffer *tokens) {
+  arena_free(&tokens->strings);
+  line_table_free(&tokens->lines);
+  free(tokens->types), tokens->types = NULL;
+  free(tokens->offsets), tokens->offsets = NULL;
+  free(tokens->lengths), tokens->lengths = NULL;
+  free(tokens->number_tokens), tokens->number_tokens = NULL;
+  free(tokens->numbers), tokens->numbers = NULL;
+  free(tokens->decoded_tokens), tokens->decoded_tokens = NULL;
+  free(tokens->decoded), tokens->decoded = NULL;
+  free(tokens->symbols), tokens->symbols = NULL;
+  free(tokens);
 }
 
 void print_token(Token *token) {
-  printf("(%s, %s)  -> [ Start: %ld, End: %ld ] [ Line: %ld, Column: %ld ]\n", 
-         token_type_string(token->type), token->value, 
-         token->pos.start, token->pos.end,
+  i64 length;
+  printf("(%s, %.*s)  -> [ Start: %ld, End: %ld ] [ Line: %ld, Column: %ld ]\n", 
+         token_type_name(token->type, &length), (int)token->length,
+         token->value, token->pos.start, token->pos.end,
          token->pos.line, token->pos.column
          );
 }
@@ -2,6 +2,9 @@
 #define TOKEN_H
 
 #include "../helper.h"
+#include "../utils/arena.h"
+#include "../utils/intern.h"
+#include "lines.h"
 
 typedef enum {
   // OPERATOR
@@ -101,6 +104,7 @@ typedef enum {
   TYPEOF,              // typeof
   SIZEOF,              // sizeof
   TK_EOF,              // EOF
+  TK_ERROR,            // Invalid input, see the lexer diagnostics
 
   STRUCT,              // struct
   ENUM,                // enum
@@ -109,6 +113,9 @@ typedef enum {
   FROM,                // from
 } TokenType;
 
+#define TOKEN_TYPE_COUNT (FROM + 1)
+
+// end is exclusive, line and column are the ones of start
 typedef struct {
   i64 start;
   i64 end;
@@ -116,21 +123,141 @@ typedef struct {
   i64 column;
 } TokenPosition;
 
-typedef struct T_K {
-  char *value;
+// Type suffix of a numeric literal, as in 10i8 or 2.5f32
+typedef enum {
+  NUMBER_UNTYPED,
+  NUMBER_I8,
+  NUMBER_I16,
+  NUMBER_I32,
+  NUMBER_I64,
+  NUMBER_F32,
+  NUMBER_F64,
+} NumberSuffix;
+
+// Value of a numeric literal, or code point of a char literal, decoded once
+// by the lexer. Float literals set real, every other one integer
+typedef struct {
+  union {
+    i64 integer;
+    double real;
+  };
+  // A NumberSuffix
+  i8 suffix;
+  // The integer doesn't fit in 64 bits, integer is then UINT64_MAX
+  i8 overflow;
+  // Always zero, numbers are written out as they are
+  i8 padding[6];
+} Number;
+
+// Value of a string or char literal with escape sequences, decoded once by
+// the lexer into the token buffer string pool
+typedef struct {
+  const char *value;
+  i64 length;
+} DecodedString;
+
+// Decoded value as written out by the cache and token streams: a range of
+// the string bytes stored with it
+typedef struct {
+  i32 offset;
+  i32 length;
+} PackedString;
+
+// Unpacked view of a token. value is a slice of the source buffer (or of the
+// token buffer string pool, for literals with escape sequences) and is not
+// null terminated, it must outlive the
+// token. 64 bytes, it is passed around by value
+typedef struct {
+  const char *value;
+  // Lexemes are at most TOKEN_MAX_OFFSET long
+  i32 length;
   TokenType type;
   TokenPosition pos;
-
-  struct T_K *next;
-  struct T_K *prev;
+  // Only set on numeric literals, and on char literals whose code point is
+  // the integer
+  Number number;
 } Token;
 
+// Largest source a token buffer can index, offsets and lengths are 32 bits
+#define TOKEN_MAX_OFFSET UINT32_MAX
+
+// Tokens packed struct-of-arrays, 9 bytes each: the type, the offset of the
+// first character and the length of the whole lexeme. Values, lines and
+// columns are rebuilt from the source and the line table by get_token
 typedef struct {
-  Token *head;
-  Token *tail;
-} TokensList;
+  const char *source;
+  i8 *types;
+  i32 *offsets;
+  i32 *lengths;
+  i64 length;
+  i64 capacity;
+
+  // Numeric and char literals in token order, packed apart since they are
+  // few: the
+  // index of each one in the token arrays and its value
+  i32 *number_tokens;
+  Number *numbers;
+  i64 numbers_length;
+  i64 numbers_capacity;
+
+  // Literals with escape sequences in token order, the others are slices of
+  // the source: the index of each one in the token arrays and its value
+  i32 *decoded_tokens;
+  DecodedString *decoded;
+  i64 decoded_length;
+  i64 decoded_capacity;
+
+  // Symbol of every identifier, NO_SYMBOL for the other tokens. Only the
+  // first symbols_length tokens have one, see intern_tokens
+  i32 *symbols;
+  i64 symbols_length;
+
+  LineTable lines;
+  Arena strings;
+  // Bytes used in strings after it was last compacted, see compact_strings
+  i64 strings_compacted;
+} TokenBuffer;
+
+const char *token_type_name(TokenType type, i64 *length);
+
+i8 is_number_type(TokenType type);
+
+Token create_token(const char *source, TokenType type, TokenPosition pos);
+
+TokenBuffer *create_token_buffer(const char *source, i64 capacity);
+
+i8 append_token(TokenBuffer *tokens, Token token);
+
+i8 replace_tokens(TokenBuffer *tokens, i64 from, i64 to,
+                  const TokenBuffer *replacement);
+
+Token get_token(const TokenBuffer *tokens, i64 index);
+
+i8 append_numbers(TokenBuffer *tokens, const i32 *number_tokens,
+                  const Number *numbers, i64 length, i64 shift);
+
+Number get_number(const i32 *number_tokens, const Number *numbers,
+                  i64 length, i64 index);
+
+i64 find_token_entry(const i32 *entry_tokens, i64 length, i64 index);
+
+i8 append_decoded(TokenBuffer *tokens, const i32 *decoded_tokens,
+                  const DecodedString *decoded, i64 length, i64 shift);
+
+i64 decoded_size(const TokenBuffer *tokens);
+
+i8 compact_strings(TokenBuffer *tokens);
+
+void pack_decoded(const TokenBuffer *tokens, PackedString *packed,
+                  char *data);
+
+i8 append_packed(TokenBuffer *tokens, const i32 *decoded_tokens,
+                 const PackedString *packed, const char *data, i64 length,
+                 i64 size);
+
+i8 intern_tokens(SymbolTable *table, TokenBuffer *tokens);
 
-Token *create_token(char *value, TokenType type, TokenPosition pos);
+void free_token_buffer(TokenBuffer *tokens);
 
 void print_token(Token *token);
 
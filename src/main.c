@@ -1,22 +1,310 @@
+#include "./driver/cache.h"
+#include "./driver/driver.h"
+#include "./lexer/dump.h"
 #include "./lexer/lexer.h"
+#include "./lexer/stream.h"
+#include "./parser/parser.h"
 #include "./utils/utils.h"
+#include "./vm/compiler.h"
+#include "./vm/vm.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--threads N] [--cache DIR] [--format FORMAT]\n"
+          "          [--from-tokens] [--ast] [--bytecode] [--run] [--stats]\n"
+          "          [--quiet]\n"
+          "          [file or directory ...] [-- argument ...]\n"
+          "  Lexes every file, directories are searched for *%s files.\n"
+          "  --threads N      worker threads, default one per core\n"
+          "  --cache DIR      reuse the tokens and syntax trees of unchanged\n"
+          "                   files, stored in DIR\n"
+          "  --format FORMAT  token listing format: text (default), jsonl, one\n"
+          "                   JSON object per token, or binary, a token\n"
+          "                   stream for other tools\n"
+          "  --from-tokens    read binary token streams instead of sources,\n"
+          "                   from stdin by default, and list their tokens\n"
+          "  --ast            parse the tokens and print the syntax tree\n"
+          "  --bytecode       compile the syntax tree and print the bytecode\n"
+          "  --run            compile the syntax tree and run it, main included\n"
+          "  --stats          print lexer counters and timings to stderr, needs\n"
+          "                   a build with make STATS=1\n"
+          "  --quiet          only print diagnostics and a summary\n"
+          "  --               the arguments after it are passed to main by\n"
+          "                   --run, after the file name\n",
+          program, SOURCE_EXTENSION);
+}
+
+/**
+ * List the tokens of every token stream in a file, the way the tokens of a
+ * source are listed
+ * @param file_location
+ * @param dump the tokens are listed to, NULL to only count them
+ * @param tokens_count increased by the number of tokens read
+ * @return the number of errors
+ */
+static i64 print_token_streams(const char *file_location, TokenDump *dump,
+                               i64 *tokens_count) {
+  SourceFile *file = load_source(file_location);
+  if (file == NULL) {
+    fprintf(stderr, "FileError: file %s could not be read: %s\n",
+            file_location, strerror(errno));
+    return 1;
+  }
+
+  i64 errors = 0;
+  TokenStream stream;
+  for (i64 offset = 0; offset < file->length; offset += stream.size) {
+    if (!read_token_stream(file->data + offset, file->length - offset,
+                           &stream)) {
+      fprintf(stderr, "FileError: file %s is not a valid token stream\n",
+              file_location);
+      errors++;
+      break;
+    }
+
+    *tokens_count += stream.length;
+    if (dump == NULL)
+      continue;
+    dump_file(dump, stream.file_location);
+    for (i64 i = 0; i < stream.length; i++) {
+      Token token = token_stream_get(&stream, i);
+      dump_token(dump, stream.file_location, &token);
+    }
+  }
+  free_source(file);
+  return errors;
+}
 
 int main(int argc, char *argv[]) {
-  char *file_location = "code/test.monkc";
-  char *source = read_file(file_location);
-  printf("CODE  ↴\n");
-  printf(" %s\n", source);
+  char *default_location = "code/test.monkc";
+  i64 threads = 0;
+  i8 quiet = 0, ast = 0, bytecode = 0, run = 0, binary = 0, from_tokens = 0,
+     stats = 0;
+  DumpFormat format = DUMP_TEXT;
+  TokenDump dump = {.buffer = NULL};
+
+  Project *project = create_project();
+  if (project == NULL)
+    goto error_mem_size;
+
+  i64 paths = 0;
+  // Arguments of main, after "--"
+  int arguments = argc;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--") == 0) {
+      arguments = i + 1;
+      break;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      long count = atol(argv[++i]);
+      if (count <= 0) {
+        print_usage(argv[0]);
+        free_project(project);
+        return EXIT_FAILURE;
+      }
+      threads = count;
+    } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+      project->cache_directory = argv[++i];
+    else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      const char *name = argv[++i];
+      binary = strcmp(name, "binary") == 0;
+      if (strcmp(name, "jsonl") == 0)
+        format = DUMP_JSON_LINES;
+      else if (!binary && strcmp(name, "text") != 0) {
+        print_usage(argv[0]);
+        free_project(project);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--from-tokens") == 0)
+      from_tokens = 1;
+    else if (strcmp(argv[i], "--stats") == 0)
+      stats = 1;
+    else if (strcmp(argv[i], "--quiet") == 0)
+      quiet = 1;
+    else if (strcmp(argv[i], "--ast") == 0)
+      ast = 1;
+    else if (strcmp(argv[i], "--bytecode") == 0)
+      bytecode = 1;
+    else if (strcmp(argv[i], "--run") == 0)
+      run = 1;
+    else if (strcmp(argv[i], "--help") == 0) {
+      print_usage(argv[0]);
+      free_project(project);
+      return EXIT_SUCCESS;
+    } else if (!add_source_path(project, argv[i]))
+      goto error_mem_size;
+    else
+      paths++;
+  }
+  if (from_tokens)
+    default_location = "-";
+  if (paths == 0 && !add_source_path(project, default_location))
+    goto error_mem_size;
+  if (project->cache_directory != NULL &&
+      !create_cache(project->cache_directory)) {
+    fprintf(stderr, "FileError: cache %s could not be used: %s\n",
+            project->cache_directory, strerror(errno));
+    project->cache_directory = NULL;
+  }
 
-  printf("LOGS ⚠ ↴\n");
-  Lexer *lexer = create_lexer(file_location, source);
-  TokensList *tokens = tokenizer(lexer);
+  // Token listings go through the dump, everything else through stdio
+  i8 listing = !quiet && !ast && !bytecode && !run;
+  if (listing && !binary) {
+    if (!token_dump_init(&dump, STDOUT_FILENO, format))
+      goto error_mem_size;
+    fflush(stdout);
+  }
 
-  // free(source), free_lexer(lexer);
-  Token *head = tokens->head;
-  while (head != NULL) {
-    print_token(head);
-    head = head->next;
+  i64 tokens_count = 0, errors = 0;
+  if (from_tokens) {
+    for (i64 i = 0; i < project->length; i++)
+      errors += print_token_streams(project->files[i].file_location,
+                                    dump.buffer ? &dump : NULL, &tokens_count);
+    goto summary;
   }
+
+  if (!lex_project(project, threads))
+    goto error_mem_size;
+
+  for (i64 i = 0; i < project->length; i++) {
+    FileResult *file = &project->files[i];
+    if (file->error != 0) {
+      fprintf(stderr, "FileError: file %s could not be lexed: %s\n",
+              file->file_location, strerror(file->error));
+      errors++;
+      continue;
+    }
+
+    tokens_count += file->tokens->length;
+    if (listing && binary) {
+      if (!write_token_stream(stdout, file->file_location, file->tokens,
+                              file->source->length)) {
+        fprintf(stderr, "FileError: tokens of %s could not be written: %s\n",
+                file->file_location, strerror(errno));
+        errors++;
+      }
+    } else if (listing) {
+      dump_file(&dump, file->file_location);
+      for (i64 j = 0; j < file->tokens->length; j++) {
+        Token token = get_token(file->tokens, j);
+        dump_token(&dump, file->file_location, &token);
+      }
+      // Diagnostics follow the tokens of their file
+      if (file->diagnostics_length > 0)
+        token_dump_flush(&dump);
+    } else if (!quiet)
+      printf("%s ↴\n", file->file_location);
+    for (i64 j = 0; j < file->diagnostics_length; j++)
+      print_diagnostic(&file->diagnostics[j]);
+    errors += file->diagnostics_length;
+
+    if (ast || bytecode || run) {
+      // A tree from the cache was stored without any error
+      Ast *tree = file->ast;
+      Parser *parser = NULL;
+      file->ast = NULL;
+      if (tree == NULL) {
+        parser = create_parser(file->file_location, file->tokens);
+        tree = parser ? parse_program(parser) : NULL;
+        if (tree == NULL) {
+          if (parser != NULL)
+            free_parser(parser);
+          goto error_mem_size;
+        }
+      }
+      if (ast && !quiet && !print_node(file->tokens, tree, tree->root, 0)) {
+        free_ast(tree);
+        if (parser != NULL)
+          free_parser(parser);
+        goto error_mem_size;
+      }
+
+      i64 syntax_errors = 0;
+      if (parser != NULL) {
+        syntax_errors = parser->diagnostics.length;
+        for (i64 j = 0; j < syntax_errors; j++)
+          print_diagnostic(&parser->diagnostics.items[j]);
+        free_parser(parser);
+        if (project->cache_directory != NULL && syntax_errors == 0 &&
+            file->diagnostics_length == 0)
+          cache_store(project->cache_directory, file->hash,
+                      file->source->length, file->tokens, tree);
+      }
+      errors += syntax_errors;
+
+      // Only a tree without syntax errors is compiled
+      if ((bytecode || run) && syntax_errors == 0 &&
+          file->diagnostics_length == 0) {
+        Compiler *compiler =
+            create_compiler(file->file_location, file->tokens, tree);
+        Program *program = compiler ? compile_program(compiler) : NULL;
+        if (program == NULL) {
+          if (compiler != NULL)
+            free_compiler(compiler);
+          free_ast(tree);
+          goto error_mem_size;
+        }
+        for (i64 j = 0; j < compiler->diagnostics.length; j++)
+          print_diagnostic(&compiler->diagnostics.items[j]);
+        errors += compiler->diagnostics.length;
+        if (bytecode && !quiet)
+          print_program(program);
+
+        if (run && compiler->diagnostics.length == 0) {
+          Value result;
+          Object *objects;
+          Diagnostic error;
+          VMStatus status =
+              run_program(program, (const char **)argv + arguments,
+                          argc - arguments, &result, &objects, &error);
+          if (status == VM_OUT_OF_MEMORY) {
+            free_objects(objects);
+            free_program(program);
+            free_compiler(compiler);
+            free_ast(tree);
+            goto error_mem_size;
+          }
+          if (status == VM_RUNTIME_ERROR) {
+            print_diagnostic(&error);
+            errors++;
+          } else if (!quiet && program->main != 0) {
+            printf("main returned ");
+            print_value(program->functions[program->main].type, result);
+            printf("\n");
+          }
+          free_objects(objects);
+        }
+        free_program(program);
+        free_compiler(compiler);
+      }
+      free_ast(tree);
+    }
+  }
+
+summary:
+  if (dump.buffer != NULL) {
+    if (!token_dump_flush(&dump)) {
+      fprintf(stderr, "FileError: tokens could not be written: %s\n",
+              strerror(errno));
+      errors++;
+    }
+    token_dump_free(&dump);
+  }
+  if (quiet)
+    printf("%ld files, %ld tokens, %ld errors\n", project->length,
+           tokens_count, errors);
+  if (stats && !print_lexer_stats(stderr))
+    fprintf(stderr, "--stats: built without lexer stats, rebuild with "
+                    "make clean all STATS=1\n");
+
+  free_project(project);
+  return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+error_mem_size:
+  fprintf(stderr, "MallocError: No memory to allocate\n");
+  return EXIT_FAILURE;
 }
@@ -0,0 +1,381 @@
+#include "ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Create an empty tree. Node 0 is allocated up front as the NO_NODE
+ * placeholder, children that are missing point to it
+ * @param capacity nodes to reserve, grown as needed
+ * @return the tree, NULL if there is no memory left
+ */
+Ast *create_ast(i64 capacity) {
+  Ast *ast = malloc(sizeof(Ast));
+  if (ast == NULL)
+    return NULL;
+
+  if (capacity < 1)
+    capacity = 1;
+  ast->nodes = malloc(sizeof(Node) * capacity);
+  if (ast->nodes == NULL) {
+    free(ast);
+    return NULL;
+  }
+  memset(&ast->nodes[NO_NODE], 0, sizeof(Node));
+  ast->nodes[NO_NODE].kind = NODE_ERROR;
+  ast->length = 1;
+  ast->capacity = capacity;
+  ast->extra = NULL;
+  ast->extra_length = ast->extra_capacity = 0;
+  ast->root = NO_NODE;
+  return ast;
+}
+
+/**
+ * Append a node, every child starts as NO_NODE and every list empty. Nodes
+ * live in one array that may move while it grows: keep NodeIds, not
+ * pointers, across appends
+ * @param ast
+ * @param kind
+ * @param token
+ * @return the node id, NO_NODE if there is no memory left
+ */
+NodeId append_node(Ast *ast, NodeKind kind, i64 token) {
+  if (ast->length == ast->capacity) {
+    // NodeIds are 32 bits
+    if (ast->capacity >= UINT32_MAX / 2)
+      return NO_NODE;
+    i64 capacity = ast->capacity * 2;
+    Node *nodes = realloc(ast->nodes, sizeof(Node) * capacity);
+    if (nodes == NULL)
+      return NO_NODE;
+    ast->nodes = nodes;
+    ast->capacity = capacity;
+  }
+
+  Node *node = &ast->nodes[ast->length];
+  memset(node, 0, sizeof(Node));
+  node->kind = kind;
+  node->token = token;
+  return ast->length++;
+}
+
+/**
+ * Copy the ids of a list to the extra array
+ * @param ast
+ * @param ids
+ * @param length
+ * @param list set to the range of the copy
+ * @return false if there is no memory left
+ */
+i8 append_node_list(Ast *ast, const NodeId *ids, i64 length,
+                    NodeList *list) {
+  if (ast->extra_length + length > ast->extra_capacity) {
+    i64 capacity = ast->extra_capacity ? ast->extra_capacity : 64;
+    while (capacity < ast->extra_length + length)
+      capacity *= 2;
+    if (capacity > UINT32_MAX)
+      return 0;
+    NodeId *extra = realloc(ast->extra, sizeof(NodeId) * capacity);
+    if (extra == NULL)
+      return 0;
+    ast->extra = extra;
+    ast->extra_capacity = capacity;
+  }
+
+  list->start = ast->extra_length;
+  list->length = length;
+  if (length > 0)
+    memcpy(ast->extra + list->start, ids, sizeof(NodeId) * length);
+  ast->extra_length += length;
+  return 1;
+}
+
+/**
+ * Allocate a side array holding one zeroed attribute per node, indexed by
+ * NodeId. The caller frees it, nodes appended afterwards are not covered
+ * @param ast
+ * @param size of one attribute
+ * @return the array, NULL if there is no memory left
+ */
+void *create_node_attributes(const Ast *ast, i64 size) {
+  return calloc(ast->length, size);
+}
+
+/**
+ * Release the tree, two arrays whatever its size
+ * @param ast
+ */
+void free_ast(Ast *ast) {
+  free(ast->nodes), ast->nodes = NULL;
+  free(ast->extra), ast->extra = NULL;
+  free(ast);
+}
+
+const char *node_kind_string(NodeKind kind) {
+  switch (kind) {
+  case NODE_PROGRAM:
+    return "PROGRAM";
+  case NODE_FUNCTION:
+    return "FUNCTION";
+  case NODE_PARAMETER:
+    return "PARAMETER";
+  case NODE_VARIABLE:
+    return "VARIABLE";
+  case NODE_STRUCT:
+    return "STRUCT";
+  case NODE_FIELD:
+    return "FIELD";
+  case NODE_ENUM:
+    return "ENUM";
+  case NODE_IMPORT:
+    return "IMPORT";
+  case NODE_TYPE:
+    return "TYPE";
+  case NODE_ARRAY_TYPE:
+    return "ARRAY_TYPE";
+  case NODE_UNION_TYPE:
+    return "UNION_TYPE";
+  case NODE_BLOCK:
+    return "BLOCK";
+  case NODE_IF:
+    return "IF";
+  case NODE_WHILE:
+    return "WHILE";
+  case NODE_DO_WHILE:
+    return "DO_WHILE";
+  case NODE_FOR:
+    return "FOR";
+  case NODE_RETURN:
+    return "RETURN";
+  case NODE_BREAK:
+    return "BREAK";
+  case NODE_CONTINUE:
+    return "CONTINUE";
+  case NODE_EXPRESSION:
+    return "EXPRESSION";
+  case NODE_ASSIGNMENT:
+    return "ASSIGNMENT";
+  case NODE_TERNARY:
+    return "TERNARY";
+  case NODE_BINARY:
+    return "BINARY";
+  case NODE_UNARY:
+    return "UNARY";
+  case NODE_POSTFIX:
+    return "POSTFIX";
+  case NODE_CALL:
+    return "CALL";
+  case NODE_METHOD_CALL:
+    return "METHOD_CALL";
+  case NODE_INDEX:
+    return "INDEX";
+  case NODE_MEMBER:
+    return "MEMBER";
+  case NODE_IDENTIFIER:
+    return "IDENTIFIER";
+  case NODE_LITERAL:
+    return "LITERAL";
+  case NODE_ARRAY:
+    return "ARRAY";
+  case NODE_ERROR:
+    return "ERROR";
+  default:
+    return "UNKNOW";
+  }
+}
+
+// Nodes left to visit by a walk of the tree
+typedef struct {
+  NodeId id;
+  i64 depth;
+} WalkItem;
+
+typedef struct {
+  WalkItem *items;
+  i64 length;
+  i64 capacity;
+} WalkStack;
+
+static i8 push_walk(WalkStack *stack, NodeId id, i64 depth) {
+  if (id == NO_NODE)
+    return 1;
+  if (stack->length == stack->capacity) {
+    i64 capacity = stack->capacity ? stack->capacity * 2 : 64;
+    WalkItem *items = realloc(stack->items, sizeof(WalkItem) * capacity);
+    if (items == NULL)
+      return 0;
+    stack->items = items;
+    stack->capacity = capacity;
+  }
+  stack->items[stack->length++] = (WalkItem){.id = id, .depth = depth};
+  return 1;
+}
+
+static i8 push_walk_list(WalkStack *stack, const Ast *ast, NodeList list,
+                          i64 depth) {
+  for (i64 i = list.length; i > 0; i--)
+    if (!push_walk(stack, ast->extra[list.start + i - 1], depth))
+      return 0;
+  return 1;
+}
+
+/**
+ * Push the children of a node, the last one first so they pop in order
+ * @param stack
+ * @param ast
+ * @param node
+ * @param depth of the children
+ * @return false if there is no memory left
+ */
+static i8 push_children(WalkStack *stack, const Ast *ast, const Node *node,
+                        i64 depth) {
+  switch (node->kind) {
+  case NODE_PROGRAM:
+  case NODE_BLOCK:
+  case NODE_ARRAY:
+  case NODE_STRUCT:
+  case NODE_ENUM:
+    return push_walk_list(stack, ast, node->list, depth);
+  case NODE_IMPORT:
+    return push_walk_list(stack, ast, node->import.names, depth) &&
+           push_walk_list(stack, ast, node->import.path, depth);
+  case NODE_FUNCTION:
+    return push_walk(stack, node->function.body, depth) &&
+           push_walk(stack, node->function.type, depth) &&
+           push_walk_list(stack, ast, node->function.parameters, depth);
+  case NODE_PARAMETER:
+  case NODE_FIELD:
+  case NODE_VARIABLE:
+    return push_walk(stack, node->variable.value, depth) &&
+           push_walk(stack, node->variable.type, depth);
+  case NODE_ARRAY_TYPE:
+    return push_walk(stack, node->type.size, depth) &&
+           push_walk(stack, node->type.element, depth);
+  case NODE_IF:
+  case NODE_WHILE:
+  case NODE_DO_WHILE:
+  case NODE_TERNARY:
+    return push_walk(stack, node->branch.otherwise, depth) &&
+           push_walk(stack, node->branch.then, depth) &&
+           push_walk(stack, node->branch.condition, depth);
+  case NODE_FOR:
+    return push_walk(stack, node->loop.body, depth) &&
+           push_walk(stack, node->loop.step, depth) &&
+           push_walk(stack, node->loop.condition, depth) &&
+           push_walk(stack, node->loop.init, depth);
+  case NODE_CALL:
+  case NODE_METHOD_CALL:
+    return push_walk_list(stack, ast, node->call.arguments, depth) &&
+           push_walk(stack, node->call.callee, depth);
+  case NODE_UNION_TYPE:
+  case NODE_ASSIGNMENT:
+  case NODE_BINARY:
+  case NODE_INDEX:
+    return push_walk(stack, node->binary.right, depth) &&
+           push_walk(stack, node->binary.left, depth);
+  case NODE_RETURN:
+  case NODE_EXPRESSION:
+  case NODE_UNARY:
+  case NODE_POSTFIX:
+  case NODE_MEMBER:
+    return push_walk(stack, node->unary.operand, depth);
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Print a node and its children, one node per line indented by depth. The
+ * walk keeps its own stack, long operator chains nest deeper than the call
+ * stack would allow
+ * @param tokens the node tokens
+ * @param ast
+ * @param id may be NO_NODE, then nothing is printed
+ * @param depth
+ * @return false if there is no memory left
+ */
+i8 print_node(const TokenBuffer *tokens, const Ast *ast, NodeId id,
+              i64 depth) {
+  WalkStack stack = {.items = NULL, .length = 0, .capacity = 0};
+  i8 ok = push_walk(&stack, id, depth);
+
+  while (ok && stack.length > 0) {
+    WalkItem item = stack.items[--stack.length];
+    const Node *node = &ast->nodes[item.id];
+    Token token = get_token(tokens, node->token);
+    printf("%*s%s", (int)(item.depth * 2), "", node_kind_string(node->kind));
+    if (node->kind != NODE_PROGRAM && node->kind != NODE_BLOCK)
+      printf(" %.*s", (int)token.length, token.value);
+    printf("  [ Line: %ld, Column: %ld ]\n", token.pos.line, token.pos.column);
+    ok = push_children(&stack, ast, node, item.depth + 1);
+  }
+
+  free(stack.items);
+  return ok;
+}
+
+static i8 list_in_tree(const Ast *ast, NodeList list) {
+  return (i64)list.start + list.length <= ast->extra_length;
+}
+
+/**
+ * Check that the lists of a node are within the extra array
+ * @param ast
+ * @param node
+ * @return true if they are
+ */
+static i8 node_lists_in_tree(const Ast *ast, const Node *node) {
+  switch (node->kind) {
+  case NODE_PROGRAM:
+  case NODE_BLOCK:
+  case NODE_ARRAY:
+  case NODE_STRUCT:
+  case NODE_ENUM:
+    return list_in_tree(ast, node->list);
+  case NODE_IMPORT:
+    return list_in_tree(ast, node->import.path) &&
+           list_in_tree(ast, node->import.names);
+  case NODE_FUNCTION:
+    return list_in_tree(ast, node->function.parameters);
+  case NODE_CALL:
+  case NODE_METHOD_CALL:
+    return list_in_tree(ast, node->call.arguments);
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Check a tree that wasn't built by the parser, such as one read back from
+ * a cache entry. Every node reached from the root must have a known kind, a
+ * token and children in range, and be reached only once so walks of the
+ * tree end
+ * @param ast
+ * @param tokens_length tokens the nodes refer to
+ * @return true if the tree can be used without further checks, false if it
+ * is invalid or if there is no memory left
+ */
+i8 valid_ast(const Ast *ast, i64 tokens_length) {
+  if (ast->root >= ast->length)
+    return 0;
+  i8 *reached = calloc(ast->length, sizeof(i8));
+  WalkStack stack = {.items = NULL, .length = 0, .capacity = 0};
+  i8 ok = reached != NULL && push_walk(&stack, ast->root, 0);
+
+  while (ok && stack.length > 0) {
+    NodeId id = stack.items[--stack.length].id;
+    if (id >= ast->length || reached[id]) {
+      ok = 0;
+      break;
+    }
+    reached[id] = 1;
+    const Node *node = &ast->nodes[id];
+    ok = node->kind <= NODE_ERROR && node->token < tokens_length &&
+         node_lists_in_tree(ast, node) && push_children(&stack, ast, node, 0);
+  }
+
+  free(stack.items);
+  free(reached);
+  return ok;
+}
@@ -1,8 +1,148 @@
 #ifndef AST_H
 #define AST_H
 
+#include "../helper.h"
+#include "../lexer/token.h"
+
+typedef enum {
+  // DECLARATION
+  NODE_PROGRAM,        // list
+  NODE_FUNCTION,       // name(parameters): type => body
+  NODE_PARAMETER,      // name: type
+  NODE_VARIABLE,       // name: type = value, name := value
+  NODE_STRUCT,         // struct name { list }
+  NODE_FIELD,          // name: type;
+  NODE_ENUM,           // enum name { list }
+  NODE_IMPORT,         // import path; from path import names;
+
+  // TYPE
+  NODE_TYPE,           // int, string, name
+  NODE_ARRAY_TYPE,     // element[size], element[..]
+  NODE_UNION_TYPE,     // left | right
+
+  // STATEMENT
+  NODE_BLOCK,          // { list }
+  NODE_IF,             // if (condition) then else otherwise
+  NODE_WHILE,          // while (condition) then
+  NODE_DO_WHILE,       // do then while (condition);
+  NODE_FOR,            // for (init; condition; step) body
+  NODE_RETURN,         // return operand;
+  NODE_BREAK,          // break;
+  NODE_CONTINUE,       // continue;
+  NODE_EXPRESSION,     // operand;
+
+  // EXPRESSION
+  NODE_ASSIGNMENT,     // left = right, left += right...
+  NODE_TERNARY,        // condition ? then : otherwise
+  NODE_BINARY,         // left + right...
+  NODE_UNARY,          // -operand, ++operand...
+  NODE_POSTFIX,        // operand++, operand--
+  NODE_CALL,           // callee(arguments)
+  NODE_METHOD_CALL,    // callee::name(arguments)
+  NODE_INDEX,          // left[right]
+  NODE_MEMBER,         // operand.name
+  NODE_IDENTIFIER,
+  NODE_LITERAL,
+  NODE_ARRAY,          // [list]
+
+  NODE_ERROR,          // Invalid syntax, see the parser diagnostics
+} NodeKind;
+
+// Index of a node in its Ast. Node 0 is never part of a tree, it stands for
+// a missing child
+typedef i32 NodeId;
+#define NO_NODE 0
+
+// Children of a node: length ids starting at start in the Ast extra array
+typedef struct {
+  i32 start;
+  i32 length;
+} NodeList;
+
+// Fixed-size node, 24 bytes. token is the index of the token that names the
+// node: the identifier of a declaration, the operator of an expression, the
+// keyword of a statement
+typedef struct {
+  i8 kind;
+  i32 token;
+  union {
+    NodeList list;
+    struct {
+      NodeList parameters;
+      NodeId type;
+      NodeId body;
+    } function;
+    struct {
+      NodeId type;
+      NodeId value;
+    } variable;
+    struct {
+      NodeId element;
+      NodeId size;
+    } type;
+    struct {
+      NodeId condition;
+      NodeId then;
+      NodeId otherwise;
+    } branch;
+    struct {
+      NodeId init;
+      NodeId condition;
+      NodeId step;
+      NodeId body;
+    } loop;
+    struct {
+      NodeList arguments;
+      NodeId callee;
+    } call;
+    struct {
+      // Identifiers of the dotted module name
+      NodeList path;
+      // Identifiers after from ... import, empty for import
+      NodeList names;
+    } import;
+    struct {
+      NodeId left;
+      NodeId right;
+    } binary;
+    struct {
+      NodeId operand;
+    } unary;
+  };
+} Node;
+
+// Every node of a compilation unit in two flat arrays, children are 32-bit
+// indices so the tree holds no pointer. Later passes attach attributes to
+// nodes through side arrays indexed by NodeId, see create_node_attributes
 typedef struct {
-  char kind;
-} Program;
+  Node *nodes;
+  i64 length;
+  i64 capacity;
+
+  // Ids of the NodeList children
+  NodeId *extra;
+  i64 extra_length;
+  i64 extra_capacity;
+
+  NodeId root;
+} Ast;
+
+Ast *create_ast(i64 capacity);
+
+NodeId append_node(Ast *ast, NodeKind kind, i64 token);
+
+i8 append_node_list(Ast *ast, const NodeId *ids, i64 length,
+                    NodeList *list);
+
+void *create_node_attributes(const Ast *ast, i64 size);
+
+void free_ast(Ast *ast);
+
+const char *node_kind_string(NodeKind kind);
+
+i8 print_node(const TokenBuffer *tokens, const Ast *ast, NodeId id,
+              i64 depth);
+
+i8 valid_ast(const Ast *ast, i64 tokens_length);
 
 #endif
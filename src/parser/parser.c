@@ -0,0 +1,1040 @@
+#include "parser.h"
+#include <stdlib.h>
+
+// Binding power of the operators, from the loosest to the tightest
+typedef enum {
+  PREC_NONE,
+  PREC_ASSIGNMENT,   // = += -= *= /= %=
+  PREC_TERNARY,      // ? :
+  PREC_OR,           // ||
+  PREC_AND,          // &&
+  PREC_BITWISE_OR,   // $
+  PREC_BITWISE_XOR,  // ^
+  PREC_BITWISE_AND,  // &
+  PREC_EQUALITY,     // == !=
+  PREC_COMPARISON,   // < > <= >=
+  PREC_SHIFT,        // << >>
+  PREC_TERM,         // + -
+  PREC_FACTOR,       // * / %
+  PREC_UNARY,        // - + ! ~ ++ -- typeof sizeof
+  PREC_POWER,        // **
+  PREC_POSTFIX,      // () [] . :: ++ --
+} Precedence;
+
+static NodeId parse_expression(Parser *parser, Precedence min);
+static NodeId parse_statement(Parser *parser);
+static NodeId parse_block(Parser *parser);
+
+/**
+ * Skip the TK_ERROR tokens at index, the lexer reported them already
+ * @param parser
+ * @param index
+ * @return index of the first token that isn't an error, TK_EOF at the latest
+ */
+static i64 skip_errors(Parser *parser, i64 index) {
+  while (parser->tokens->types[index] == TK_ERROR)
+    index++;
+  return index;
+}
+
+static TokenType current_type(Parser *parser) {
+  return parser->tokens->types[parser->index];
+}
+
+/**
+ * Find an upcoming token without consuming anything
+ * @param parser
+ * @param n distance from the current token
+ * @return its index, the one of TK_EOF if the stream ends before
+ */
+static i64 peek_index(Parser *parser, i64 n) {
+  i64 index = parser->index;
+  while (n-- > 0 && parser->tokens->types[index] != TK_EOF)
+    index = skip_errors(parser, index + 1);
+  return index;
+}
+
+static TokenType peek_type(Parser *parser, i64 n) {
+  return parser->tokens->types[peek_index(parser, n)];
+}
+
+static void advance(Parser *parser) {
+  if (current_type(parser) != TK_EOF)
+    parser->index = skip_errors(parser, parser->index + 1);
+}
+
+static i8 check(Parser *parser, TokenType type) {
+  return current_type(parser) == type;
+}
+
+static i8 match(Parser *parser, TokenType type) {
+  if (!check(parser, type))
+    return 0;
+  advance(parser);
+  return 1;
+}
+
+/**
+ * The lexer reads "::" as two ":" tokens, they form a method call
+ * separator when nothing stands between them
+ * @param parser
+ * @param index of the first ":"
+ * @return true if the tokens at index are "::"
+ */
+static i8 is_method_separator(Parser *parser, i64 index) {
+  const TokenBuffer *tokens = parser->tokens;
+  return tokens->types[index] == TYPE_DECLARATION &&
+         tokens->types[index + 1] == TYPE_DECLARATION &&
+         tokens->offsets[index] + 1 == tokens->offsets[index + 1];
+}
+
+/**
+ * Record a syntax error at a token. Only the first error of a statement is
+ * reported, the following ones are usually caused by it
+ * @param parser
+ * @param token index of the token where the error is
+ * @param details
+ */
+static void report_syntax_error(Parser *parser, i64 token,
+                                const char *details) {
+  if (parser->panic)
+    return;
+  parser->panic = 1;
+
+  Diagnostic diagnostic = {.kind = SYNTAX_ERROR, .details = details};
+  diagnostic.pos.file_location = parser->file_location;
+  diagnostic.pos.index = parser->tokens->offsets[token];
+  line_table_lookup(&parser->tokens->lines, diagnostic.pos.index,
+                    &diagnostic.pos.line, &diagnostic.pos.column);
+  if (!append_diagnostic(&parser->diagnostics, diagnostic))
+    parser->out_of_memory = 1;
+}
+
+/**
+ * Consume a token of the expected type or report an error
+ * @param parser
+ * @param type
+ * @param details error message when the token is missing
+ * @return true if the token was there
+ */
+static i8 expect(Parser *parser, TokenType type, const char *details) {
+  if (match(parser, type))
+    return 1;
+  report_syntax_error(parser, parser->index, details);
+  return 0;
+}
+
+/**
+ * Skip the rest of a statement after a syntax error, up to its ";" or to the
+ * "}" of the enclosing block
+ * @param parser
+ */
+static void synchronize(Parser *parser) {
+  parser->panic = 0;
+
+  // The statement may have ended on its ";" already
+  i64 previous = parser->index;
+  while (previous > 0 && parser->tokens->types[previous - 1] == TK_ERROR)
+    previous--;
+  if (previous > 0 && parser->tokens->types[previous - 1] == SEMICOLON)
+    return;
+
+  while (!check(parser, TK_EOF) && !check(parser, RCBRACKETS))
+    if (match(parser, SEMICOLON))
+      return;
+    else
+      advance(parser);
+}
+
+/**
+ * Append a node to the tree, every child starts as NO_NODE
+ * @param parser
+ * @param kind
+ * @param token
+ * @return the node id, NO_NODE if there is no memory left
+ */
+static NodeId create_node(Parser *parser, NodeKind kind, i64 token) {
+  NodeId id = append_node(parser->ast, kind, token);
+  if (id == NO_NODE)
+    parser->out_of_memory = 1;
+  return id;
+}
+
+/**
+ * The nodes move when the tree grows, so a node is only looked up to store
+ * a child once that child is parsed. Out of memory, id is NO_NODE and the
+ * store lands in the placeholder node
+ * @param parser
+ * @param id
+ * @return the node
+ */
+static Node *node_at(Parser *parser, NodeId id) {
+  return &parser->ast->nodes[id];
+}
+
+static NodeId create_error_node(Parser *parser, const char *details) {
+  report_syntax_error(parser, parser->index, details);
+  return create_node(parser, NODE_ERROR, parser->index);
+}
+
+/**
+ * Push a list item on the parser stack
+ * @param parser
+ * @param node
+ */
+static void push_node(Parser *parser, NodeId node) {
+  if (parser->stack_length == parser->stack_capacity) {
+    i64 capacity = parser->stack_capacity ? parser->stack_capacity * 2 : 64;
+    NodeId *grown = realloc(parser->stack, sizeof(NodeId) * capacity);
+    if (grown == NULL) {
+      parser->out_of_memory = 1;
+      return;
+    }
+    parser->stack = grown;
+    parser->stack_capacity = capacity;
+  }
+  parser->stack[parser->stack_length++] = node;
+}
+
+/**
+ * Move the items pushed since base into the tree
+ * @param parser
+ * @param base stack length when the list started
+ * @return the list, empty if there is no memory left
+ */
+static NodeList pop_list(Parser *parser, i64 base) {
+  NodeList list = {.start = 0, .length = 0};
+  if (!append_node_list(parser->ast, parser->stack + base,
+                        parser->stack_length - base, &list))
+    parser->out_of_memory = 1;
+  parser->stack_length = base;
+  return list;
+}
+
+/**
+ * Parse expressions separated by "," up to the closing token
+ * @param parser
+ * @param closing
+ * @param details error message when the closing token is missing
+ * @return the expressions
+ */
+static NodeList parse_arguments(Parser *parser, TokenType closing,
+                                const char *details) {
+  i64 base = parser->stack_length;
+  if (!check(parser, closing)) {
+    do
+      push_node(parser, parse_expression(parser, PREC_ASSIGNMENT));
+    while (match(parser, COMMA));
+  }
+  expect(parser, closing, details);
+  return pop_list(parser, base);
+}
+
+static i8 is_type_start(TokenType type) {
+  switch (type) {
+  case LONG:
+  case INT:
+  case I8:
+  case I16:
+  case I32:
+  case I64:
+  case FLOAT:
+  case F8:
+  case F16:
+  case F32:
+  case F64:
+  case DOUBLE:
+  case STRING:
+  case CHAR:
+  case VOID:
+  case BOOLEAN:
+  case IDENTIFIER:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Parse a type without unions: a base type followed by array suffixes
+ * @param parser
+ * @return the type node
+ */
+static NodeId parse_type_term(Parser *parser) {
+  if (!is_type_start(current_type(parser)))
+    return create_error_node(parser, "Expected a type");
+
+  NodeId node = create_node(parser, NODE_TYPE, parser->index);
+  advance(parser);
+  while (node != NO_NODE && check(parser, LBRACKETS)) {
+    NodeId array = create_node(parser, NODE_ARRAY_TYPE, parser->index);
+    advance(parser);
+    if (array == NO_NODE)
+      return NO_NODE;
+
+    node_at(parser, array)->type.element = node;
+    if (check(parser, RBRACKETS))
+      report_syntax_error(parser, parser->index,
+                          "Expected an array size or \"..\"");
+    else if (!match(parser, SPREAD)) {
+      NodeId size = parse_expression(parser, PREC_ASSIGNMENT);
+      node_at(parser, array)->type.size = size;
+    }
+    expect(parser, RBRACKETS, "Expected \"]\" after the array size");
+    node = array;
+  }
+  return node;
+}
+
+/**
+ * Parse a type, unions of types included
+ * @param parser
+ * @return the type node
+ */
+static NodeId parse_type(Parser *parser) {
+  NodeId node = parse_type_term(parser);
+  while (node != NO_NODE && check(parser, OR_TYPE)) {
+    NodeId type = create_node(parser, NODE_UNION_TYPE, parser->index);
+    advance(parser);
+    if (type == NO_NODE)
+      return NO_NODE;
+    node_at(parser, type)->binary.left = node;
+    NodeId right = parse_type_term(parser);
+    node_at(parser, type)->binary.right = right;
+    node = type;
+  }
+  return node;
+}
+
+static NodeId parse_prefix(Parser *parser) {
+  i64 token = parser->index;
+  NodeId node;
+  NodeList list;
+  NodeId operand;
+
+  switch (current_type(parser)) {
+  case IDENTIFIER:
+    advance(parser);
+    return create_node(parser, NODE_IDENTIFIER, token);
+
+  case INT_LITERAL:
+  case FLOAT_LITERAL:
+  case STRING_LITERAL:
+  case CHAR_LITERAL:
+  case BINARY_LITERAL:
+  case OCT_LITERAL:
+  case HEX_LITERAL:
+  case TRUE:
+  case FALSE:
+  case TK_NULL:
+    advance(parser);
+    return create_node(parser, NODE_LITERAL, token);
+
+  case LPARENTESES:
+    advance(parser);
+    node = parse_expression(parser, PREC_ASSIGNMENT);
+    expect(parser, RPARENTESES, "Expected \")\" after the expression");
+    return node;
+
+  case LBRACKETS:
+    advance(parser);
+    node = create_node(parser, NODE_ARRAY, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    list = parse_arguments(parser, RBRACKETS,
+                           "Expected \"]\" at the end of the array");
+    node_at(parser, node)->list = list;
+    return node;
+
+  case MINUS:
+  case PLUS:
+  case NOT:
+  case BITWISE_NOT:
+  case INCREMENT:
+  case DECREMENT:
+  case TYPEOF:
+  case SIZEOF:
+    advance(parser);
+    node = create_node(parser, NODE_UNARY, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    operand = parse_expression(parser, PREC_UNARY);
+    node_at(parser, node)->unary.operand = operand;
+    return node;
+
+  default:
+    return create_error_node(parser, "Expected an expression");
+  }
+}
+
+static Precedence infix_precedence(Parser *parser) {
+  switch (current_type(parser)) {
+  case ASSIGNMENT_OPERATOR:
+  case ASSIGNMENT_PLUS:
+  case ASSIGNMENT_MINUS:
+  case ASSIGNMENT_MULTIPLY:
+  case ASSIGNMENT_DIVIDE:
+  case ASSIGNMENT_MODULE:
+    return PREC_ASSIGNMENT;
+  case TERNARY_OPERATOR:
+    return PREC_TERNARY;
+  case OR:
+    return PREC_OR;
+  case AND:
+    return PREC_AND;
+  case BITWISE_OR:
+    return PREC_BITWISE_OR;
+  case BITWISE_XOR:
+    return PREC_BITWISE_XOR;
+  case BITWISE_AND:
+    return PREC_BITWISE_AND;
+  case EQUAL:
+  case NOT_EQUAL:
+    return PREC_EQUALITY;
+  case LESS_THEN:
+  case GREATER_THEN:
+  case LESS_EQUAL:
+  case GREATER_EQUAL:
+    return PREC_COMPARISON;
+  case LEFT_SHIFT:
+  case RIGHT_SHIFT:
+    return PREC_SHIFT;
+  case PLUS:
+  case MINUS:
+    return PREC_TERM;
+  case MULTIPLY:
+  case DIVIDE:
+  case MODULE:
+    return PREC_FACTOR;
+  case POWER:
+    return PREC_POWER;
+  case LPARENTESES:
+  case LBRACKETS:
+  case DOT:
+  case INCREMENT:
+  case DECREMENT:
+    return PREC_POSTFIX;
+  case TYPE_DECLARATION:
+    return is_method_separator(parser, parser->index) ? PREC_POSTFIX
+                                                      : PREC_NONE;
+  default:
+    return PREC_NONE;
+  }
+}
+
+static i8 is_assignable(Parser *parser, NodeId id) {
+  NodeKind kind = node_at(parser, id)->kind;
+  return id == NO_NODE || kind == NODE_IDENTIFIER || kind == NODE_INDEX ||
+         kind == NODE_MEMBER || kind == NODE_ERROR;
+}
+
+/**
+ * Parse a call, an index, a member access, a method call or a postfix
+ * increment applied to left
+ * @param parser
+ * @param left
+ * @return the postfix node
+ */
+static NodeId parse_postfix(Parser *parser, NodeId left) {
+  i64 token = parser->index;
+  TokenType type = current_type(parser);
+  NodeId node;
+  NodeList arguments;
+  NodeId right;
+
+  advance(parser);
+  switch (type) {
+  case LPARENTESES:
+    node = create_node(parser, NODE_CALL, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->call.callee = left;
+    arguments = parse_arguments(parser, RPARENTESES,
+                                "Expected \")\" after the call arguments");
+    node_at(parser, node)->call.arguments = arguments;
+    return node;
+
+  case LBRACKETS:
+    node = create_node(parser, NODE_INDEX, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->binary.left = left;
+    right = parse_expression(parser, PREC_ASSIGNMENT);
+    node_at(parser, node)->binary.right = right;
+    expect(parser, RBRACKETS, "Expected \"]\" after the index");
+    return node;
+
+  case DOT:
+    node = create_node(parser, NODE_MEMBER, parser->index);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->unary.operand = left;
+    expect(parser, IDENTIFIER, "Expected a member name after \".\"");
+    return node;
+
+  case INCREMENT:
+  case DECREMENT:
+    node = create_node(parser, NODE_POSTFIX, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->unary.operand = left;
+    return node;
+
+  default:
+    // Second ":" of "::"
+    advance(parser);
+    node = create_node(parser, NODE_METHOD_CALL, parser->index);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->call.callee = left;
+    if (expect(parser, IDENTIFIER, "Expected a method name after \"::\"") &&
+        expect(parser, LPARENTESES, "Expected \"(\" after the method name")) {
+      arguments = parse_arguments(parser, RPARENTESES,
+                                  "Expected \")\" after the call arguments");
+      node_at(parser, node)->call.arguments = arguments;
+    }
+    return node;
+  }
+}
+
+/**
+ * Parse an infix operator and its right operand
+ * @param parser
+ * @param left
+ * @param precedence of the operator
+ * @return the operator node
+ */
+static NodeId parse_infix(Parser *parser, NodeId left,
+                          Precedence precedence) {
+  if (precedence == PREC_POSTFIX)
+    return parse_postfix(parser, left);
+
+  i64 token = parser->index;
+  advance(parser);
+  switch (precedence) {
+  case PREC_ASSIGNMENT: {
+    if (!is_assignable(parser, left))
+      report_syntax_error(parser, token, "Invalid assignment target");
+    NodeId node = create_node(parser, NODE_ASSIGNMENT, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->binary.left = left;
+    NodeId right = parse_expression(parser, PREC_ASSIGNMENT);
+    node_at(parser, node)->binary.right = right;
+    return node;
+  }
+
+  case PREC_TERNARY: {
+    NodeId node = create_node(parser, NODE_TERNARY, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->branch.condition = left;
+    NodeId then = parse_expression(parser, PREC_ASSIGNMENT);
+    node_at(parser, node)->branch.then = then;
+    expect(parser, TYPE_DECLARATION,
+           "Expected \":\" in the ternary expression");
+    NodeId otherwise = parse_expression(parser, PREC_TERNARY);
+    node_at(parser, node)->branch.otherwise = otherwise;
+    return node;
+  }
+
+  default: {
+    NodeId node = create_node(parser, NODE_BINARY, token);
+    if (node == NO_NODE)
+      return NO_NODE;
+    node_at(parser, node)->binary.left = left;
+    // "**" is right associative, every other binary operator is left one
+    NodeId right = parse_expression(
+        parser, precedence == PREC_POWER ? PREC_POWER : precedence + 1);
+    node_at(parser, node)->binary.right = right;
+    return node;
+  }
+  }
+}
+
+/**
+ * Pratt parser: a prefix expression, then every infix operator binding at
+ * least as tight as min. Chains of left associative operators are parsed in
+ * a loop, only right operands recurse
+ * @param parser
+ * @param min loosest operator precedence to take
+ * @return the expression node
+ */
+static NodeId parse_expression(Parser *parser, Precedence min) {
+  if (parser->depth >= PARSER_MAX_DEPTH)
+    return create_error_node(parser, "Expression is nested too deeply");
+  parser->depth++;
+
+  NodeId left = parse_prefix(parser);
+  Precedence precedence;
+  while ((precedence = infix_precedence(parser)) != PREC_NONE &&
+         precedence >= min && !parser->out_of_memory)
+    left = parse_infix(parser, left, precedence);
+
+  parser->depth--;
+  return left;
+}
+
+/**
+ * A function declaration starts like a call, only the parameters that have a
+ * type, or the ":" or "=>" after an empty parameter list, tell them apart
+ * @param parser
+ * @return true if a function declaration starts at the current token
+ */
+static i8 is_function(Parser *parser) {
+  if (!check(parser, IDENTIFIER) || peek_type(parser, 1) != LPARENTESES)
+    return 0;
+  if (peek_type(parser, 2) == RPARENTESES)
+    return peek_type(parser, 3) == TYPE_DECLARATION ||
+           peek_type(parser, 3) == RETURN_OPERATOR;
+  return peek_type(parser, 2) == IDENTIFIER &&
+         peek_type(parser, 3) == TYPE_DECLARATION &&
+         !is_method_separator(parser, peek_index(parser, 3));
+}
+
+/**
+ * name(parameter: type, ...): type => body
+ * @param parser
+ * @return the function node
+ */
+static NodeId parse_function(Parser *parser) {
+  NodeId node = create_node(parser, NODE_FUNCTION, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  advance(parser), advance(parser);
+
+  i64 base = parser->stack_length;
+  if (!check(parser, RPARENTESES)) {
+    do {
+      NodeId parameter = create_node(parser, NODE_PARAMETER, parser->index);
+      push_node(parser, parameter);
+      if (parameter == NO_NODE)
+        break;
+      if (expect(parser, IDENTIFIER, "Expected a parameter name") &&
+          expect(parser, TYPE_DECLARATION,
+                 "Expected \":\" and the parameter type")) {
+        NodeId type = parse_type(parser);
+        node_at(parser, parameter)->variable.type = type;
+      }
+    } while (match(parser, COMMA));
+  }
+  expect(parser, RPARENTESES, "Expected \")\" after the parameters");
+  NodeList parameters = pop_list(parser, base);
+  node_at(parser, node)->function.parameters = parameters;
+
+  if (match(parser, TYPE_DECLARATION)) {
+    NodeId type = parse_type(parser);
+    node_at(parser, node)->function.type = type;
+  }
+  if (!expect(parser, RETURN_OPERATOR,
+              "Expected \"=>\" before the function body"))
+    return node;
+  NodeId body;
+  if (check(parser, LCBRACKETS))
+    body = parse_block(parser);
+  else {
+    body = parse_expression(parser, PREC_ASSIGNMENT);
+    expect(parser, SEMICOLON, "Expected \";\" after the function body");
+  }
+  node_at(parser, node)->function.body = body;
+  return node;
+}
+
+/**
+ * A variable declaration or an expression, without the ";" that ends it
+ * @param parser
+ * @return the statement node
+ */
+static NodeId parse_simple_statement(Parser *parser) {
+  i64 token = parser->index;
+  NodeId node;
+  NodeId child;
+
+  if (check(parser, IDENTIFIER) &&
+      peek_type(parser, 1) == TYPE_DECLARATION &&
+      !is_method_separator(parser, peek_index(parser, 1))) {
+    // name: type = value
+    node = create_node(parser, NODE_VARIABLE, token);
+    advance(parser), advance(parser);
+    if (node == NO_NODE)
+      return NO_NODE;
+    child = parse_type(parser);
+    node_at(parser, node)->variable.type = child;
+    if (match(parser, ASSIGNMENT_OPERATOR)) {
+      child = parse_expression(parser, PREC_ASSIGNMENT);
+      node_at(parser, node)->variable.value = child;
+    }
+    return node;
+  }
+
+  if (check(parser, IDENTIFIER) &&
+      peek_type(parser, 1) == ASSIGNMENT_MUTABLE) {
+    // name := value
+    node = create_node(parser, NODE_VARIABLE, token);
+    advance(parser), advance(parser);
+    if (node == NO_NODE)
+      return NO_NODE;
+    child = parse_expression(parser, PREC_ASSIGNMENT);
+    node_at(parser, node)->variable.value = child;
+    return node;
+  }
+
+  node = create_node(parser, NODE_EXPRESSION, token);
+  if (node == NO_NODE)
+    return NO_NODE;
+  child = parse_expression(parser, PREC_ASSIGNMENT);
+  node_at(parser, node)->unary.operand = child;
+  return node;
+}
+
+/**
+ * Parse identifiers separated by a token
+ * @param parser
+ * @param separator
+ * @param details error message when an identifier is missing
+ * @return the identifiers
+ */
+static NodeList parse_names(Parser *parser, TokenType separator,
+                            const char *details) {
+  i64 base = parser->stack_length;
+  do {
+    if (!check(parser, IDENTIFIER)) {
+      report_syntax_error(parser, parser->index, details);
+      break;
+    }
+    push_node(parser, create_node(parser, NODE_IDENTIFIER, parser->index));
+    advance(parser);
+  } while (match(parser, separator));
+  return pop_list(parser, base);
+}
+
+/**
+ * import module.name; or from module.name import name, ...;
+ * @param parser
+ * @return the import node
+ */
+static NodeId parse_import(Parser *parser) {
+  NodeId node = create_node(parser, NODE_IMPORT, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  i8 from = check(parser, FROM);
+  advance(parser);
+
+  NodeList list = parse_names(parser, DOT, "Expected a module name");
+  node_at(parser, node)->import.path = list;
+  if (from && expect(parser, IMPORT, "Expected \"import\" after the module")) {
+    list = parse_names(parser, COMMA, "Expected a name to import");
+    node_at(parser, node)->import.names = list;
+  }
+  expect(parser, SEMICOLON, "Expected \";\" after the import");
+  return node;
+}
+
+/**
+ * struct name { field: type; ... }
+ * @param parser
+ * @return the struct node
+ */
+static NodeId parse_struct(Parser *parser) {
+  advance(parser);
+  NodeId node = create_node(parser, NODE_STRUCT, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  if (!expect(parser, IDENTIFIER, "Expected a struct name") ||
+      !expect(parser, LCBRACKETS, "Expected \"{\" before the fields"))
+    return node;
+
+  i64 base = parser->stack_length;
+  while (!check(parser, RCBRACKETS) && !check(parser, TK_EOF) &&
+         !parser->panic) {
+    NodeId field = create_node(parser, NODE_FIELD, parser->index);
+    push_node(parser, field);
+    if (field == NO_NODE)
+      break;
+    if (expect(parser, IDENTIFIER, "Expected a field name") &&
+        expect(parser, TYPE_DECLARATION,
+               "Expected \":\" and the field type")) {
+      NodeId type = parse_type(parser);
+      node_at(parser, field)->variable.type = type;
+    }
+    expect(parser, SEMICOLON, "Expected \";\" after the field");
+  }
+  NodeList fields = pop_list(parser, base);
+  node_at(parser, node)->list = fields;
+  expect(parser, RCBRACKETS, "Expected \"}\" after the fields");
+  return node;
+}
+
+/**
+ * enum name { member, ... }
+ * @param parser
+ * @return the enum node
+ */
+static NodeId parse_enum(Parser *parser) {
+  advance(parser);
+  NodeId node = create_node(parser, NODE_ENUM, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  if (!expect(parser, IDENTIFIER, "Expected an enum name") ||
+      !expect(parser, LCBRACKETS, "Expected \"{\" before the members"))
+    return node;
+
+  if (!check(parser, RCBRACKETS)) {
+    NodeList members = parse_names(parser, COMMA, "Expected a member name");
+    node_at(parser, node)->list = members;
+  }
+  expect(parser, RCBRACKETS, "Expected \"}\" after the members");
+  return node;
+}
+
+/**
+ * { statement ... }
+ * @param parser
+ * @return the block node
+ */
+static NodeId parse_block(Parser *parser) {
+  NodeId node = create_node(parser, NODE_BLOCK, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  advance(parser);
+
+  i64 base = parser->stack_length;
+  while (!check(parser, RCBRACKETS) && !check(parser, TK_EOF) &&
+         !parser->out_of_memory) {
+    i64 start = parser->index;
+    push_node(parser, parse_statement(parser));
+    if (parser->index == start)
+      advance(parser);
+  }
+  expect(parser, RCBRACKETS, "Expected \"}\" at the end of the block");
+  NodeList list = pop_list(parser, base);
+  node_at(parser, node)->list = list;
+  return node;
+}
+
+/**
+ * "(" expression ")" after if and while
+ * @param parser
+ * @return the condition node
+ */
+static NodeId parse_condition(Parser *parser) {
+  expect(parser, LPARENTESES, "Expected \"(\" before the condition");
+  NodeId condition = parse_expression(parser, PREC_ASSIGNMENT);
+  expect(parser, RPARENTESES, "Expected \")\" after the condition");
+  return condition;
+}
+
+/**
+ * Parse a statement that starts with a keyword
+ * @param parser
+ * @param kind node kind of the keyword
+ * @return the statement node
+ */
+static NodeId parse_keyword_statement(Parser *parser, NodeKind kind) {
+  NodeId node = create_node(parser, kind, parser->index);
+  if (node == NO_NODE)
+    return NO_NODE;
+  advance(parser);
+
+  NodeId child;
+  switch (kind) {
+  case NODE_IF:
+    child = parse_condition(parser);
+    node_at(parser, node)->branch.condition = child;
+    child = parse_statement(parser);
+    node_at(parser, node)->branch.then = child;
+    if (match(parser, ELSE)) {
+      child = parse_statement(parser);
+      node_at(parser, node)->branch.otherwise = child;
+    }
+    break;
+
+  case NODE_WHILE:
+    child = parse_condition(parser);
+    node_at(parser, node)->branch.condition = child;
+    child = parse_statement(parser);
+    node_at(parser, node)->branch.then = child;
+    break;
+
+  case NODE_DO_WHILE:
+    child = parse_statement(parser);
+    node_at(parser, node)->branch.then = child;
+    expect(parser, WHILE, "Expected \"while\" after the do body");
+    child = parse_condition(parser);
+    node_at(parser, node)->branch.condition = child;
+    expect(parser, SEMICOLON, "Expected \";\" after the condition");
+    break;
+
+  case NODE_FOR:
+    expect(parser, LPARENTESES, "Expected \"(\" after for");
+    if (!check(parser, SEMICOLON)) {
+      child = parse_simple_statement(parser);
+      node_at(parser, node)->loop.init = child;
+    }
+    expect(parser, SEMICOLON, "Expected \";\" after the loop initializer");
+    if (!check(parser, SEMICOLON)) {
+      child = parse_expression(parser, PREC_ASSIGNMENT);
+      node_at(parser, node)->loop.condition = child;
+    }
+    expect(parser, SEMICOLON, "Expected \";\" after the loop condition");
+    if (!check(parser, RPARENTESES)) {
+      child = parse_expression(parser, PREC_ASSIGNMENT);
+      node_at(parser, node)->loop.step = child;
+    }
+    expect(parser, RPARENTESES, "Expected \")\" after the loop step");
+    child = parse_statement(parser);
+    node_at(parser, node)->loop.body = child;
+    break;
+
+  case NODE_RETURN:
+    if (!check(parser, SEMICOLON)) {
+      child = parse_expression(parser, PREC_ASSIGNMENT);
+      node_at(parser, node)->unary.operand = child;
+    }
+    expect(parser, SEMICOLON, "Expected \";\" after the return value");
+    break;
+
+  default:
+    expect(parser, SEMICOLON, "Expected \";\" after the statement");
+    break;
+  }
+  return node;
+}
+
+static NodeId parse_statement_kind(Parser *parser) {
+  NodeId node;
+  switch (current_type(parser)) {
+  case LCBRACKETS:
+    return parse_block(parser);
+  case IF:
+    return parse_keyword_statement(parser, NODE_IF);
+  case WHILE:
+    return parse_keyword_statement(parser, NODE_WHILE);
+  case DO:
+    return parse_keyword_statement(parser, NODE_DO_WHILE);
+  case FOR:
+    return parse_keyword_statement(parser, NODE_FOR);
+  case RETURN:
+    return parse_keyword_statement(parser, NODE_RETURN);
+  case BREAK:
+    return parse_keyword_statement(parser, NODE_BREAK);
+  case CONTINUE:
+    return parse_keyword_statement(parser, NODE_CONTINUE);
+
+  case STRUCT:
+    return parse_struct(parser);
+  case ENUM:
+    return parse_enum(parser);
+  case IMPORT:
+  case FROM:
+    return parse_import(parser);
+
+  // Reserved, the language doesn't define these statements yet
+  case SWITCH:
+  case CASE:
+  case FOREACH:
+    return create_error_node(parser,
+                             "Reserved keyword, there is no switch or "
+                             "foreach statement yet");
+
+  default:
+    if (is_function(parser))
+      return parse_function(parser);
+    node = parse_simple_statement(parser);
+    expect(parser, SEMICOLON, "Expected \";\" after the statement");
+    return node;
+  }
+}
+
+/**
+ * Parse a statement, recovering at its end after a syntax error
+ * @param parser
+ * @return the statement node
+ */
+static NodeId parse_statement(Parser *parser) {
+  if (parser->depth >= PARSER_MAX_DEPTH) {
+    NodeId node = create_error_node(parser, "Statement is nested too deeply");
+    synchronize(parser);
+    return node;
+  }
+
+  parser->depth++;
+  NodeId node = parse_statement_kind(parser);
+  parser->depth--;
+  if (parser->panic)
+    synchronize(parser);
+  return node;
+}
+
+/**
+ * Create a parser over a token stream
+ * @param file_location
+ * @param tokens must outlive the parser, up to TK_EOF
+ * @return the parser, NULL if there is no memory left
+ */
+Parser *create_parser(const char *file_location, const TokenBuffer *tokens) {
+  Parser *parser = malloc(sizeof(Parser));
+  if (parser == NULL)
+    return NULL;
+
+  // About one node every two tokens
+  parser->ast = create_ast(tokens->length / 2 + 1);
+  if (parser->ast == NULL) {
+    free(parser);
+    return NULL;
+  }
+
+  parser->file_location = file_location;
+  parser->tokens = tokens;
+  parser->index = skip_errors(parser, 0);
+  parser->stack = NULL;
+  parser->stack_length = parser->stack_capacity = 0;
+  parser->depth = 0;
+  parser->panic = 0;
+  parser->diagnostics.items = NULL;
+  parser->diagnostics.length = parser->diagnostics.capacity = 0;
+  parser->out_of_memory = 0;
+  return parser;
+}
+
+/**
+ * Parse the whole token stream. Syntax errors are collected as diagnostics
+ * and leave NODE_ERROR nodes in the tree
+ * @param parser
+ * @return the tree, rooted at its program node and released by the caller
+ * with free_ast. NULL if there is no memory left
+ */
+Ast *parse_program(Parser *parser) {
+  NodeId node = create_node(parser, NODE_PROGRAM, parser->index);
+  if (node == NO_NODE)
+    return NULL;
+
+  i64 base = parser->stack_length;
+  while (!check(parser, TK_EOF) && !parser->out_of_memory) {
+    i64 start = parser->index;
+    push_node(parser, parse_statement(parser));
+    if (parser->index == start)
+      advance(parser);
+  }
+  NodeList list = pop_list(parser, base);
+  node_at(parser, node)->list = list;
+  if (parser->out_of_memory)
+    return NULL;
+
+  Ast *ast = parser->ast;
+  ast->root = node;
+  parser->ast = NULL;
+  return ast;
+}
+
+/**
+ * Release the parser, with the tree unless parse_program handed it over
+ * @param parser
+ */
+void free_parser(Parser *parser) {
+  if (parser->ast != NULL)
+    free_ast(parser->ast), parser->ast = NULL;
+  free(parser->stack), parser->stack = NULL;
+  free(parser->diagnostics.items), parser->diagnostics.items = NULL;
+  free(parser);
+}
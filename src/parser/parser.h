@@ -2,18 +2,39 @@
 #define PARSER_H
 
 #include "../helper.h"
+#include "../lexer/lexer.h"
+#include "ast.h"
 
-typedef struct {
-  i8 is_error;
-  union {
-    char *error;
-    char *result;
-  };
-} Node;
+// Deepest nesting of expressions and statements before giving up, keeps the
+// recursion within the stack of a worker thread
+#ifndef PARSER_MAX_DEPTH
+#define PARSER_MAX_DEPTH 1024
+#endif
 
 typedef struct {
-  Node *root;
+  const char *file_location;
+  const TokenBuffer *tokens;
+  // Next token, TK_ERROR tokens are skipped since the lexer reported them
   i64 index;
+
+  // Tree being built, handed over by parse_program
+  Ast *ast;
+  // Children of the lists being parsed, copied to the tree once complete
+  NodeId *stack;
+  i64 stack_length;
+  i64 stack_capacity;
+
+  i64 depth;
+  // Set after an error until the next statement, to report it only once
+  i8 panic;
+  Diagnostics diagnostics;
+  i8 out_of_memory;
 } Parser;
 
+Parser *create_parser(const char *file_location, const TokenBuffer *tokens);
+
+Ast *parse_program(Parser *parser);
+
+void free_parser(Parser *parser);
+
 #endif
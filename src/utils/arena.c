@@ -0,0 +1,107 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8
+
+/**
+ * Allocate a new block big enough for at least size bytes and put it in front
+ * of the arena block list
+ * @param arena
+ * @param size
+ * @return the new block, NULL if there is no memory left
+ */
+static ArenaBlock *arena_grow(Arena *arena, i64 size) {
+  i64 capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+  if (block == NULL)
+    return NULL;
+  block->used = 0;
+  block->capacity = capacity;
+  block->next = arena->head;
+  arena->head = block;
+  return block;
+}
+
+void arena_init(Arena *arena) { arena->head = NULL; }
+
+/**
+ * Bump allocate from the current block. Memory is only released all at once
+ * through arena_free
+ * @param arena
+ * @param size
+ * @return pointer to size bytes, aligned to ARENA_ALIGNMENT, NULL if there is
+ * no memory left
+ */
+void *arena_alloc(Arena *arena, i64 size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(i64)(ARENA_ALIGNMENT - 1);
+
+  ArenaBlock *block = arena->head;
+  if (block == NULL || block->capacity - block->used < size)
+    block = arena_grow(arena, size);
+  if (block == NULL)
+    return NULL;
+
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+/**
+ * Copy a slice of string into the arena
+ * @param arena
+ * @param value
+ * @param length
+ * @return a null terminated copy owned by the arena, NULL if there is no
+ * memory left
+ */
+char *arena_strndup(Arena *arena, const char *value, i64 length) {
+  char *copy = arena_alloc(arena, length + 1);
+  if (copy == NULL)
+    return NULL;
+  memcpy(copy, value, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/**
+ * Move every block of from into arena, from is left empty. Pointers into the
+ * moved blocks stay valid
+ * @param arena
+ * @param from
+ */
+void arena_merge(Arena *arena, Arena *from) {
+  if (from->head == NULL)
+    return;
+
+  ArenaBlock *tail = from->head;
+  while (tail->next != NULL)
+    tail = tail->next;
+  tail->next = arena->head;
+  arena->head = from->head;
+  from->head = NULL;
+}
+
+/**
+ * Bytes handed out by the arena, alignment included
+ * @param arena
+ * @return the size
+ */
+i64 arena_used(const Arena *arena) {
+  i64 used = 0;
+  for (const ArenaBlock *block = arena->head; block != NULL;
+       block = block->next)
+    used += block->used;
+  return used;
+}
+
+void arena_free(Arena *arena) {
+  ArenaBlock *block = arena->head;
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
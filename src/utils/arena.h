@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "../helper.h"
+
+typedef struct A_B {
+  struct A_B *next;
+  i64 used;
+  i64 capacity;
+  char data[];
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock *head;
+} Arena;
+
+void arena_init(Arena *arena);
+
+void *arena_alloc(Arena *arena, i64 size);
+
+char *arena_strndup(Arena *arena, const char *value, i64 length);
+
+void arena_merge(Arena *arena, Arena *from);
+
+i64 arena_used(const Arena *arena);
+
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,90 @@
+#include "hash.h"
+#include <string.h>
+
+// XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static i64 rotate_left(i64 value, int count) {
+  return (value << count) | (value >> (64 - count));
+}
+
+// Unaligned loads, the input is read as little endian
+static i64 read64(const char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static i64 read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static i64 round64(i64 accumulator, i64 input) {
+  accumulator += input * PRIME64_2;
+  accumulator = rotate_left(accumulator, 31);
+  return accumulator * PRIME64_1;
+}
+
+static i64 merge_round(i64 accumulator, i64 value) {
+  accumulator ^= round64(0, value);
+  return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * Hash bytes with XXH64, four independent lanes consume 32 bytes per
+ * iteration so long inputs hash at memory speed
+ * @param data
+ * @param length
+ * @param seed
+ * @return the 64-bit hash
+ */
+i64 hash_bytes(const void *data, i64 length, i64 seed) {
+  const char *p = data, *end = p + length;
+  i64 hash;
+
+  if (length >= 32) {
+    i64 v1 = seed + PRIME64_1 + PRIME64_2, v2 = seed + PRIME64_2;
+    i64 v3 = seed, v4 = seed - PRIME64_1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+    }
+    hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) +
+           rotate_left(v4, 18);
+    hash = merge_round(hash, v1);
+    hash = merge_round(hash, v2);
+    hash = merge_round(hash, v3);
+    hash = merge_round(hash, v4);
+  } else
+    hash = seed + PRIME64_5;
+  hash += length;
+
+  for (; p + 8 <= end; p += 8) {
+    hash ^= round64(0, read64(p));
+    hash = rotate_left(hash, 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    hash ^= read32(p) * PRIME64_1;
+    hash = rotate_left(hash, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    hash ^= (i64)(unsigned char)*p * PRIME64_5;
+    hash = rotate_left(hash, 11) * PRIME64_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,8 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "../helper.h"
+
+i64 hash_bytes(const void *data, i64 length, i64 seed);
+
+#endif
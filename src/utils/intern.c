@@ -0,0 +1,170 @@
+#include "intern.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SHARD_INITIAL_SLOTS 256
+
+/**
+ * Create an empty symbol table
+ * @return the table, NULL if there is no memory left
+ */
+SymbolTable *create_symbol_table(void) {
+  SymbolTable *table = malloc(sizeof(SymbolTable));
+  if (table == NULL)
+    return NULL;
+  for (i64 i = 0; i < SYMBOL_SHARDS; i++) {
+    SymbolShard *shard = &table->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->slots = NULL;
+    shard->slots_capacity = 0;
+    shard->symbols = NULL;
+    shard->length = shard->capacity = 0;
+    arena_init(&shard->names);
+  }
+  return table;
+}
+
+/**
+ * Double the slots of a shard, or create them, and put every symbol back
+ * @param shard
+ * @return false if there is no memory left
+ */
+static i8 grow_slots(SymbolShard *shard) {
+  i64 capacity =
+      shard->slots_capacity ? shard->slots_capacity * 2 : SHARD_INITIAL_SLOTS;
+  i32 *slots = calloc(capacity, sizeof(i32));
+  if (slots == NULL)
+    return 0;
+
+  // The low bits picked the shard, the next ones pick the slot
+  for (i64 i = 0; i < shard->length; i++) {
+    i64 slot = (shard->symbols[i].hash >> SYMBOL_SHARD_BITS) & (capacity - 1);
+    while (slots[slot] != 0)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = i + 1;
+  }
+  free(shard->slots);
+  shard->slots = slots;
+  shard->slots_capacity = capacity;
+  return 1;
+}
+
+/**
+ * Add a symbol to a shard whose lock is held
+ * @param shard
+ * @param name
+ * @param length
+ * @param hash
+ * @return its index in the shard, NO_SYMBOL if there is no memory left
+ */
+static i32 add_symbol(SymbolShard *shard, const char *name, i64 length,
+                      i64 hash) {
+  if (shard->length == shard->capacity) {
+    i64 capacity = shard->capacity ? shard->capacity * 2 : 64;
+    Symbol *symbols = realloc(shard->symbols, sizeof(Symbol) * capacity);
+    if (symbols == NULL)
+      return NO_SYMBOL;
+    shard->symbols = symbols;
+    shard->capacity = capacity;
+  }
+  char *copy = arena_strndup(&shard->names, name, length);
+  if (copy == NULL)
+    return NO_SYMBOL;
+
+  shard->symbols[shard->length] =
+      (Symbol){.name = copy, .length = length, .hash = hash};
+  return shard->length++;
+}
+
+/**
+ * Hash a name the way the table does, the low bits pick its shard
+ * @param name
+ * @param length
+ * @return the hash to pass to intern_hashed
+ */
+i64 symbol_hash(const char *name, i64 length) {
+  return hash_bytes(name, length, 0);
+}
+
+/**
+ * Get the symbol of a name, adding it on first sight
+ * @param table
+ * @param name not null terminated, copied into the table once
+ * @param length
+ * @return the symbol, NO_SYMBOL if there is no memory left
+ */
+i32 intern(SymbolTable *table, const char *name, i64 length) {
+  return intern_hashed(table, name, length, symbol_hash(name, length));
+}
+
+/**
+ * Same as intern, for callers that hashed the name already
+ * @param table
+ * @param name
+ * @param length
+ * @param hash from symbol_hash
+ * @return the symbol, NO_SYMBOL if there is no memory left
+ */
+i32 intern_hashed(SymbolTable *table, const char *name, i64 length,
+                  i64 hash) {
+  i64 shard_index = hash & (SYMBOL_SHARDS - 1);
+  SymbolShard *shard = &table->shards[shard_index];
+
+  pthread_mutex_lock(&shard->lock);
+  // Kept at most half full
+  if (shard->length * 2 >= shard->slots_capacity && !grow_slots(shard)) {
+    pthread_mutex_unlock(&shard->lock);
+    return NO_SYMBOL;
+  }
+
+  i64 mask = shard->slots_capacity - 1;
+  i64 slot = (hash >> SYMBOL_SHARD_BITS) & mask;
+  i32 index = NO_SYMBOL;
+  while (shard->slots[slot] != 0) {
+    const Symbol *symbol = &shard->symbols[shard->slots[slot] - 1];
+    if (symbol->hash == hash && symbol->length == length &&
+        memcmp(symbol->name, name, length) == 0) {
+      index = shard->slots[slot] - 1;
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  if (index == NO_SYMBOL) {
+    index = add_symbol(shard, name, length, hash);
+    if (index != NO_SYMBOL)
+      shard->slots[slot] = index + 1;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return index == NO_SYMBOL ? NO_SYMBOL
+                            : index << SYMBOL_SHARD_BITS | shard_index;
+}
+
+/**
+ * Get the name of a symbol
+ * @param table
+ * @param symbol
+ * @param length set to the length of the name
+ * @return the null terminated name, it lives as long as the table
+ */
+const char *symbol_name(SymbolTable *table, i32 symbol, i64 *length) {
+  SymbolShard *shard = &table->shards[symbol & (SYMBOL_SHARDS - 1)];
+  pthread_mutex_lock(&shard->lock);
+  const Symbol *entry = &shard->symbols[symbol >> SYMBOL_SHARD_BITS];
+  const char *name = entry->name;
+  *length = entry->length;
+  pthread_mutex_unlock(&shard->lock);
+  return name;
+}
+
+void free_symbol_table(SymbolTable *table) {
+  for (i64 i = 0; i < SYMBOL_SHARDS; i++) {
+    SymbolShard *shard = &table->shards[i];
+    pthread_mutex_destroy(&shard->lock);
+    free(shard->slots);
+    free(shard->symbols);
+    arena_free(&shard->names);
+  }
+  free(table);
+}
@@ -0,0 +1,53 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "../helper.h"
+#include "arena.h"
+#include <pthread.h>
+
+#define NO_SYMBOL UINT32_MAX
+// Power of two, the low bits of a symbol are its shard
+#define SYMBOL_SHARDS 16
+#define SYMBOL_SHARD_BITS 4
+
+typedef struct {
+  // Null terminated copy owned by the shard
+  const char *name;
+  i64 length;
+  i64 hash;
+} Symbol;
+
+// Open addressing table with linear probing. Each slot holds the index of a
+// symbol plus one, 0 when it is empty
+typedef struct {
+  pthread_mutex_t lock;
+  i32 *slots;
+  i64 slots_capacity;
+  Symbol *symbols;
+  i64 length;
+  i64 capacity;
+  Arena names;
+} SymbolShard;
+
+// Names interned once per compilation, each distinct name gets a 32-bit
+// symbol so names compare by integer equality. Every function can be called
+// from several threads at once, the table is split into shards by hash, each
+// one with its own lock
+typedef struct {
+  SymbolShard shards[SYMBOL_SHARDS];
+} SymbolTable;
+
+SymbolTable *create_symbol_table(void);
+
+i64 symbol_hash(const char *name, i64 length);
+
+i32 intern(SymbolTable *table, const char *name, i64 length);
+
+i32 intern_hashed(SymbolTable *table, const char *name, i64 length,
+                  i64 hash);
+
+const char *symbol_name(SymbolTable *table, i32 symbol, i64 *length);
+
+void free_symbol_table(SymbolTable *table);
+
+#endif
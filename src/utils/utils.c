@@ -1,35 +1,140 @@
+#define _DEFAULT_SOURCE
 #include "./utils.h"
 #include <errno.h>
-#include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-char *read_file(const char *file_location) {
-  FILE *file = fopen(file_location, "r");
-  if (file == NULL)
-    goto file_not_found;
+#define READ_CHUNK_SIZE (64 * 1024)
 
-  // Get file length
-  fseek(file, 0, SEEK_END);
-  long length = ftell(file);
-  fseek(file, 0, SEEK_SET);
+/**
+ * Read a whole file descriptor into heap memory, used for pipes, stdin and
+ * anything else that can't be mapped
+ * @param fd
+ * @param source
+ * @return 1 on success, 0 otherwise
+ */
+static i8 read_descriptor(int fd, SourceFile *source) {
+  i64 capacity = READ_CHUNK_SIZE, length = 0;
+  char *data = malloc(capacity + 1);
+  if (data == NULL)
+    return 0;
 
-  char *source = malloc(sizeof(char) * (length + 1));
+  while (1) {
+    if (length == capacity) {
+      capacity *= 2;
+      char *grown = realloc(data, capacity + 1);
+      if (grown == NULL)
+        goto error;
+      data = grown;
+    }
+
+    ssize_t n = read(fd, data + length, capacity - length);
+    if (n == 0)
+      break;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      goto error;
+    }
+    length += n;
+  }
+
+  data[length] = '\0';
+  source->data = data;
+  source->length = length;
+  source->mapped_length = 0;
+  return 1;
+
+error:
+  free(data);
+  return 0;
+}
+
+/**
+ * Map a regular file read only. The mapping is one byte longer than the file
+ * and backed by zero filled anonymous memory past the end of the file, so the
+ * lexer can rely on the '\0' sentinel without copying the source
+ * @param fd
+ * @param length file length
+ * @param source
+ * @return 1 on success, 0 otherwise
+ */
+static i8 map_descriptor(int fd, i64 length, SourceFile *source) {
+  i64 page = sysconf(_SC_PAGESIZE);
+  i64 mapped_length = (length + 1 + page - 1) & ~(page - 1);
+
+  char *reserved = mmap(NULL, mapped_length, PROT_READ,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED)
+    return 0;
+
+  char *data =
+      mmap(reserved, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  if (data == MAP_FAILED) {
+    munmap(reserved, mapped_length);
+    return 0;
+  }
+  madvise(data, length, MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->length = length;
+  source->mapped_length = mapped_length;
+  return 1;
+}
+
+/**
+ * Load a source file. Regular files are memory mapped, pipes and stdin ("-")
+ * fall back to a buffered read
+ * @param file_location
+ * @return the loaded source, NULL with errno set if the file can't be read
+ */
+SourceFile *load_source(const char *file_location) {
+  SourceFile *source = malloc(sizeof(SourceFile));
   if (source == NULL)
-    goto error_mem_size;
+    return NULL;
+
+  i8 is_stdin = strcmp(file_location, "-") == 0;
+  int fd = is_stdin ? STDIN_FILENO : open(file_location, O_RDONLY);
+  if (fd < 0)
+    goto error;
 
-  // Get file content
-  source[length] = '\0';
-  fread(source, sizeof(char), length, file);
-  fclose(file);
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+    goto error_close;
+  if (S_ISDIR(info.st_mode)) {
+    errno = EISDIR;
+    goto error_close;
+  }
+
+  i8 loaded = 0;
+  if (S_ISREG(info.st_mode) && info.st_size > 0)
+    loaded = map_descriptor(fd, info.st_size, source);
+  if (!loaded && !read_descriptor(fd, source))
+    goto error_close;
+
+  if (!is_stdin)
+    close(fd);
   return source;
 
-error_mem_size:
-  fprintf(stderr, "MallocError: %s.\n", strerror(errno));
-  fclose(file);
-  exit(EXIT_FAILURE);
+error_close:
+  if (!is_stdin) {
+    int error = errno;
+    close(fd);
+    errno = error;
+  }
+error:
+  free(source);
+  return NULL;
+}
 
-file_not_found:
-  fprintf(stderr, "FileError: file %s not found\n", file_location);
-  exit(EXIT_FAILURE);
+void free_source(SourceFile *source) {
+  if (source->mapped_length > 0)
+    munmap((void *)source->data, source->mapped_length);
+  else
+    free((void *)source->data);
+  free(source);
 }
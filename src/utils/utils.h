@@ -1,6 +1,18 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-char *read_file(const char *file_location);
+#include "../helper.h"
+
+typedef struct {
+  // Always followed by a '\0' sentinel at data[length]
+  const char *data;
+  i64 length;
+  // Size of the mapping when data is memory mapped, 0 when it is heap memory
+  i64 mapped_length;
+} SourceFile;
+
+SourceFile *load_source(const char *file_location);
+
+void free_source(SourceFile *source);
 
 #endif
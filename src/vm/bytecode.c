@@ -0,0 +1,327 @@
+#include "bytecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPCODE_NAME(name) #name,
+static const char *opcode_names[OPCODE_COUNT] = {OPCODES(OPCODE_NAME)};
+#undef OPCODE_NAME
+
+/**
+ * Make room for one more item in a growable array
+ * @param items
+ * @param length
+ * @param capacity
+ * @param size of an item
+ * @return false if there is no memory left
+ */
+static i8 reserve(void **items, i64 length, i64 *capacity, i64 size) {
+  if (length < *capacity)
+    return 1;
+  i64 grown = *capacity ? *capacity * 2 : 16;
+  void *resized = realloc(*items, size * grown);
+  if (resized == NULL)
+    return 0;
+  *items = resized;
+  *capacity = grown;
+  return 1;
+}
+
+/**
+ * Create a program with its top-level function, function 0
+ * @param file_location
+ * @param tokens the program is compiled from, must outlive it
+ * @return the program, NULL if there is no memory left
+ */
+Program *create_program(const char *file_location, const TokenBuffer *tokens) {
+  Program *program = calloc(1, sizeof(Program));
+  if (program == NULL)
+    return NULL;
+  program->file_location = file_location;
+  program->tokens = tokens;
+
+  i64 init;
+  if (!append_function(program, tokens->length - 1, VALUE_VOID, &init)) {
+    free_program(program);
+    return NULL;
+  }
+  return program;
+}
+
+/**
+ * Append a function without parameters nor code
+ * @param program
+ * @param token of the function name
+ * @param type returned
+ * @param index set to the function index
+ * @return false if there is no memory left
+ */
+i8 append_function(Program *program, i64 token, ValueType type, i64 *index) {
+  if (program->functions_length >= UINT16_MAX ||
+      !reserve((void **)&program->functions, program->functions_length,
+               &program->functions_capacity, sizeof(Function)))
+    return 0;
+
+  Function *function = &program->functions[program->functions_length];
+  memset(function, 0, sizeof(Function));
+  function->token = token;
+  function->type = type;
+  *index = program->functions_length++;
+  return 1;
+}
+
+/**
+ * Append an instruction to the code of a function
+ * @param function
+ * @param instruction
+ * @param token it was compiled from
+ * @return false if there is no memory left
+ */
+i8 append_instruction(Function *function, Instruction instruction,
+                      i64 token) {
+  if (function->length == function->capacity) {
+    i64 capacity = function->capacity ? function->capacity * 2 : 64;
+    Instruction *code = realloc(function->code, sizeof(Instruction) * capacity);
+    if (code == NULL)
+      return 0;
+    function->code = code;
+    i32 *tokens = realloc(function->tokens, sizeof(i32) * capacity);
+    if (tokens == NULL)
+      return 0;
+    function->tokens = tokens;
+    function->capacity = capacity;
+  }
+
+  function->code[function->length] = instruction;
+  function->tokens[function->length++] = token;
+  return 1;
+}
+
+/**
+ * Append a value to the constant pool
+ * @param program
+ * @param value
+ * @param index set to the constant index
+ * @return false if there is no memory left
+ */
+i8 append_constant(Program *program, Value value, i64 *index) {
+  if (program->constants_length > UINT32_MAX ||
+      !reserve((void **)&program->constants, program->constants_length,
+               &program->constants_capacity, sizeof(Value)))
+    return 0;
+  program->constants[program->constants_length] = value;
+  *index = program->constants_length++;
+  return 1;
+}
+
+/**
+ * Append a global variable
+ * @param program
+ * @param type
+ * @param index set to the global index
+ * @return false if there is no memory left
+ */
+i8 append_global(Program *program, ValueType type, i64 *index) {
+  if (program->globals_length > UINT32_MAX ||
+      !reserve((void **)&program->globals, program->globals_length,
+               &program->globals_capacity, sizeof(ValueType)))
+    return 0;
+  program->globals[program->globals_length] = type;
+  *index = program->globals_length++;
+  return 1;
+}
+
+void free_program(Program *program) {
+  for (i64 i = 0; i < program->functions_length; i++) {
+    free(program->functions[i].parameters);
+    free(program->functions[i].code);
+    free(program->functions[i].tokens);
+  }
+  free(program->functions), program->functions = NULL;
+  free(program->constants), program->constants = NULL;
+  free(program->globals), program->globals = NULL;
+  free_objects(program->objects), program->objects = NULL;
+  free(program);
+}
+
+/**
+ * Type of an array
+ * @param item type of its items, neither void nor an array
+ * @return the array type
+ */
+ValueType array_of(ValueType item) { return VALUE_ARRAY + item; }
+
+ValueType item_type(ValueType array) { return array - VALUE_ARRAY; }
+
+i8 is_array(ValueType type) { return type > VALUE_ARRAY; }
+
+i8 is_reference(ValueType type) { return type >= VALUE_STRING; }
+
+/**
+ * Allocate an object and link it to a list
+ * @param objects list it is released with
+ * @param size of the whole object
+ * @return the object, NULL if there is no memory left
+ */
+static Object *new_object(Object **objects, i64 size) {
+  Object *object = malloc(size);
+  if (object == NULL)
+    return NULL;
+  object->next = *objects;
+  *objects = object;
+  return object;
+}
+
+/**
+ * Allocate an array with its items zeroed
+ * @param objects list it is released with
+ * @param length
+ * @return the array, NULL if there is no memory left
+ */
+Array *new_array(Object **objects, i64 length) {
+  if (length > (INT64_MAX - sizeof(Array)) / sizeof(Value))
+    return NULL;
+  Array *array =
+      (Array *)new_object(objects, sizeof(Array) + sizeof(Value) * length);
+  if (array == NULL)
+    return NULL;
+  array->object.length = length;
+  memset(array->items, 0, sizeof(Value) * length);
+  return array;
+}
+
+/**
+ * Allocate a string
+ * @param objects list it is released with
+ * @param chars copied
+ * @param length
+ * @return the string, NULL if there is no memory left
+ */
+String *new_string(Object **objects, const char *chars, i64 length) {
+  String *string = (String *)new_object(objects, sizeof(String) + length);
+  if (string == NULL)
+    return NULL;
+  string->object.length = length;
+  if (length > 0)
+    memcpy(string->chars, chars, length);
+  return string;
+}
+
+void free_objects(Object *objects) {
+  while (objects != NULL) {
+    Object *next = objects->next;
+    free(objects);
+    objects = next;
+  }
+}
+
+// Names of the array types, by type of their items
+static const char *array_type_names[] = {
+    "void[..]", "boolean[..]", "i8[..]",  "i16[..]",   "i32[..]",
+    "i64[..]",  "f32[..]",     "f64[..]", "string[..]"};
+
+const char *value_type_string(ValueType type) {
+  if (is_array(type) && item_type(type) <= VALUE_STRING)
+    return array_type_names[item_type(type)];
+  switch (type) {
+  case VALUE_VOID:
+    return "void";
+  case VALUE_BOOLEAN:
+    return "boolean";
+  case VALUE_I8:
+    return "i8";
+  case VALUE_I16:
+    return "i16";
+  case VALUE_I32:
+    return "i32";
+  case VALUE_I64:
+    return "i64";
+  case VALUE_F32:
+    return "f32";
+  case VALUE_F64:
+    return "f64";
+  case VALUE_STRING:
+    return "string";
+  default:
+    return "UNKNOW";
+  }
+}
+
+/**
+ * Print a value the way it would be written in the source
+ * @param type
+ * @param value
+ */
+void print_value(ValueType type, Value value) {
+  switch (type) {
+  case VALUE_VOID:
+    printf("void");
+    break;
+  case VALUE_BOOLEAN:
+    printf(value.i ? "true" : "false");
+    break;
+  case VALUE_F32:
+    printf("%g", value.f32);
+    break;
+  case VALUE_F64:
+    printf("%g", value.f64);
+    break;
+  case VALUE_STRING:
+    if (value.object == NULL)
+      printf("\"\"");
+    else
+      printf("\"%.*s\"", (int)value.object->length,
+             ((String *)value.object)->chars);
+    break;
+  default:
+    if (!is_array(type)) {
+      printf("%ld", (int64_t)value.i);
+      break;
+    }
+    printf("[");
+    for (i64 i = 0; value.object != NULL && i < value.object->length; i++) {
+      if (i > 0)
+        printf(", ");
+      print_value(item_type(type), ((Array *)value.object)->items[i]);
+    }
+    printf("]");
+    break;
+  }
+}
+
+static void print_function(const Program *program, i64 index) {
+  const Function *function = &program->functions[index];
+  if (index == 0)
+    printf("<top level>");
+  else {
+    Token name = get_token(program->tokens, function->token);
+    printf("%.*s", (int)name.length, name.value);
+  }
+  printf(" (%ld parameters, %ld registers): %s\n", function->arity,
+         function->registers, value_type_string(function->type));
+
+  for (i64 i = 0; i < function->length; i++) {
+    Instruction instruction = function->code[i];
+    printf("  %4ld  %-18s %5u %5u %5u", i, opcode_names[instruction.op],
+           instruction.a, instruction.b, instruction.c);
+    switch (instruction.op) {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+      printf("  -> %ld", i + 1 + INSTRUCTION_SBX(instruction));
+      break;
+    default:
+      break;
+    }
+    printf("\n");
+  }
+}
+
+/**
+ * Disassemble every function of a program
+ * @param program
+ */
+void print_program(const Program *program) {
+  for (i64 i = 0; i < program->functions_length; i++)
+    print_function(program, i);
+}
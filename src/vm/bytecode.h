@@ -0,0 +1,229 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "../helper.h"
+#include "../lexer/token.h"
+
+// Types a value can have at runtime. Integers narrower than 64 bits are kept
+// sign extended in a whole register and wrapped back after each operation
+typedef enum {
+  VALUE_VOID,
+  VALUE_BOOLEAN,
+  VALUE_I8,
+  VALUE_I16,
+  VALUE_I32,
+  VALUE_I64,
+  VALUE_F32,
+  VALUE_F64,
+  VALUE_STRING,
+  // An array type is VALUE_ARRAY plus the type of its items, which are
+  // neither void nor arrays. See array_of
+  VALUE_ARRAY,
+} ValueType;
+
+// Strings and arrays live on the heap, the registers holding one point to
+// it. A null pointer is an empty one, so a zeroed register is a valid value
+// of every type
+typedef struct Object {
+  // Objects are released together, with the program for the string
+  // constants and once the run is over for the other ones
+  struct Object *next;
+  i64 length;
+} Object;
+
+// A register, its type is known by the instructions that read it so it
+// carries no tag
+typedef union {
+  i64 i;
+  float f32;
+  double f64;
+  Object *object;
+} Value;
+
+typedef struct {
+  Object object;
+  Value items[];
+} Array;
+
+// Not null terminated, strings are immutable since literals are shared
+typedef struct {
+  Object object;
+  char chars[];
+} String;
+
+// Every opcode, in dispatch table order. A, B and C are register numbers of
+// the current frame unless told otherwise, Bx is B and C read as one 32-bit
+// operand and sBx the same signed
+#define OPCODES(X)                                                          \
+  X(OP_MOVE)          /* A = B */                                           \
+  X(OP_CONST)         /* A = constants[Bx] */                               \
+  X(OP_GET_GLOBAL)    /* A = globals[Bx] */                                 \
+  X(OP_SET_GLOBAL)    /* globals[Bx] = A */                                 \
+                                                                            \
+  X(OP_ADD_I32)       /* A = B + C, wrapped to 32 bits */                   \
+  X(OP_SUB_I32)                                                             \
+  X(OP_MUL_I32)                                                             \
+  X(OP_DIV_I32)                                                             \
+  X(OP_MOD_I32)                                                             \
+  X(OP_POW_I32)       /* A = B ** C, truncated toward 0 */                  \
+  X(OP_NEG_I32)       /* A = -B */                                          \
+  X(OP_ADD_I64)                                                             \
+  X(OP_SUB_I64)                                                             \
+  X(OP_MUL_I64)                                                             \
+  X(OP_DIV_I64)                                                             \
+  X(OP_MOD_I64)                                                             \
+  X(OP_POW_I64)                                                             \
+  X(OP_NEG_I64)                                                             \
+  X(OP_ADD_F32)                                                             \
+  X(OP_SUB_F32)                                                             \
+  X(OP_MUL_F32)                                                             \
+  X(OP_DIV_F32)                                                             \
+  X(OP_POW_F32)                                                             \
+  X(OP_NEG_F32)                                                             \
+  X(OP_ADD_F64)                                                             \
+  X(OP_SUB_F64)                                                             \
+  X(OP_MUL_F64)                                                             \
+  X(OP_DIV_F64)                                                             \
+  X(OP_POW_F64)                                                             \
+  X(OP_NEG_F64)                                                             \
+                                                                            \
+  X(OP_BITWISE_AND)   /* integers of any width */                           \
+  X(OP_BITWISE_OR)                                                          \
+  X(OP_BITWISE_XOR)                                                         \
+  X(OP_BITWISE_NOT)                                                         \
+  X(OP_LEFT_SHIFT)                                                          \
+  X(OP_RIGHT_SHIFT)   /* arithmetic */                                      \
+  X(OP_NOT)           /* A = !B, booleans and integers */                   \
+                                                                            \
+  X(OP_EQ_I64)        /* A = B == C, integers of any width and booleans */  \
+  X(OP_NE_I64)                                                              \
+  X(OP_LT_I64)                                                              \
+  X(OP_LE_I64)                                                              \
+  X(OP_EQ_F32)                                                              \
+  X(OP_NE_F32)                                                              \
+  X(OP_LT_F32)                                                              \
+  X(OP_LE_F32)                                                              \
+  X(OP_EQ_F64)                                                              \
+  X(OP_NE_F64)                                                              \
+  X(OP_LT_F64)                                                              \
+  X(OP_LE_F64)                                                              \
+                                                                            \
+  X(OP_WRAP_I8)       /* A = B wrapped to 8 bits and sign extended */       \
+  X(OP_WRAP_I16)                                                            \
+  X(OP_WRAP_I32)                                                            \
+  X(OP_I64_TO_F32)                                                          \
+  X(OP_I64_TO_F64)                                                          \
+  X(OP_F32_TO_I64)                                                          \
+  X(OP_F64_TO_I64)                                                          \
+  X(OP_F32_TO_F64)                                                          \
+  X(OP_F64_TO_F32)                                                          \
+  X(OP_TO_BOOLEAN)    /* A = B != 0, integers */                            \
+                                                                            \
+  X(OP_ARRAY)         /* A = array of the C registers from B */             \
+  X(OP_NEW_ARRAY)     /* A = array of B zeroed items */                     \
+  X(OP_GET_INDEX)     /* A = B[C], arrays */                                \
+  X(OP_SET_INDEX)     /* A[B] = C, arrays */                                \
+  X(OP_GET_CHAR)      /* A = B[C], strings, as an i8 */                     \
+  X(OP_LENGTH)        /* A = items of the array or bytes of the string B */ \
+                                                                            \
+  X(OP_JUMP)          /* ip += sBx */                                       \
+  X(OP_JUMP_IF_FALSE) /* if !A, ip += sBx */                                \
+  X(OP_JUMP_IF_TRUE)  /* if A, ip += sBx */                                 \
+  X(OP_CALL)          /* A = functions[B](A, A + 1... A + C - 1) */         \
+  X(OP_RETURN)        /* return A */                                        \
+  X(OP_RETURN_VOID)
+
+#define OPCODE_ENUM(name) name,
+typedef enum { OPCODES(OPCODE_ENUM) OPCODE_COUNT } OpCode;
+#undef OPCODE_ENUM
+
+// Fixed-size instruction, 8 bytes
+typedef struct {
+  i8 op;
+  i16 a;
+  i16 b;
+  i16 c;
+} Instruction;
+
+#define INSTRUCTION_BX(instruction)                                         \
+  ((i32)(instruction).b | (i32)(instruction).c << 16)
+#define INSTRUCTION_SBX(instruction) ((int32_t)INSTRUCTION_BX(instruction))
+
+// Registers a frame can address through A, B and C
+#define MAX_REGISTERS UINT16_MAX
+
+typedef struct {
+  // Token of the function name
+  i64 token;
+  ValueType type;
+  ValueType *parameters;
+  i64 arity;
+  // Parameters first, then locals and temporaries
+  i64 registers;
+
+  Instruction *code;
+  // Token of each instruction, to report runtime errors
+  i32 *tokens;
+  i64 length;
+  i64 capacity;
+} Function;
+
+typedef struct {
+  const char *file_location;
+  // Must outlive the program, the functions point in it
+  const TokenBuffer *tokens;
+
+  Function *functions;
+  i64 functions_length;
+  i64 functions_capacity;
+
+  Value *constants;
+  i64 constants_length;
+  i64 constants_capacity;
+
+  ValueType *globals;
+  i64 globals_length;
+  i64 globals_capacity;
+
+  // Strings of the constant pool
+  Object *objects;
+
+  // Function called after the top-level statements ran, 0 if there is none
+  // since function 0 runs the top-level statements
+  i64 main;
+} Program;
+
+Program *create_program(const char *file_location, const TokenBuffer *tokens);
+
+i8 append_function(Program *program, i64 token, ValueType type, i64 *index);
+
+i8 append_instruction(Function *function, Instruction instruction,
+                      i64 token);
+
+i8 append_constant(Program *program, Value value, i64 *index);
+
+i8 append_global(Program *program, ValueType type, i64 *index);
+
+void free_program(Program *program);
+
+ValueType array_of(ValueType item);
+
+ValueType item_type(ValueType array);
+
+i8 is_array(ValueType type);
+
+i8 is_reference(ValueType type);
+
+Array *new_array(Object **objects, i64 length);
+
+String *new_string(Object **objects, const char *chars, i64 length);
+
+void free_objects(Object *objects);
+
+const char *value_type_string(ValueType type);
+
+void print_value(ValueType type, Value value);
+
+void print_program(const Program *program);
+
+#endif
@@ -0,0 +1,2130 @@
+#include "compiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Result of an expression: the register holding it and its type
+typedef struct {
+  i64 reg;
+  ValueType type;
+  // Instruction that wrote reg, when it is the only one, so it can write
+  // straight to another register instead. NO_INSTRUCTION otherwise
+  i64 producer;
+} Operand;
+
+#define NO_INSTRUCTION UINT64_MAX
+
+typedef enum {
+  ARITHMETIC_ADD,
+  ARITHMETIC_SUB,
+  ARITHMETIC_MUL,
+  ARITHMETIC_DIV,
+  ARITHMETIC_MOD,
+  ARITHMETIC_POW,
+  ARITHMETIC_NEG,
+} Arithmetic;
+
+// Typed opcodes of each arithmetic operation, OPCODE_COUNT where there is
+// none. i8 and i16 use the i32 ones and wrap the result
+static const OpCode i32_opcodes[] = {OP_ADD_I32, OP_SUB_I32, OP_MUL_I32,
+                                     OP_DIV_I32, OP_MOD_I32, OP_POW_I32,
+                                     OP_NEG_I32};
+static const OpCode i64_opcodes[] = {OP_ADD_I64, OP_SUB_I64, OP_MUL_I64,
+                                     OP_DIV_I64, OP_MOD_I64, OP_POW_I64,
+                                     OP_NEG_I64};
+static const OpCode f32_opcodes[] = {OP_ADD_F32, OP_SUB_F32,   OP_MUL_F32,
+                                     OP_DIV_F32, OPCODE_COUNT, OP_POW_F32,
+                                     OP_NEG_F32};
+static const OpCode f64_opcodes[] = {OP_ADD_F64, OP_SUB_F64,   OP_MUL_F64,
+                                     OP_DIV_F64, OPCODE_COUNT, OP_POW_F64,
+                                     OP_NEG_F64};
+
+static Operand compile_expression(Compiler *compiler, NodeId id,
+                                  ValueType hint);
+static void compile_statement(Compiler *compiler, NodeId id);
+
+static const Node *node_at(Compiler *compiler, NodeId id) {
+  return &compiler->ast->nodes[id];
+}
+
+static Function *current_function(Compiler *compiler) {
+  return &compiler->program->functions[compiler->function];
+}
+
+static i8 is_integer(ValueType type) {
+  return type >= VALUE_I8 && type <= VALUE_I64;
+}
+
+static i8 is_float(ValueType type) {
+  return type == VALUE_F32 || type == VALUE_F64;
+}
+
+/**
+ * Record an error at a token. Only the first error of a statement is
+ * reported, the following ones are usually caused by it
+ * @param compiler
+ * @param kind TYPE_ERROR or UNSUPPORTED_FEATURE
+ * @param token index of the token where the error is
+ * @param details
+ */
+static void report_error(Compiler *compiler, DiagnosticKind kind, i64 token,
+                         const char *details) {
+  if (compiler->panic)
+    return;
+  compiler->panic = 1;
+
+  Diagnostic diagnostic = {.kind = kind, .details = details};
+  diagnostic.pos.file_location = compiler->file_location;
+  diagnostic.pos.index = compiler->tokens->offsets[token];
+  line_table_lookup(&compiler->tokens->lines, diagnostic.pos.index,
+                    &diagnostic.pos.line, &diagnostic.pos.column);
+  if (!append_diagnostic(&compiler->diagnostics, diagnostic))
+    compiler->out_of_memory = 1;
+}
+
+static void report_type_error(Compiler *compiler, i64 token,
+                              const char *details) {
+  report_error(compiler, TYPE_ERROR, token, details);
+}
+
+/**
+ * Record valid code the compiler can't translate yet, it is not the
+ * program that is wrong
+ * @param compiler
+ * @param token
+ * @param details
+ */
+static void report_unsupported(Compiler *compiler, i64 token,
+                               const char *details) {
+  report_error(compiler, UNSUPPORTED_FEATURE, token, details);
+}
+
+/**
+ * Compare the names of two identifiers, by symbol once they are interned
+ * @param compiler
+ * @param a token
+ * @param b token
+ * @return true if they are the same name
+ */
+static i8 same_name(Compiler *compiler, i64 a, i64 b) {
+  const TokenBuffer *tokens = compiler->tokens;
+  if (a < tokens->symbols_length && b < tokens->symbols_length)
+    return tokens->symbols[a] == tokens->symbols[b];
+  return tokens->lengths[a] == tokens->lengths[b] &&
+         memcmp(tokens->source + tokens->offsets[a],
+                tokens->source + tokens->offsets[b], tokens->lengths[a]) == 0;
+}
+
+static i8 is_named(Compiler *compiler, i64 token, const char *name) {
+  const TokenBuffer *tokens = compiler->tokens;
+  return tokens->lengths[token] == strlen(name) &&
+         memcmp(tokens->source + tokens->offsets[token], name,
+                tokens->lengths[token]) == 0;
+}
+
+/**
+ * Append an instruction to the function being compiled
+ * @param compiler
+ * @param op
+ * @param a
+ * @param b
+ * @param c
+ * @param token the instruction is compiled from
+ * @return index of the instruction
+ */
+static i64 emit(Compiler *compiler, OpCode op, i64 a, i64 b, i64 c,
+                i64 token) {
+  Function *function = current_function(compiler);
+  Instruction instruction = {.op = op, .a = a, .b = b, .c = c};
+  if (!append_instruction(function, instruction, token))
+    compiler->out_of_memory = 1;
+  return function->length - 1;
+}
+
+static i64 emit_bx(Compiler *compiler, OpCode op, i64 a, i64 bx, i64 token) {
+  return emit(compiler, op, a, bx & UINT16_MAX, bx >> 16, token);
+}
+
+/**
+ * Emit a jump to patch once its target is known
+ * @param compiler
+ * @param op OP_JUMP, OP_JUMP_IF_FALSE or OP_JUMP_IF_TRUE
+ * @param a register tested
+ * @param token
+ * @return index of the jump
+ */
+static i64 emit_jump(Compiler *compiler, OpCode op, i64 a, i64 token) {
+  return emit(compiler, op, a, 0, 0, token);
+}
+
+/**
+ * Point a jump at an instruction
+ * @param compiler
+ * @param jump index of the jump
+ * @param target index of the instruction to jump to
+ */
+static void patch_jump(Compiler *compiler, i64 jump, i64 target) {
+  if (compiler->out_of_memory)
+    return;
+  i32 offset = (i32)(int32_t)(target - (jump + 1));
+  Instruction *instruction = &current_function(compiler)->code[jump];
+  instruction->b = offset & UINT16_MAX;
+  instruction->c = offset >> 16;
+}
+
+static i64 next_instruction(Compiler *compiler) {
+  return current_function(compiler)->length;
+}
+
+/**
+ * Take the next free register
+ * @param compiler
+ * @param token reported if the function runs out of registers
+ * @return the register
+ */
+static i64 alloc_register(Compiler *compiler, i64 token) {
+  if (compiler->registers >= MAX_REGISTERS) {
+    report_type_error(compiler, token, "Function needs too many registers");
+    return 0;
+  }
+
+  Function *function = current_function(compiler);
+  i64 reg = compiler->registers++;
+  if (compiler->registers > function->registers)
+    function->registers = compiler->registers;
+  return reg;
+}
+
+/**
+ * Register to write a value computed from an operand: the operand one when
+ * it is a temporary, a new one when it is a variable
+ * @param compiler
+ * @param operand
+ * @param token
+ * @return the register
+ */
+static i64 result_register(Compiler *compiler, Operand operand, i64 token) {
+  if (operand.reg >= compiler->locals)
+    return operand.reg;
+  return alloc_register(compiler, token);
+}
+
+/**
+ * Put an operand in a given register, rewriting the instruction that
+ * produced it when possible instead of adding a move
+ * @param compiler
+ * @param operand
+ * @param reg
+ * @param token
+ */
+static void move_to(Compiler *compiler, Operand operand, i64 reg, i64 token) {
+  if (operand.reg == reg)
+    return;
+  if (operand.producer != NO_INSTRUCTION && !compiler->out_of_memory) {
+    current_function(compiler)->code[operand.producer].a = reg;
+    return;
+  }
+  emit(compiler, OP_MOVE, reg, operand.reg, 0, token);
+}
+
+static Operand load_constant(Compiler *compiler, Value value, ValueType type,
+                             i64 token) {
+  i64 index = 0;
+  if (!append_constant(compiler->program, value, &index))
+    compiler->out_of_memory = 1;
+  Operand operand = {.type = type};
+  operand.reg = alloc_register(compiler, token);
+  operand.producer = emit_bx(compiler, OP_CONST, operand.reg, index, token);
+  return operand;
+}
+
+static Operand load_zero(Compiler *compiler, ValueType type, i64 token) {
+  Value value;
+  memset(&value, 0, sizeof(Value));
+  return load_constant(compiler, value, type, token);
+}
+
+static Operand load_one(Compiler *compiler, ValueType type, i64 token) {
+  Value value;
+  memset(&value, 0, sizeof(Value));
+  if (type == VALUE_F32)
+    value.f32 = 1;
+  else if (type == VALUE_F64)
+    value.f64 = 1;
+  else
+    value.i = 1;
+  return load_constant(compiler, value, type, token);
+}
+
+/**
+ * Load a string constant, owned by the program
+ * @param compiler
+ * @param chars
+ * @param length
+ * @param token
+ * @return the operand
+ */
+static Operand load_string(Compiler *compiler, const char *chars, i64 length,
+                           i64 token) {
+  Value value;
+  String *string = new_string(&compiler->program->objects, chars, length);
+  if (string == NULL)
+    compiler->out_of_memory = 1;
+  value.object = string ? &string->object : NULL;
+  return load_constant(compiler, value, VALUE_STRING, token);
+}
+
+static OpCode wrap_opcode(ValueType type) {
+  switch (type) {
+  case VALUE_I8:
+    return OP_WRAP_I8;
+  case VALUE_I16:
+    return OP_WRAP_I16;
+  case VALUE_I32:
+    return OP_WRAP_I32;
+  default:
+    return OPCODE_COUNT;
+  }
+}
+
+/**
+ * Apply a unary instruction to an operand
+ * @param compiler
+ * @param op
+ * @param operand
+ * @param type of the result
+ * @param token
+ * @return the result
+ */
+static Operand emit_unary(Compiler *compiler, OpCode op, Operand operand,
+                          ValueType type, i64 token) {
+  Operand result = {.type = type};
+  result.reg = result_register(compiler, operand, token);
+  result.producer = emit(compiler, op, result.reg, operand.reg, 0, token);
+  return result;
+}
+
+/**
+ * Convert an operand to another type, implicitly: between numbers, and from
+ * integers to booleans
+ * @param compiler
+ * @param operand
+ * @param type wanted
+ * @param token reported if the conversion isn't allowed
+ * @return the converted operand
+ */
+static Operand convert(Compiler *compiler, Operand operand, ValueType type,
+                       i64 token) {
+  if (operand.type == type)
+    return operand;
+  if (operand.type == VALUE_VOID || type == VALUE_VOID) {
+    report_type_error(compiler, token, "Expression has no value");
+    return (Operand){operand.reg, type, NO_INSTRUCTION};
+  }
+  if (is_reference(operand.type) || is_reference(type)) {
+    report_type_error(compiler, token, "Types don't match");
+    return (Operand){operand.reg, type, NO_INSTRUCTION};
+  }
+
+  if (is_float(operand.type)) {
+    if (type == VALUE_BOOLEAN) {
+      report_type_error(compiler, token, "A float is not a boolean");
+      return (Operand){operand.reg, type, NO_INSTRUCTION};
+    }
+    if (is_float(type))
+      return emit_unary(compiler,
+                        type == VALUE_F64 ? OP_F32_TO_F64 : OP_F64_TO_F32,
+                        operand, type, token);
+    operand = emit_unary(compiler,
+                         operand.type == VALUE_F64 ? OP_F64_TO_I64
+                                                   : OP_F32_TO_I64,
+                         operand, VALUE_I64, token);
+    if (type == VALUE_I64)
+      return operand;
+    return emit_unary(compiler, wrap_opcode(type), operand, type, token);
+  }
+
+  // From a boolean or an integer
+  if (type == VALUE_BOOLEAN)
+    return emit_unary(compiler, OP_TO_BOOLEAN, operand, type, token);
+  if (is_float(type))
+    return emit_unary(compiler,
+                      type == VALUE_F64 ? OP_I64_TO_F64 : OP_I64_TO_F32,
+                      operand, type, token);
+  if (operand.type == VALUE_BOOLEAN || type > operand.type)
+    // Already sign extended to 64 bits
+    return (Operand){operand.reg, type, operand.producer};
+  return emit_unary(compiler, wrap_opcode(type), operand, type, token);
+}
+
+/**
+ * Type of an arithmetic operation between two operands: the widest float if
+ * there is one, the widest integer otherwise
+ * @param a
+ * @param b
+ * @return the type, VALUE_VOID if the operands aren't both numbers
+ */
+static ValueType arithmetic_type(ValueType a, ValueType b) {
+  if (!(is_integer(a) || is_float(a)) || !(is_integer(b) || is_float(b)))
+    return VALUE_VOID;
+  if (is_float(a) || is_float(b))
+    return a == VALUE_F64 || b == VALUE_F64 ? VALUE_F64 : VALUE_F32;
+  return a > b ? a : b;
+}
+
+static OpCode arithmetic_opcode(Arithmetic arithmetic, ValueType type) {
+  switch (type) {
+  case VALUE_I64:
+    return i64_opcodes[arithmetic];
+  case VALUE_F32:
+    return f32_opcodes[arithmetic];
+  case VALUE_F64:
+    return f64_opcodes[arithmetic];
+  default:
+    return i32_opcodes[arithmetic];
+  }
+}
+
+/**
+ * Emit a typed arithmetic instruction, i8 and i16 results are wrapped
+ * @param compiler
+ * @param arithmetic
+ * @param left converted to type already
+ * @param right converted to type already, unused for ARITHMETIC_NEG
+ * @param type
+ * @param reg destination
+ * @param token
+ * @return the result
+ */
+static Operand emit_arithmetic(Compiler *compiler, Arithmetic arithmetic,
+                               Operand left, Operand right, ValueType type,
+                               i64 reg, i64 token) {
+  OpCode op = arithmetic_opcode(arithmetic, type);
+  if (op == OPCODE_COUNT) {
+    report_type_error(compiler, token, "Operator needs integers");
+    return (Operand){reg, type, NO_INSTRUCTION};
+  }
+
+  Operand result = {.reg = reg, .type = type};
+  result.producer = emit(compiler, op, reg, left.reg, right.reg, token);
+  if (type == VALUE_I8 || type == VALUE_I16)
+    result.producer = emit(compiler, wrap_opcode(type), reg, reg, 0, token);
+  return result;
+}
+
+static i8 token_arithmetic(TokenType type, Arithmetic *arithmetic) {
+  switch (type) {
+  case PLUS:
+  case ASSIGNMENT_PLUS:
+  case INCREMENT:
+    *arithmetic = ARITHMETIC_ADD;
+    return 1;
+  case MINUS:
+  case ASSIGNMENT_MINUS:
+  case DECREMENT:
+    *arithmetic = ARITHMETIC_SUB;
+    return 1;
+  case MULTIPLY:
+  case ASSIGNMENT_MULTIPLY:
+    *arithmetic = ARITHMETIC_MUL;
+    return 1;
+  case DIVIDE:
+  case ASSIGNMENT_DIVIDE:
+    *arithmetic = ARITHMETIC_DIV;
+    return 1;
+  case MODULE:
+  case ASSIGNMENT_MODULE:
+    *arithmetic = ARITHMETIC_MOD;
+    return 1;
+  case POWER:
+    *arithmetic = ARITHMETIC_POW;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Resolve a type node
+ * @param compiler
+ * @param id
+ * @return the type, VALUE_VOID for void and after reporting an error
+ */
+static ValueType resolve_type(Compiler *compiler, NodeId id) {
+  const Node *node = node_at(compiler, id);
+  ValueType item;
+
+  switch (node->kind) {
+  case NODE_ERROR:
+    // Reported by the parser
+    compiler->panic = 1;
+    return VALUE_VOID;
+
+  case NODE_ARRAY_TYPE:
+    // Checked before resolving the items, element chains can be long
+    if (node_at(compiler, node->type.element)->kind == NODE_ARRAY_TYPE) {
+      report_unsupported(compiler, node->token,
+                         "Arrays of arrays are not supported yet");
+      return VALUE_VOID;
+    }
+    item = resolve_type(compiler, node->type.element);
+    if (item == VALUE_VOID) {
+      report_type_error(compiler, node->token, "Array items can't be void");
+      return VALUE_VOID;
+    }
+    return array_of(item);
+
+  case NODE_UNION_TYPE:
+    report_unsupported(compiler, node->token,
+                       "Union types are not supported yet");
+    return VALUE_VOID;
+
+  case NODE_TYPE:
+    break;
+
+  default:
+    report_type_error(compiler, node->token, "Expected a type");
+    return VALUE_VOID;
+  }
+
+  switch (compiler->tokens->types[node->token]) {
+  case VOID:
+    return VALUE_VOID;
+  case BOOLEAN:
+    return VALUE_BOOLEAN;
+  case I8:
+  case CHAR:
+    return VALUE_I8;
+  case I16:
+    return VALUE_I16;
+  case INT:
+  case I32:
+    return VALUE_I32;
+  case LONG:
+  case I64:
+    return VALUE_I64;
+  case FLOAT:
+  case F32:
+    return VALUE_F32;
+  case DOUBLE:
+  case F64:
+    return VALUE_F64;
+  case STRING:
+    return VALUE_STRING;
+  case F8:
+  case F16:
+    report_unsupported(compiler, node->token,
+                       "f8 and f16 are not supported yet");
+    return VALUE_VOID;
+  case IDENTIFIER:
+    report_unsupported(compiler, node->token,
+                       "Named types are not supported yet");
+    return VALUE_VOID;
+  default:
+    report_type_error(compiler, node->token, "Expected a type");
+    return VALUE_VOID;
+  }
+}
+
+static Variable *find_variable(Compiler *compiler, i64 name) {
+  for (i64 i = compiler->variables_length; i > 0; i--)
+    if (same_name(compiler, compiler->variables[i - 1].name, name))
+      return &compiler->variables[i - 1];
+  return NULL;
+}
+
+/**
+ * Find a function by name
+ * @param compiler
+ * @param name token
+ * @return its index, 0 if there is none
+ */
+static i64 find_function(Compiler *compiler, i64 name) {
+  for (i64 i = 1; i < compiler->program->functions_length; i++)
+    if (same_name(compiler, compiler->program->functions[i].token, name))
+      return i;
+  return 0;
+}
+
+/**
+ * Declare a variable in the current scope, a global at the top level
+ * @param compiler
+ * @param name token
+ * @param type
+ * @param index its register, or global index
+ */
+static void declare_variable(Compiler *compiler, i64 name, ValueType type,
+                             i64 index) {
+  for (i64 i = compiler->variables_length; i > 0; i--) {
+    Variable *variable = &compiler->variables[i - 1];
+    if (variable->scope < compiler->scope)
+      break;
+    if (same_name(compiler, variable->name, name)) {
+      report_type_error(compiler, name, "Variable is already declared");
+      return;
+    }
+  }
+
+  if (compiler->variables_length == compiler->variables_capacity) {
+    i64 capacity =
+        compiler->variables_capacity ? compiler->variables_capacity * 2 : 64;
+    Variable *grown =
+        realloc(compiler->variables, sizeof(Variable) * capacity);
+    if (grown == NULL) {
+      compiler->out_of_memory = 1;
+      return;
+    }
+    compiler->variables = grown;
+    compiler->variables_capacity = capacity;
+  }
+  compiler->variables[compiler->variables_length++] = (Variable){
+      .name = name, .type = type, .index = index, .scope = compiler->scope};
+}
+
+static void begin_scope(Compiler *compiler) { compiler->scope++; }
+
+/**
+ * Drop the variables of the innermost scope and free their registers
+ * @param compiler
+ */
+static void end_scope(Compiler *compiler) {
+  compiler->scope--;
+  while (compiler->variables_length > 0 &&
+         compiler->variables[compiler->variables_length - 1].scope >
+             compiler->scope) {
+    compiler->variables_length--;
+    compiler->locals =
+        compiler->variables[compiler->variables_length].index;
+  }
+  compiler->registers = compiler->locals;
+}
+
+static i8 is_global(const Variable *variable) {
+  return variable->scope == 0;
+}
+
+/**
+ * Push a jump or a node on one of the compiler stacks
+ * @param compiler
+ * @param items
+ * @param length
+ * @param capacity
+ * @param item
+ * @return true on success, false if there is no memory left
+ */
+static i8 push_index(Compiler *compiler, i64 **items, i64 *length,
+                     i64 *capacity, i64 item) {
+  if (*length == *capacity) {
+    i64 grown = *capacity ? *capacity * 2 : 16;
+    i64 *resized = realloc(*items, sizeof(i64) * grown);
+    if (resized == NULL) {
+      compiler->out_of_memory = 1;
+      return 0;
+    }
+    *items = resized;
+    *capacity = grown;
+  }
+  (*items)[(*length)++] = item;
+  return 1;
+}
+
+/**
+ * Point the jumps pushed since base at target and drop them
+ * @param compiler
+ * @param jumps
+ * @param length
+ * @param base
+ * @param target
+ */
+static void patch_jumps(Compiler *compiler, i64 *jumps, i64 *length, i64 base,
+                        i64 target) {
+  for (i64 i = base; i < *length; i++)
+    patch_jump(compiler, jumps[i], target);
+  *length = base;
+}
+
+/**
+ * Runtime type of a literal type suffix
+ * @param suffix
+ * @return the type, VALUE_VOID for an untyped literal
+ */
+static ValueType suffix_type(NumberSuffix suffix) {
+  switch (suffix) {
+  case NUMBER_I8:
+    return VALUE_I8;
+  case NUMBER_I16:
+    return VALUE_I16;
+  case NUMBER_I32:
+    return VALUE_I32;
+  case NUMBER_I64:
+    return VALUE_I64;
+  case NUMBER_F32:
+    return VALUE_F32;
+  case NUMBER_F64:
+    return VALUE_F64;
+  default:
+    return VALUE_VOID;
+  }
+}
+
+/**
+ * Check that an integer literal holds in a type
+ * @param integer decoded by the lexer
+ * @param type an integer type
+ * @param negated if a minus sign is in front, reaching one more
+ * @return true if it fits
+ */
+static i8 integer_fits(i64 integer, ValueType type, i8 negated) {
+  switch (type) {
+  case VALUE_I8:
+    return integer <= (i64)INT8_MAX + negated;
+  case VALUE_I16:
+    return integer <= (i64)INT16_MAX + negated;
+  case VALUE_I32:
+    return integer <= (i64)INT32_MAX + negated;
+  default:
+    return integer <= (i64)INT64_MAX + negated;
+  }
+}
+
+/**
+ * Compile a literal, numbers take the type hinted by the context when they
+ * can so they need no conversion at runtime
+ * @param compiler
+ * @param node
+ * @param hint type the value will be converted to, VALUE_VOID if unknown
+ * @param negated if the literal is the operand of a minus sign, integers are
+ * then loaded negative so the smallest value of each type can be written
+ * @return the operand
+ */
+static Operand compile_literal(Compiler *compiler, const Node *node,
+                               ValueType hint, i8 negated) {
+  Value value;
+  memset(&value, 0, sizeof(Value));
+  Token token = get_token(compiler->tokens, node->token);
+
+  switch (token.type) {
+  case TRUE:
+  case FALSE:
+    value.i = token.type == TRUE;
+    return load_constant(compiler, value, VALUE_BOOLEAN, node->token);
+
+  case CHAR_LITERAL:
+    // Code point decoded by the lexer, a char holds the ASCII ones
+    if (token.number.integer > 0x7F) {
+      report_type_error(compiler, node->token,
+                        "Char literal does not fit in a char");
+      return load_zero(compiler, VALUE_I8, node->token);
+    }
+    value.i = token.number.integer;
+    return load_constant(compiler, value, VALUE_I8, node->token);
+
+  case STRING_LITERAL:
+    // Decoded by the lexer
+    return load_string(compiler, token.value, token.length, node->token);
+
+  case INT_LITERAL:
+  case BINARY_LITERAL:
+  case OCT_LITERAL:
+  case HEX_LITERAL: {
+    // Decoded by the lexer
+    i64 integer = token.number.integer;
+    if (token.number.overflow || !integer_fits(integer, VALUE_I64, negated)) {
+      report_type_error(compiler, node->token, "Integer literal is too large");
+      return load_zero(compiler, VALUE_I64, node->token);
+    }
+    // A suffix fixes the type, the context converts it if needed
+    ValueType suffix = suffix_type(token.number.suffix);
+    if (suffix != VALUE_VOID)
+      hint = suffix;
+    if (is_float(hint)) {
+      if (hint == VALUE_F32)
+        value.f32 = negated ? -(float)integer : (float)integer;
+      else
+        value.f64 = negated ? -(double)integer : (double)integer;
+      return load_constant(compiler, value, hint, node->token);
+    }
+
+    ValueType type =
+        integer_fits(integer, VALUE_I32, negated) ? VALUE_I32 : VALUE_I64;
+    if (suffix != VALUE_VOID || (is_integer(hint) && hint < type)) {
+      // Never wrapped, a literal the type can't hold is a mistake
+      if (!integer_fits(integer, hint, negated)) {
+        report_type_error(compiler, node->token,
+                          "Integer literal does not fit in its type");
+        return load_zero(compiler, hint, node->token);
+      }
+      type = hint;
+    }
+    // Sign extended as every register holding a narrow integer
+    value.i = negated ? 0 - integer : integer;
+    return load_constant(compiler, value, type, node->token);
+  }
+
+  case FLOAT_LITERAL: {
+    ValueType suffix = suffix_type(token.number.suffix);
+    if (suffix == VALUE_F32 || (suffix == VALUE_VOID && hint == VALUE_F32)) {
+      value.f32 = token.number.real;
+      return load_constant(compiler, value, VALUE_F32, node->token);
+    }
+    value.f64 = token.number.real;
+    return load_constant(compiler, value, VALUE_F64, node->token);
+  }
+
+  default:
+    // null, there is no type it belongs to yet
+    report_unsupported(compiler, node->token, "null is not supported yet");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+}
+
+/**
+ * Write a value to a variable
+ * @param compiler
+ * @param variable
+ * @param value converted to the variable type already
+ * @param token
+ */
+static void store_variable(Compiler *compiler, const Variable *variable,
+                           Operand value, i64 token) {
+  if (is_global(variable))
+    emit_bx(compiler, OP_SET_GLOBAL, value.reg, variable->index, token);
+  else
+    move_to(compiler, value, variable->index, token);
+}
+
+static Operand load_variable(Compiler *compiler, const Variable *variable,
+                             i64 token) {
+  if (!is_global(variable))
+    return (Operand){variable->index, variable->type, NO_INSTRUCTION};
+
+  Operand operand = {.type = variable->type};
+  operand.reg = alloc_register(compiler, token);
+  operand.producer =
+      emit_bx(compiler, OP_GET_GLOBAL, operand.reg, variable->index, token);
+  return operand;
+}
+
+/**
+ * Find the variable an assignment or an increment writes, items are
+ * handled apart
+ * @param compiler
+ * @param id target node
+ * @param token of the operator
+ * @return the variable, NULL after reporting an error
+ */
+static Variable *assignment_target(Compiler *compiler, NodeId id, i64 token) {
+  const Node *node = node_at(compiler, id);
+  if (node->kind == NODE_ERROR) {
+    // Reported by the parser
+    compiler->panic = 1;
+    return NULL;
+  }
+  if (node->kind == NODE_MEMBER) {
+    report_unsupported(compiler, node->token,
+                       "Members are not supported yet");
+    return NULL;
+  }
+  if (node->kind != NODE_IDENTIFIER) {
+    report_type_error(compiler, token, "Only variables and items can be "
+                                       "assigned");
+    return NULL;
+  }
+  Variable *variable = find_variable(compiler, node->token);
+  if (variable == NULL)
+    report_type_error(compiler, node->token, "Variable is not declared");
+  return variable;
+}
+
+/**
+ * Compile both operands of a binary operation. A literal is compiled after
+ * the other operand so it can take its type, literals have no side effect
+ * @param compiler
+ * @param node
+ * @param left
+ * @param right
+ */
+static void compile_operands(Compiler *compiler, const Node *node,
+                             Operand *left, Operand *right) {
+  NodeId left_id = node->binary.left, right_id = node->binary.right;
+  if (node_at(compiler, left_id)->kind == NODE_LITERAL &&
+      node_at(compiler, right_id)->kind != NODE_LITERAL) {
+    *right = compile_expression(compiler, right_id, VALUE_VOID);
+    *left = compile_expression(compiler, left_id, right->type);
+  } else {
+    *left = compile_expression(compiler, left_id, VALUE_VOID);
+    *right = compile_expression(compiler, right_id, left->type);
+  }
+}
+
+static Operand compile_comparison(Compiler *compiler, const Node *node,
+                                  TokenType op, Operand left, Operand right,
+                                  i64 reg) {
+  ValueType type = arithmetic_type(left.type, right.type);
+  if (left.type == VALUE_BOOLEAN && right.type == VALUE_BOOLEAN &&
+      (op == EQUAL || op == NOT_EQUAL))
+    type = VALUE_BOOLEAN;
+  if (type == VALUE_VOID) {
+    report_type_error(compiler, node->token, "Operator needs numbers");
+    return (Operand){reg, VALUE_BOOLEAN, NO_INSTRUCTION};
+  }
+  left = convert(compiler, left, type, node->token);
+  right = convert(compiler, right, type, node->token);
+
+  // a > b is b < a, a >= b is b <= a
+  if (op == GREATER_THEN || op == GREATER_EQUAL) {
+    Operand swap = left;
+    left = right, right = swap;
+  }
+
+  OpCode opcode;
+  i8 f32 = type == VALUE_F32, f64 = type == VALUE_F64;
+  switch (op) {
+  case EQUAL:
+    opcode = f32 ? OP_EQ_F32 : f64 ? OP_EQ_F64 : OP_EQ_I64;
+    break;
+  case NOT_EQUAL:
+    opcode = f32 ? OP_NE_F32 : f64 ? OP_NE_F64 : OP_NE_I64;
+    break;
+  case LESS_THEN:
+  case GREATER_THEN:
+    opcode = f32 ? OP_LT_F32 : f64 ? OP_LT_F64 : OP_LT_I64;
+    break;
+  default:
+    opcode = f32 ? OP_LE_F32 : f64 ? OP_LE_F64 : OP_LE_I64;
+    break;
+  }
+
+  Operand result = {.reg = reg, .type = VALUE_BOOLEAN};
+  result.producer =
+      emit(compiler, opcode, reg, left.reg, right.reg, node->token);
+  return result;
+}
+
+static Operand compile_bitwise(Compiler *compiler, const Node *node,
+                               TokenType op, Operand left, Operand right,
+                               i64 reg) {
+  if (!is_integer(left.type) || !is_integer(right.type)) {
+    report_type_error(compiler, node->token, "Operator needs integers");
+    return (Operand){reg, VALUE_I64, NO_INSTRUCTION};
+  }
+
+  ValueType type = arithmetic_type(left.type, right.type);
+  OpCode opcode;
+  switch (op) {
+  case BITWISE_AND:
+    opcode = OP_BITWISE_AND;
+    break;
+  case BITWISE_OR:
+    opcode = OP_BITWISE_OR;
+    break;
+  case BITWISE_XOR:
+    opcode = OP_BITWISE_XOR;
+    break;
+  case LEFT_SHIFT:
+    opcode = OP_LEFT_SHIFT;
+    break;
+  default:
+    opcode = OP_RIGHT_SHIFT;
+    break;
+  }
+
+  Operand result = {.reg = reg, .type = type};
+  result.producer =
+      emit(compiler, opcode, reg, left.reg, right.reg, node->token);
+  // Only a left shift can carry bits past the width of the type
+  if (opcode == OP_LEFT_SHIFT && type != VALUE_I64)
+    result = emit_unary(compiler, wrap_opcode(type), result, type,
+                        node->token);
+  return result;
+}
+
+/**
+ * && and || only evaluate their right operand when it decides the result
+ * @param compiler
+ * @param node
+ * @param op
+ * @param left compiled already
+ * @param reg destination
+ * @return the result
+ */
+static Operand compile_logical(Compiler *compiler, const Node *node,
+                               TokenType op, Operand left, i64 reg) {
+  left = convert(compiler, left, VALUE_BOOLEAN, node->token);
+  move_to(compiler, left, reg, node->token);
+  compiler->registers = reg + 1;
+
+  i64 jump = emit_jump(compiler, op == AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE,
+                       reg, node->token);
+  Operand right =
+      compile_expression(compiler, node->binary.right, VALUE_BOOLEAN);
+  right = convert(compiler, right, VALUE_BOOLEAN, node->token);
+  move_to(compiler, right, reg, node->token);
+  patch_jump(compiler, jump, next_instruction(compiler));
+  return (Operand){reg, VALUE_BOOLEAN, NO_INSTRUCTION};
+}
+
+/**
+ * Apply a binary operator other than && and || to compiled operands
+ * @param compiler
+ * @param node
+ * @param left
+ * @param right
+ * @param reg destination
+ * @return the result
+ */
+static Operand compile_operator(Compiler *compiler, const Node *node,
+                                Operand left, Operand right, i64 reg) {
+  TokenType op = compiler->tokens->types[node->token];
+  Arithmetic arithmetic;
+
+  switch (op) {
+  case EQUAL:
+  case NOT_EQUAL:
+  case LESS_THEN:
+  case GREATER_THEN:
+  case LESS_EQUAL:
+  case GREATER_EQUAL:
+    return compile_comparison(compiler, node, op, left, right, reg);
+  case BITWISE_AND:
+  case BITWISE_OR:
+  case BITWISE_XOR:
+  case LEFT_SHIFT:
+  case RIGHT_SHIFT:
+    return compile_bitwise(compiler, node, op, left, right, reg);
+  default:
+    break;
+  }
+
+  if (!token_arithmetic(op, &arithmetic)) {
+    report_type_error(compiler, node->token, "Unknown binary operator");
+    return (Operand){reg, VALUE_I64, NO_INSTRUCTION};
+  }
+
+  ValueType type = arithmetic_type(left.type, right.type);
+  if (type == VALUE_VOID) {
+    report_type_error(compiler, node->token, "Operator needs numbers");
+    return (Operand){reg, VALUE_I64, NO_INSTRUCTION};
+  }
+  left = convert(compiler, left, type, node->token);
+  right = convert(compiler, right, type, node->token);
+  return emit_arithmetic(compiler, arithmetic, left, right, type, reg,
+                         node->token);
+}
+
+static i8 is_logical(Compiler *compiler, const Node *node) {
+  TokenType op = compiler->tokens->types[node->token];
+  return op == AND || op == OR;
+}
+
+/**
+ * Binary operators are left associative, so a chain as 1 + 1 + ... + 1
+ * nests on its left operand as deep as it is long. The left operands are
+ * walked down and the chain compiled from the bottom in a loop, only the
+ * right operands recurse
+ * @param compiler
+ * @param id
+ * @return the result
+ */
+static Operand compile_binary(Compiler *compiler, NodeId id) {
+  const Node *node = node_at(compiler, id);
+  // Every operator of the chain writes its result to the register of the
+  // first temporary operand
+  i64 reg = alloc_register(compiler, node->token);
+  compiler->registers = reg;
+
+  i64 base = compiler->chain_length;
+  while (node_at(compiler, node->binary.left)->kind == NODE_BINARY) {
+    if (!push_index(compiler, &compiler->chain, &compiler->chain_length,
+                    &compiler->chain_capacity, id)) {
+      compiler->chain_length = base;
+      return (Operand){reg, VALUE_I64, NO_INSTRUCTION};
+    }
+    id = node->binary.left;
+    node = node_at(compiler, id);
+  }
+
+  Operand left, right;
+  if (is_logical(compiler, node)) {
+    left = compile_expression(compiler, node->binary.left, VALUE_BOOLEAN);
+    left = compile_logical(compiler, node, compiler->tokens->types[node->token],
+                           left, reg);
+  } else {
+    compile_operands(compiler, node, &left, &right);
+    left = compile_operator(compiler, node, left, right, reg);
+  }
+
+  // Each result is the left operand of the operator above it
+  while (compiler->chain_length > base) {
+    node = node_at(compiler, compiler->chain[--compiler->chain_length]);
+    compiler->registers = reg + 1;
+    if (is_logical(compiler, node))
+      left = compile_logical(compiler, node,
+                             compiler->tokens->types[node->token], left, reg);
+    else {
+      right = compile_expression(compiler, node->binary.right, left.type);
+      left = compile_operator(compiler, node, left, right, reg);
+    }
+  }
+  return left;
+}
+
+/**
+ * Compile the array or the string and the index of an index expression
+ * @param compiler
+ * @param node
+ * @param object
+ * @param index
+ * @return false after reporting an error
+ */
+static i8 compile_subscript(Compiler *compiler, const Node *node,
+                            Operand *object, Operand *index) {
+  *object = compile_expression(compiler, node->binary.left, VALUE_VOID);
+  *index = compile_expression(compiler, node->binary.right, VALUE_I64);
+  if (!is_reference(object->type)) {
+    report_type_error(compiler, node->token,
+                      "Only arrays and strings can be indexed");
+    return 0;
+  }
+  if (!is_integer(index->type)) {
+    report_type_error(compiler, node->token, "Index must be an integer");
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Compile the array and the index of an item an assignment or an
+ * increment writes
+ * @param compiler
+ * @param node index node
+ * @param array
+ * @param index
+ * @return false after reporting an error
+ */
+static i8 compile_item_target(Compiler *compiler, const Node *node,
+                              Operand *array, Operand *index) {
+  if (!compile_subscript(compiler, node, array, index))
+    return 0;
+  if (array->type == VALUE_STRING) {
+    report_type_error(compiler, node->token, "Strings can't be changed");
+    return 0;
+  }
+  return 1;
+}
+
+static Operand load_item(Compiler *compiler, Operand array, Operand index,
+                         i64 token) {
+  Operand item = {.type = item_type(array.type)};
+  item.reg = alloc_register(compiler, token);
+  item.producer =
+      emit(compiler, OP_GET_INDEX, item.reg, array.reg, index.reg, token);
+  return item;
+}
+
+/**
+ * Value of x op= value from the value of x
+ * @param compiler
+ * @param node assignment
+ * @param left value of x
+ * @return the value to store, not converted back to the type of x yet
+ */
+static Operand compile_compound(Compiler *compiler, const Node *node,
+                                Operand left) {
+  Arithmetic arithmetic = ARITHMETIC_ADD;
+  token_arithmetic(compiler->tokens->types[node->token], &arithmetic);
+  Operand right = compile_expression(compiler, node->binary.right, left.type);
+  ValueType type = arithmetic_type(left.type, right.type);
+  if (type == VALUE_VOID) {
+    report_type_error(compiler, node->token, "Operator needs numbers");
+    return right;
+  }
+  left = convert(compiler, left, type, node->token);
+  right = convert(compiler, right, type, node->token);
+  return emit_arithmetic(compiler, arithmetic, left, right, type,
+                         result_register(compiler, right, node->token),
+                         node->token);
+}
+
+/**
+ * a[i] = value, a[i] += value... The array and the index are compiled once
+ * @param compiler
+ * @param node
+ * @return the value assigned
+ */
+static Operand compile_item_assignment(Compiler *compiler, const Node *node) {
+  Operand array, index;
+  if (!compile_item_target(compiler, node_at(compiler, node->binary.left),
+                           &array, &index))
+    return load_zero(compiler, VALUE_I64, node->token);
+
+  ValueType type = item_type(array.type);
+  Operand value;
+  if (compiler->tokens->types[node->token] == ASSIGNMENT_OPERATOR)
+    value = compile_expression(compiler, node->binary.right, type);
+  else
+    value = compile_compound(compiler, node,
+                             load_item(compiler, array, index, node->token));
+  value = convert(compiler, value, type, node->token);
+  emit(compiler, OP_SET_INDEX, array.reg, index.reg, value.reg, node->token);
+  // The store reads the register, it must not be rewritten
+  return (Operand){value.reg, value.type, NO_INSTRUCTION};
+}
+
+/**
+ * x = value, x += value...
+ * @param compiler
+ * @param node
+ * @return the value assigned
+ */
+static Operand compile_assignment(Compiler *compiler, const Node *node) {
+  if (node_at(compiler, node->binary.left)->kind == NODE_INDEX)
+    return compile_item_assignment(compiler, node);
+
+  Variable *variable =
+      assignment_target(compiler, node->binary.left, node->token);
+  if (variable == NULL)
+    return load_zero(compiler, VALUE_I64, node->token);
+  // The variables may move while the value is compiled
+  Variable target = *variable;
+
+  Operand value;
+  if (compiler->tokens->types[node->token] == ASSIGNMENT_OPERATOR)
+    value = compile_expression(compiler, node->binary.right, target.type);
+  else
+    value = compile_compound(compiler, node,
+                             load_variable(compiler, &target, node->token));
+
+  value = convert(compiler, value, target.type, node->token);
+  store_variable(compiler, &target, value, node->token);
+  if (!is_global(&target))
+    return (Operand){target.index, target.type, NO_INSTRUCTION};
+  return (Operand){value.reg, value.type, NO_INSTRUCTION};
+}
+
+/**
+ * ++a[i], --a[i], a[i]++ and a[i]--
+ * @param compiler
+ * @param node
+ * @param postfix true if the result is the value before the increment
+ * @return the result
+ */
+static Operand compile_item_increment(Compiler *compiler, const Node *node,
+                                      i8 postfix) {
+  Operand array, index;
+  if (!compile_item_target(compiler, node_at(compiler, node->unary.operand),
+                           &array, &index))
+    return load_zero(compiler, VALUE_I64, node->token);
+  ValueType type = item_type(array.type);
+  if (!is_integer(type) && !is_float(type)) {
+    report_type_error(compiler, node->token, "Operator needs numbers");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+
+  Arithmetic arithmetic = ARITHMETIC_ADD;
+  token_arithmetic(compiler->tokens->types[node->token], &arithmetic);
+  Operand before = load_item(compiler, array, index, node->token);
+  Operand one = load_one(compiler, type, node->token);
+  Operand after =
+      emit_arithmetic(compiler, arithmetic, before, one, type,
+                      alloc_register(compiler, node->token), node->token);
+  emit(compiler, OP_SET_INDEX, array.reg, index.reg, after.reg, node->token);
+  Operand result = postfix ? before : after;
+  return (Operand){result.reg, type, NO_INSTRUCTION};
+}
+
+/**
+ * ++x, --x, x++ and x--
+ * @param compiler
+ * @param node
+ * @param postfix true if the result is the value before the increment
+ * @return the result
+ */
+static Operand compile_increment(Compiler *compiler, const Node *node,
+                                 i8 postfix) {
+  if (node_at(compiler, node->unary.operand)->kind == NODE_INDEX)
+    return compile_item_increment(compiler, node, postfix);
+
+  Variable *variable =
+      assignment_target(compiler, node->unary.operand, node->token);
+  if (variable == NULL)
+    return load_zero(compiler, VALUE_I64, node->token);
+  Variable target = *variable;
+  if (!is_integer(target.type) && !is_float(target.type)) {
+    report_type_error(compiler, node->token, "Operator needs numbers");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+
+  Operand value = load_variable(compiler, &target, node->token);
+  Operand before = value;
+  if (postfix && !is_global(&target)) {
+    before.reg = alloc_register(compiler, node->token);
+    before.producer = NO_INSTRUCTION;
+    emit(compiler, OP_MOVE, before.reg, value.reg, 0, node->token);
+  }
+
+  Arithmetic arithmetic = ARITHMETIC_ADD;
+  token_arithmetic(compiler->tokens->types[node->token], &arithmetic);
+  Operand one = load_one(compiler, target.type, node->token);
+  i64 reg = is_global(&target)
+                ? alloc_register(compiler, node->token)
+                : target.index;
+  Operand after = emit_arithmetic(compiler, arithmetic, value, one,
+                                  target.type, reg, node->token);
+  if (is_global(&target))
+    store_variable(compiler, &target, after, node->token);
+  return postfix ? before : after;
+}
+
+/**
+ * Size of the values of a type in bytes, the width the VM works with
+ * @param type
+ * @return the size, 0 for the types without one
+ */
+static i64 value_size(ValueType type) {
+  switch (type) {
+  case VALUE_BOOLEAN:
+  case VALUE_I8:
+    return 1;
+  case VALUE_I16:
+    return 2;
+  case VALUE_I32:
+  case VALUE_F32:
+    return 4;
+  case VALUE_I64:
+  case VALUE_F64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * typeof x is the name of the type of x, sizeof x the size of its values.
+ * As in C the operand never runs, it is compiled for its type and its code
+ * dropped
+ * @param compiler
+ * @param node
+ * @param op TYPEOF or SIZEOF
+ * @return the result
+ */
+static Operand compile_type_query(Compiler *compiler, const Node *node,
+                                  TokenType op) {
+  i64 length = current_function(compiler)->length;
+  i64 registers = compiler->registers;
+  Operand operand =
+      compile_expression(compiler, node->unary.operand, VALUE_VOID);
+  current_function(compiler)->length = length;
+  compiler->registers = registers;
+
+  if (op == TYPEOF) {
+    const char *name = value_type_string(operand.type);
+    return load_string(compiler, name, strlen(name), node->token);
+  }
+  Value value = {.i = value_size(operand.type)};
+  if (value.i == 0)
+    report_type_error(compiler, node->token,
+                      "sizeof needs a number or a boolean");
+  return load_constant(compiler, value, VALUE_I64, node->token);
+}
+
+static Operand compile_unary(Compiler *compiler, const Node *node,
+                             ValueType hint) {
+  TokenType op = compiler->tokens->types[node->token];
+  if (op == INCREMENT || op == DECREMENT)
+    return compile_increment(compiler, node, 0);
+  if (op == TYPEOF || op == SIZEOF)
+    return compile_type_query(compiler, node, op);
+
+  // A negative integer literal is loaded as is, it could not be written
+  // otherwise when its absolute value doesn't fit, as in -128i8
+  const Node *operand_node = node_at(compiler, node->unary.operand);
+  if (op == MINUS && operand_node->kind == NODE_LITERAL) {
+    TokenType literal = compiler->tokens->types[operand_node->token];
+    if (literal == INT_LITERAL || literal == BINARY_LITERAL ||
+        literal == OCT_LITERAL || literal == HEX_LITERAL)
+      return compile_literal(compiler, operand_node, hint, 1);
+  }
+
+  Operand operand = compile_expression(compiler, node->unary.operand, hint);
+  switch (op) {
+  case PLUS:
+  case MINUS:
+    if (!is_integer(operand.type) && !is_float(operand.type)) {
+      report_type_error(compiler, node->token, "Operator needs numbers");
+      return operand;
+    }
+    if (op == PLUS)
+      return operand;
+    return emit_arithmetic(compiler, ARITHMETIC_NEG, operand, operand,
+                           operand.type,
+                           result_register(compiler, operand, node->token),
+                           node->token);
+
+  case NOT:
+    if (operand.type != VALUE_BOOLEAN && !is_integer(operand.type)) {
+      report_type_error(compiler, node->token, "Operator needs a boolean");
+      return operand;
+    }
+    return emit_unary(compiler, OP_NOT, operand, VALUE_BOOLEAN, node->token);
+
+  case BITWISE_NOT:
+    if (!is_integer(operand.type)) {
+      report_type_error(compiler, node->token, "Operator needs integers");
+      return operand;
+    }
+    return emit_unary(compiler, OP_BITWISE_NOT, operand, operand.type,
+                      node->token);
+
+  default:
+    report_type_error(compiler, node->token, "Unknown unary operator");
+    return operand;
+  }
+}
+
+/**
+ * condition ? then : otherwise. The type of the result is only known once
+ * both branches are compiled, the then branch jumps over the otherwise one
+ * to a conversion when it needs one
+ * @param compiler
+ * @param node
+ * @param hint
+ * @return the result
+ */
+static Operand compile_ternary(Compiler *compiler, const Node *node,
+                               ValueType hint) {
+  i64 reg = alloc_register(compiler, node->token);
+  Operand condition =
+      compile_expression(compiler, node->branch.condition, VALUE_BOOLEAN);
+  condition = convert(compiler, condition, VALUE_BOOLEAN, node->token);
+  i64 otherwise_jump =
+      emit_jump(compiler, OP_JUMP_IF_FALSE, condition.reg, node->token);
+
+  compiler->registers = reg + 1;
+  Operand then = compile_expression(compiler, node->branch.then, hint);
+  move_to(compiler, then, reg, node->token);
+  i64 end_jump = emit_jump(compiler, OP_JUMP, 0, node->token);
+
+  patch_jump(compiler, otherwise_jump, next_instruction(compiler));
+  compiler->registers = reg + 1;
+  Operand otherwise =
+      compile_expression(compiler, node->branch.otherwise, then.type);
+  ValueType type = arithmetic_type(then.type, otherwise.type);
+  if (type == VALUE_VOID)
+    type = then.type;
+  otherwise = convert(compiler, otherwise, type, node->token);
+  move_to(compiler, otherwise, reg, node->token);
+
+  if (type != then.type) {
+    i64 skip = emit_jump(compiler, OP_JUMP, 0, node->token);
+    patch_jump(compiler, end_jump, next_instruction(compiler));
+    Operand converted =
+        convert(compiler, (Operand){reg, then.type, NO_INSTRUCTION}, type,
+                node->token);
+    move_to(compiler, converted, reg, node->token);
+    end_jump = skip;
+  }
+  patch_jump(compiler, end_jump, next_instruction(compiler));
+  compiler->registers = reg + 1;
+  return (Operand){reg, type, NO_INSTRUCTION};
+}
+
+/**
+ * Arguments are moved to consecutive registers, the callee frame starts at
+ * the first one and its result lands there
+ * @param compiler
+ * @param node
+ * @return the result
+ */
+static Operand compile_call(Compiler *compiler, const Node *node) {
+  const Node *callee = node_at(compiler, node->call.callee);
+  if (callee->kind != NODE_IDENTIFIER) {
+    report_type_error(compiler, node->token, "Only functions can be called");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+  i64 index = find_function(compiler, callee->token);
+  if (index == 0) {
+    report_type_error(compiler, callee->token, "Function is not declared");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+
+  const Function *function = &compiler->program->functions[index];
+  NodeList arguments = node->call.arguments;
+  if (arguments.length != function->arity) {
+    report_type_error(compiler, node->token,
+                      "Wrong number of arguments in the call");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+
+  i64 base = compiler->registers;
+  for (i64 i = 0; i < arguments.length; i++) {
+    ValueType type = function->parameters[i];
+    NodeId argument = compiler->ast->extra[arguments.start + i];
+    compiler->registers = base + i;
+    i64 reg = alloc_register(compiler, node->token);
+    Operand value = compile_expression(compiler, argument, type);
+    value = convert(compiler, value, type, node->token);
+    move_to(compiler, value, reg, node->token);
+  }
+  compiler->registers = base;
+  alloc_register(compiler, node->token);
+
+  emit(compiler, OP_CALL, base, index, arguments.length, node->token);
+  return (Operand){base, function->type, NO_INSTRUCTION};
+}
+
+/**
+ * [a, b, ...] The items are moved to consecutive registers and copied to a
+ * new array. Their type is the one of the items of the hinted array type,
+ * or else the one of the first item
+ * @param compiler
+ * @param node
+ * @param hint
+ * @return the array
+ */
+static Operand compile_array(Compiler *compiler, const Node *node,
+                             ValueType hint) {
+  NodeList items = node->list;
+  ValueType type = is_array(hint) ? item_type(hint) : VALUE_VOID;
+  if (items.length == 0) {
+    if (type == VALUE_VOID)
+      report_type_error(compiler, node->token,
+                        "Type of the empty array is unknown");
+    // A null array is an empty one
+    return load_zero(compiler, array_of(type), node->token);
+  }
+
+  i64 base = compiler->registers;
+  for (i64 i = 0; i < items.length; i++) {
+    NodeId item = compiler->ast->extra[items.start + i];
+    compiler->registers = base + i;
+    i64 reg = alloc_register(compiler, node->token);
+    Operand value = compile_expression(compiler, item, type);
+    if (type == VALUE_VOID)
+      type = value.type;
+    value = convert(compiler, value, type, node->token);
+    move_to(compiler, value, reg, node->token);
+  }
+  compiler->registers = base;
+  if (is_array(type))
+    report_unsupported(compiler, node->token,
+                       "Arrays of arrays are not supported yet");
+  if (is_array(type) || type == VALUE_VOID)
+    return load_zero(compiler, VALUE_I64, node->token);
+
+  Operand array = {.type = array_of(type)};
+  array.reg = alloc_register(compiler, node->token);
+  array.producer =
+      emit(compiler, OP_ARRAY, array.reg, base, items.length, node->token);
+  return array;
+}
+
+static Operand compile_index(Compiler *compiler, const Node *node) {
+  // The result reuses the register of the first temporary operand
+  i64 reg = alloc_register(compiler, node->token);
+  compiler->registers = reg;
+  Operand object, index;
+  if (!compile_subscript(compiler, node, &object, &index))
+    return (Operand){reg, VALUE_I64, NO_INSTRUCTION};
+
+  // The chars of a string are i8, as char is
+  i8 string = object.type == VALUE_STRING;
+  Operand result = {.reg = reg,
+                    .type = string ? VALUE_I8 : item_type(object.type)};
+  result.producer = emit(compiler, string ? OP_GET_CHAR : OP_GET_INDEX, reg,
+                         object.reg, index.reg, node->token);
+  return result;
+}
+
+/**
+ * x::len() is the only method, the length of an array or a string
+ * @param compiler
+ * @param node
+ * @return the result
+ */
+static Operand compile_method_call(Compiler *compiler, const Node *node) {
+  Operand object =
+      compile_expression(compiler, node->call.callee, VALUE_VOID);
+  if (!is_named(compiler, node->token, "len")) {
+    report_type_error(compiler, node->token, "Method is not declared");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+  if (!is_reference(object.type)) {
+    report_type_error(compiler, node->token,
+                      "Only arrays and strings have a length");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+  if (node->call.arguments.length != 0) {
+    report_type_error(compiler, node->token,
+                      "Wrong number of arguments in the call");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+  return emit_unary(compiler, OP_LENGTH, object, VALUE_I64, node->token);
+}
+
+static Operand compile_expression_kind(Compiler *compiler, NodeId id,
+                                       ValueType hint) {
+  const Node *node = node_at(compiler, id);
+  Variable *variable;
+
+  switch (node->kind) {
+  case NODE_LITERAL:
+    return compile_literal(compiler, node, hint, 0);
+
+  case NODE_IDENTIFIER:
+    variable = find_variable(compiler, node->token);
+    if (variable == NULL) {
+      report_type_error(compiler, node->token, "Variable is not declared");
+      return load_zero(compiler, VALUE_I64, node->token);
+    }
+    return load_variable(compiler, variable, node->token);
+
+  case NODE_BINARY:
+    return compile_binary(compiler, id);
+  case NODE_ASSIGNMENT:
+    return compile_assignment(compiler, node);
+  case NODE_UNARY:
+    return compile_unary(compiler, node, hint);
+  case NODE_POSTFIX:
+    return compile_increment(compiler, node, 1);
+  case NODE_TERNARY:
+    return compile_ternary(compiler, node, hint);
+  case NODE_CALL:
+    return compile_call(compiler, node);
+  case NODE_ARRAY:
+    return compile_array(compiler, node, hint);
+  case NODE_INDEX:
+    return compile_index(compiler, node);
+  case NODE_METHOD_CALL:
+    return compile_method_call(compiler, node);
+
+  case NODE_MEMBER:
+    report_unsupported(compiler, node->token,
+                       "Members are not supported yet");
+    return load_zero(compiler, VALUE_I64, node->token);
+
+  case NODE_ERROR:
+    // Reported by the parser
+    compiler->panic = 1;
+    return load_zero(compiler, VALUE_I64, node->token);
+
+  default:
+    report_type_error(compiler, node->token, "Expected an expression");
+    return load_zero(compiler, VALUE_I64, node->token);
+  }
+}
+
+/**
+ * Compile an expression to a register
+ * @param compiler
+ * @param id
+ * @param hint type the value will be converted to, VALUE_VOID if unknown.
+ * Only literals use it, the result may have another type
+ * @return the register holding the value and its type
+ */
+static Operand compile_expression(Compiler *compiler, NodeId id,
+                                  ValueType hint) {
+  // Postfix chains as a[0][0]... have no nesting limit in the parser
+  if (compiler->depth >= COMPILER_MAX_DEPTH) {
+    i64 token = node_at(compiler, id)->token;
+    report_unsupported(compiler, token, "Expression is nested too deeply");
+    return load_zero(compiler, VALUE_I64, token);
+  }
+
+  compiler->depth++;
+  Operand operand = compile_expression_kind(compiler, id, hint);
+  compiler->depth--;
+  // The next temporaries must not overwrite the result
+  if (operand.reg >= compiler->locals && operand.reg >= compiler->registers)
+    compiler->registers = operand.reg + 1;
+  return operand;
+}
+
+/**
+ * Compile an expression whose value is unused: x++ needs no copy of x then
+ * @param compiler
+ * @param id
+ */
+static void compile_effect(Compiler *compiler, NodeId id) {
+  const Node *node = node_at(compiler, id);
+  if (node->kind == NODE_POSTFIX)
+    compile_increment(compiler, node, 0);
+  else
+    compile_expression(compiler, id, VALUE_VOID);
+}
+
+/**
+ * Compile a condition, the register tested by a conditional jump
+ * @param compiler
+ * @param id
+ * @return the register
+ */
+static i64 compile_condition(Compiler *compiler, NodeId id) {
+  const Node *node = node_at(compiler, id);
+  Operand condition = compile_expression(compiler, id, VALUE_BOOLEAN);
+  if (condition.type != VALUE_BOOLEAN && !is_integer(condition.type))
+    report_type_error(compiler, node->token,
+                      "Condition must be a boolean or an integer");
+  return condition.reg;
+}
+
+/**
+ * Size written in an array type, when it is a literal
+ * @param compiler
+ * @param id type node
+ * @param size set to the size
+ * @return true if the type has a literal size
+ */
+static i8 literal_size(Compiler *compiler, NodeId id, i64 *size) {
+  const Node *type = node_at(compiler, id);
+  if (type->kind != NODE_ARRAY_TYPE || type->type.size == NO_NODE)
+    return 0;
+  const Node *literal = node_at(compiler, type->type.size);
+  if (literal->kind != NODE_LITERAL ||
+      !is_number_type(compiler->tokens->types[literal->token]) ||
+      compiler->tokens->types[literal->token] == FLOAT_LITERAL)
+    return 0;
+  *size = get_token(compiler->tokens, literal->token).number.integer;
+  return 1;
+}
+
+/**
+ * Array of the size written in its type, with its items zeroed
+ * @param compiler
+ * @param node array type
+ * @param type
+ * @return the array
+ */
+static Operand compile_new_array(Compiler *compiler, const Node *node,
+                                 ValueType type) {
+  Operand size = compile_expression(compiler, node->type.size, VALUE_I64);
+  if (!is_integer(size.type)) {
+    report_type_error(compiler, node->token, "Array size must be an integer");
+    return load_zero(compiler, type, node->token);
+  }
+  return emit_unary(compiler, OP_NEW_ARRAY, size, type, node->token);
+}
+
+/**
+ * name: type = value, name: type or name := value. Without a value the
+ * variable is zeroed, an array with a size in its type gets that many
+ * items. The size is only checked against array literals otherwise, as
+ * arrays of any length can be assigned later
+ * @param compiler
+ * @param node
+ */
+static void compile_variable(Compiler *compiler, const Node *node) {
+  ValueType type = VALUE_VOID;
+  if (node->variable.type != NO_NODE) {
+    type = resolve_type(compiler, node->variable.type);
+    if (type == VALUE_VOID)
+      report_type_error(compiler, node->token, "Variable can't be void");
+  }
+
+  i64 reg = compiler->registers;
+  Operand value;
+  i64 size;
+  if (node->variable.value != NO_NODE) {
+    const Node *initializer = node_at(compiler, node->variable.value);
+    if (node->variable.type != NO_NODE && initializer->kind == NODE_ARRAY &&
+        literal_size(compiler, node->variable.type, &size) &&
+        size != initializer->list.length)
+      report_type_error(compiler, node->token,
+                        "Array literal doesn't have the size of its type");
+    value = compile_expression(compiler, node->variable.value, type);
+    if (node->variable.type == NO_NODE)
+      type = value.type;
+    if (type == VALUE_VOID)
+      report_type_error(compiler, node->token, "Expression has no value");
+    value = convert(compiler, value, type, node->token);
+  } else if (node->variable.type != NO_NODE && is_array(type) &&
+             node_at(compiler, node->variable.type)->type.size != NO_NODE)
+    value = compile_new_array(compiler, node_at(compiler, node->variable.type),
+                              type);
+  else
+    value = load_zero(compiler, type, node->token);
+
+  if (compiler->scope == 0) {
+    i64 index = 0;
+    if (!append_global(compiler->program, type, &index))
+      compiler->out_of_memory = 1;
+    emit_bx(compiler, OP_SET_GLOBAL, value.reg, index, node->token);
+    declare_variable(compiler, node->token, type, index);
+    return;
+  }
+
+  compiler->registers = reg;
+  alloc_register(compiler, node->token);
+  move_to(compiler, value, reg, node->token);
+  declare_variable(compiler, node->token, type, reg);
+  compiler->locals = reg + 1;
+}
+
+static void compile_block(Compiler *compiler, const Node *node) {
+  begin_scope(compiler);
+  for (i64 i = 0; i < node->list.length; i++)
+    compile_statement(compiler, compiler->ast->extra[node->list.start + i]);
+  end_scope(compiler);
+}
+
+static void compile_if(Compiler *compiler, const Node *node) {
+  i64 condition = compile_condition(compiler, node->branch.condition);
+  i64 otherwise_jump =
+      emit_jump(compiler, OP_JUMP_IF_FALSE, condition, node->token);
+  compiler->registers = compiler->locals;
+  begin_scope(compiler);
+  compile_statement(compiler, node->branch.then);
+  end_scope(compiler);
+
+  if (node->branch.otherwise == NO_NODE) {
+    patch_jump(compiler, otherwise_jump, next_instruction(compiler));
+    return;
+  }
+  i64 end_jump = emit_jump(compiler, OP_JUMP, 0, node->token);
+  patch_jump(compiler, otherwise_jump, next_instruction(compiler));
+  begin_scope(compiler);
+  compile_statement(compiler, node->branch.otherwise);
+  end_scope(compiler);
+  patch_jump(compiler, end_jump, next_instruction(compiler));
+}
+
+/**
+ * Compile a loop with its condition at the bottom, one jump per iteration:
+ * init, jump to the condition, body, step, condition jumping back to the
+ * body. continue goes to the step, break past the condition
+ * @param compiler
+ * @param node
+ * @param init may be NO_NODE
+ * @param condition may be NO_NODE, the loop is endless then
+ * @param step may be NO_NODE
+ * @param body
+ * @param test_first false for do while loops
+ */
+static void compile_loop(Compiler *compiler, const Node *node, NodeId init,
+                         NodeId condition, NodeId step, NodeId body,
+                         i8 test_first) {
+  begin_scope(compiler);
+  if (init != NO_NODE)
+    compile_statement(compiler, init);
+
+  i64 condition_jump = 0;
+  if (test_first && condition != NO_NODE)
+    condition_jump = emit_jump(compiler, OP_JUMP, 0, node->token);
+
+  i64 breaks = compiler->breaks_length;
+  i64 continues = compiler->continues_length;
+  compiler->loops++;
+  i64 start = next_instruction(compiler);
+  compile_statement(compiler, body);
+  compiler->loops--;
+
+  patch_jumps(compiler, compiler->continues, &compiler->continues_length,
+              continues, next_instruction(compiler));
+  if (step != NO_NODE) {
+    compiler->panic = 0;
+    compile_effect(compiler, step);
+    compiler->registers = compiler->locals;
+  }
+
+  if (condition == NO_NODE)
+    patch_jump(compiler, emit_jump(compiler, OP_JUMP, 0, node->token), start);
+  else {
+    if (test_first)
+      patch_jump(compiler, condition_jump, next_instruction(compiler));
+    compiler->panic = 0;
+    i64 reg = compile_condition(compiler, condition);
+    patch_jump(compiler, emit_jump(compiler, OP_JUMP_IF_TRUE, reg, node->token),
+               start);
+    compiler->registers = compiler->locals;
+  }
+  patch_jumps(compiler, compiler->breaks, &compiler->breaks_length, breaks,
+              next_instruction(compiler));
+  end_scope(compiler);
+}
+
+static void compile_return(Compiler *compiler, const Node *node) {
+  if (compiler->function == 0) {
+    report_type_error(compiler, node->token, "Return outside of a function");
+    return;
+  }
+
+  ValueType type = current_function(compiler)->type;
+  if (node->unary.operand == NO_NODE) {
+    if (type != VALUE_VOID)
+      report_type_error(compiler, node->token, "Function must return a value");
+    emit(compiler, OP_RETURN_VOID, 0, 0, 0, node->token);
+    return;
+  }
+  if (type == VALUE_VOID) {
+    report_type_error(compiler, node->token,
+                      "Function doesn't return a value");
+    return;
+  }
+
+  Operand value = compile_expression(compiler, node->unary.operand, type);
+  value = convert(compiler, value, type, node->token);
+  emit(compiler, OP_RETURN, value.reg, 0, 0, node->token);
+}
+
+static void compile_jump(Compiler *compiler, const Node *node) {
+  if (compiler->loops == 0) {
+    report_type_error(compiler, node->token, "Jump outside of a loop");
+    return;
+  }
+  i64 jump = emit_jump(compiler, OP_JUMP, 0, node->token);
+  if (node->kind == NODE_BREAK)
+    push_index(compiler, &compiler->breaks, &compiler->breaks_length,
+              &compiler->breaks_capacity, jump);
+  else
+    push_index(compiler, &compiler->continues, &compiler->continues_length,
+              &compiler->continues_capacity, jump);
+}
+
+/**
+ * Compile the body of a function declared by declare_functions
+ * @param compiler
+ * @param node
+ * @param index of the function
+ */
+static void compile_function(Compiler *compiler, const Node *node,
+                             i64 index) {
+  i64 function = compiler->function, locals = compiler->locals,
+      registers = compiler->registers, loops = compiler->loops;
+  compiler->function = index;
+  compiler->locals = compiler->registers = compiler->loops = 0;
+  begin_scope(compiler);
+
+  Function *declared = current_function(compiler);
+  for (i64 i = 0; i < node->function.parameters.length; i++) {
+    NodeId parameter =
+        compiler->ast->extra[node->function.parameters.start + i];
+    i64 reg = alloc_register(compiler, node->token);
+    declare_variable(compiler, node_at(compiler, parameter)->token,
+                     declared->parameters[i], reg);
+    compiler->locals = reg + 1;
+  }
+  // Room for the result of a function without parameters
+  if (compiler->registers == 0)
+    alloc_register(compiler, node->token);
+  compiler->registers = compiler->locals;
+
+  const Node *body = node_at(compiler, node->function.body);
+  ValueType type = current_function(compiler)->type;
+  if (body->kind == NODE_BLOCK)
+    compile_statement(compiler, node->function.body);
+  else if (node->function.body != NO_NODE) {
+    // name(...) => expression;
+    compiler->panic = 0;
+    Operand value = compile_expression(compiler, node->function.body, type);
+    if (type == VALUE_VOID)
+      emit(compiler, OP_RETURN_VOID, 0, 0, 0, node->token);
+    else {
+      value = convert(compiler, value, type, node->token);
+      emit(compiler, OP_RETURN, value.reg, 0, 0, node->token);
+    }
+  }
+
+  // Falling off the end returns zero
+  if (type == VALUE_VOID)
+    emit(compiler, OP_RETURN_VOID, 0, 0, 0, node->token);
+  else {
+    compiler->registers = compiler->locals;
+    Operand zero = load_zero(compiler, type, node->token);
+    emit(compiler, OP_RETURN, zero.reg, 0, 0, node->token);
+  }
+
+  end_scope(compiler);
+  compiler->function = function;
+  compiler->locals = locals;
+  compiler->registers = registers;
+  compiler->loops = loops;
+}
+
+static void compile_statement_kind(Compiler *compiler, NodeId id) {
+  const Node *node = node_at(compiler, id);
+  switch (node->kind) {
+  case NODE_VARIABLE:
+    compile_variable(compiler, node);
+    break;
+  case NODE_EXPRESSION:
+    compile_effect(compiler, node->unary.operand);
+    break;
+  case NODE_BLOCK:
+    compile_block(compiler, node);
+    break;
+  case NODE_IF:
+    compile_if(compiler, node);
+    break;
+  case NODE_WHILE:
+    compile_loop(compiler, node, NO_NODE, node->branch.condition, NO_NODE,
+                 node->branch.then, 1);
+    break;
+  case NODE_DO_WHILE:
+    compile_loop(compiler, node, NO_NODE, node->branch.condition, NO_NODE,
+                 node->branch.then, 0);
+    break;
+  case NODE_FOR:
+    compile_loop(compiler, node, node->loop.init, node->loop.condition,
+                 node->loop.step, node->loop.body, 1);
+    break;
+  case NODE_RETURN:
+    compile_return(compiler, node);
+    break;
+  case NODE_BREAK:
+  case NODE_CONTINUE:
+    compile_jump(compiler, node);
+    break;
+  case NODE_FUNCTION:
+    if (compiler->function != 0 || compiler->scope != 0)
+      report_type_error(compiler, node->token,
+                        "Functions are only declared at the top level");
+    else if (find_function(compiler, node->token) != 0)
+      compile_function(compiler, node, find_function(compiler, node->token));
+    break;
+  case NODE_STRUCT:
+    report_unsupported(compiler, node->token, "Structs are not supported yet");
+    break;
+  case NODE_ENUM:
+    report_unsupported(compiler, node->token, "Enums are not supported yet");
+    break;
+  case NODE_IMPORT:
+    report_unsupported(compiler, node->token, "Imports are not supported yet");
+    break;
+  case NODE_ERROR:
+    // Reported by the parser
+    break;
+  default:
+    report_type_error(compiler, node->token, "Expected a statement");
+    break;
+  }
+}
+
+static void compile_statement(Compiler *compiler, NodeId id) {
+  compiler->panic = 0;
+  compile_statement_kind(compiler, id);
+  compiler->registers = compiler->locals;
+}
+
+/**
+ * Declare every top-level function before compiling anything, so calls can
+ * come before the declaration of the function they call
+ * @param compiler
+ * @param program list of the top-level statements
+ */
+static void declare_functions(Compiler *compiler, NodeList program) {
+  for (i64 i = 0; i < program.length; i++) {
+    const Node *node = node_at(compiler, compiler->ast->extra[program.start + i]);
+    if (node->kind != NODE_FUNCTION)
+      continue;
+
+    compiler->panic = 0;
+    if (find_function(compiler, node->token) != 0) {
+      report_type_error(compiler, node->token, "Function is already declared");
+      continue;
+    }
+
+    ValueType type = VALUE_VOID;
+    if (node->function.type != NO_NODE)
+      type = resolve_type(compiler, node->function.type);
+
+    i64 index;
+    if (!append_function(compiler->program, node->token, type, &index)) {
+      compiler->out_of_memory = 1;
+      return;
+    }
+    Function *function = &compiler->program->functions[index];
+    NodeList parameters = node->function.parameters;
+    function->arity = parameters.length;
+    if (parameters.length > 0) {
+      function->parameters = malloc(sizeof(ValueType) * parameters.length);
+      if (function->parameters == NULL) {
+        compiler->out_of_memory = 1;
+        return;
+      }
+    }
+    for (i64 j = 0; j < parameters.length; j++) {
+      const Node *parameter =
+          node_at(compiler, compiler->ast->extra[parameters.start + j]);
+      function->parameters[j] = resolve_type(compiler, parameter->variable.type);
+      if (function->parameters[j] == VALUE_VOID)
+        report_type_error(compiler, parameter->token,
+                          "Parameter can't be void");
+    }
+
+    // main() or main(argc: int, argv: string[..]), run_program passes the
+    // command line
+    if (is_named(compiler, node->token, "main")) {
+      compiler->program->main = index;
+      if (parameters.length > 0 &&
+          !(parameters.length == 2 && is_integer(function->parameters[0]) &&
+            function->parameters[1] == array_of(VALUE_STRING)))
+        report_type_error(compiler, node->token,
+                          "main takes no parameters, or argc: int and "
+                          "argv: string[..]");
+    }
+  }
+}
+
+/**
+ * Create a compiler for a parsed file
+ * @param file_location
+ * @param tokens must outlive the compiled program
+ * @param ast must outlive the compiler
+ * @return the compiler, NULL if there is no memory left
+ */
+Compiler *create_compiler(const char *file_location, const TokenBuffer *tokens,
+                          const Ast *ast) {
+  Compiler *compiler = calloc(1, sizeof(Compiler));
+  if (compiler == NULL)
+    return NULL;
+
+  compiler->program = create_program(file_location, tokens);
+  if (compiler->program == NULL) {
+    free(compiler);
+    return NULL;
+  }
+  compiler->file_location = file_location;
+  compiler->tokens = tokens;
+  compiler->ast = ast;
+  return compiler;
+}
+
+/**
+ * Compile a whole file. The top-level statements make function 0, errors
+ * are collected as diagnostics and the program must not run if there are
+ * some
+ * @param compiler
+ * @return the program, released by the caller with free_program. NULL if
+ * there is no memory left
+ */
+Program *compile_program(Compiler *compiler) {
+  const Node *root = node_at(compiler, compiler->ast->root);
+  declare_functions(compiler, root->list);
+
+  for (i64 i = 0; i < root->list.length && !compiler->out_of_memory; i++)
+    compile_statement(compiler, compiler->ast->extra[root->list.start + i]);
+  if (current_function(compiler)->registers == 0)
+    alloc_register(compiler, root->token);
+  emit(compiler, OP_RETURN_VOID, 0, 0, 0, root->token);
+  if (compiler->out_of_memory)
+    return NULL;
+
+  Program *program = compiler->program;
+  compiler->program = NULL;
+  return program;
+}
+
+/**
+ * Release the compiler, with the program unless compile_program handed it
+ * over
+ * @param compiler
+ */
+void free_compiler(Compiler *compiler) {
+  if (compiler->program != NULL)
+    free_program(compiler->program), compiler->program = NULL;
+  free(compiler->variables), compiler->variables = NULL;
+  free(compiler->breaks), compiler->breaks = NULL;
+  free(compiler->continues), compiler->continues = NULL;
+  free(compiler->chain), compiler->chain = NULL;
+  free(compiler->diagnostics.items), compiler->diagnostics.items = NULL;
+  free(compiler);
+}
@@ -0,0 +1,73 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "../helper.h"
+#include "../lexer/lexer.h"
+#include "../parser/ast.h"
+#include "bytecode.h"
+
+// Deepest expression nesting compiled. Binary chains are compiled in a loop
+// and don't count, see compile_binary
+#ifndef COMPILER_MAX_DEPTH
+#define COMPILER_MAX_DEPTH 4096
+#endif
+
+typedef struct {
+  // Token of the name
+  i64 name;
+  ValueType type;
+  // Register of a local, index of a global
+  i64 index;
+  // Block nesting, 0 for globals
+  i64 scope;
+} Variable;
+
+typedef struct {
+  const char *file_location;
+  const TokenBuffer *tokens;
+  const Ast *ast;
+  // Handed over by compile_program
+  Program *program;
+
+  // Function being compiled
+  i64 function;
+  // Globals, then the locals in scope
+  Variable *variables;
+  i64 variables_length;
+  i64 variables_capacity;
+  i64 scope;
+  // Registers below are locals, the ones above temporaries
+  i64 locals;
+  // Next free register
+  i64 registers;
+
+  // Jumps to patch at the end of the enclosing loops
+  i64 *breaks;
+  i64 breaks_length;
+  i64 breaks_capacity;
+  i64 *continues;
+  i64 continues_length;
+  i64 continues_capacity;
+  i64 loops;
+
+  // Operators of the binary chains being compiled, see compile_binary
+  i64 *chain;
+  i64 chain_length;
+  i64 chain_capacity;
+  // Expressions being compiled, nested in one another
+  i64 depth;
+
+  // Set after an error until the next statement, to report it only once
+  i8 panic;
+  Diagnostics diagnostics;
+  i8 out_of_memory;
+} Compiler;
+
+Compiler *create_compiler(const char *file_location, const TokenBuffer *tokens,
+                          const Ast *ast);
+
+Program *compile_program(Compiler *compiler);
+
+void free_compiler(Compiler *compiler);
+
+#endif
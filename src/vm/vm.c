@@ -0,0 +1,569 @@
+#include "vm.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Record a runtime error at the token the failing instruction was compiled
+ * from
+ * @param vm
+ * @param function running
+ * @param ip just past the failing instruction
+ * @param details
+ * @return VM_RUNTIME_ERROR
+ */
+static VMStatus runtime_error(VM *vm, const Function *function,
+                              const Instruction *ip, const char *details) {
+  const TokenBuffer *tokens = vm->program->tokens;
+  i64 token = function->tokens[ip - 1 - function->code];
+
+  vm->error.kind = RUNTIME_ERROR;
+  vm->error.details = details;
+  vm->error.pos.file_location = vm->program->file_location;
+  vm->error.pos.index = tokens->offsets[token];
+  line_table_lookup(&tokens->lines, vm->error.pos.index, &vm->error.pos.line,
+                    &vm->error.pos.column);
+  return VM_RUNTIME_ERROR;
+}
+
+/**
+ * Grow the register stack, the registers may move
+ * @param vm
+ * @param size registers needed
+ * @return false if there is no memory left
+ */
+static i8 reserve_stack(VM *vm, i64 size) {
+  if (size <= vm->stack_capacity)
+    return 1;
+  i64 capacity = vm->stack_capacity ? vm->stack_capacity : 1024;
+  while (capacity < size)
+    capacity *= 2;
+  Value *stack = realloc(vm->stack, sizeof(Value) * capacity);
+  if (stack == NULL)
+    return 0;
+  vm->stack = stack;
+  vm->stack_capacity = capacity;
+  return 1;
+}
+
+static i64 wrap_i32(i64 value) { return (int64_t)(int32_t)value; }
+
+/**
+ * Raise an integer to a power by squaring, overflows wrap
+ * @param base
+ * @param exponent negative powers are truncated toward zero, only those of
+ * 1 and -1 aren't zero
+ * @return the power
+ */
+static i64 power_i64(i64 base, i64 exponent) {
+  if ((int64_t)exponent < 0) {
+    if ((int64_t)base == -1)
+      return exponent & 1 ? base : 1;
+    return base == 1;
+  }
+  i64 result = 1;
+  while (exponent != 0) {
+    if (exponent & 1)
+      result *= base;
+    base *= base;
+    exponent >>= 1;
+  }
+  return result;
+}
+
+static i64 object_length(const Object *object) {
+  return object == NULL ? 0 : object->length;
+}
+
+/**
+ * Truncate a float to an integer, NaN and out of range values give the
+ * smallest integer instead of undefined behavior
+ * @param value
+ * @return the integer
+ */
+static i64 float_to_integer(double value) {
+  if (value >= -9223372036854775808.0 && value < 9223372036854775808.0)
+    return (int64_t)value;
+  return (i64)INT64_MIN;
+}
+
+#ifdef VM_COMPUTED_GOTO
+// Labels as values and computed goto are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/**
+ * Run a function until it returns, with the calls it makes
+ * @param vm
+ * @param index of the function, its arguments are in the first registers
+ * of the stack
+ * @param result set to the value returned
+ * @return VM_OK, or the error that stopped it
+ */
+static VMStatus execute(VM *vm, i64 index, Value *result) {
+  const Function *functions = vm->program->functions;
+  const Value *constants = vm->program->constants;
+  Value *globals = vm->globals;
+
+  const Function *function = &functions[index];
+  if (!reserve_stack(vm, function->registers))
+    return VM_OUT_OF_MEMORY;
+  Value *r = vm->stack;
+  const Instruction *ip = function->code;
+  i64 frames = 0;
+  Instruction i;
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_LABEL(name) &&label_##name,
+  static const void *dispatch[OPCODE_COUNT] = {OPCODES(VM_LABEL)};
+#undef VM_LABEL
+#define VM_CASE(name) label_##name:
+#define VM_NEXT() goto *dispatch[(i = *ip++).op]
+  VM_NEXT();
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT() continue
+  for (;;) {
+    i = *ip++;
+    switch (i.op) {
+#endif
+
+  VM_CASE(OP_MOVE) {
+    r[i.a] = r[i.b];
+    VM_NEXT();
+  }
+  VM_CASE(OP_CONST) {
+    r[i.a] = constants[INSTRUCTION_BX(i)];
+    VM_NEXT();
+  }
+  VM_CASE(OP_GET_GLOBAL) {
+    r[i.a] = globals[INSTRUCTION_BX(i)];
+    VM_NEXT();
+  }
+  VM_CASE(OP_SET_GLOBAL) {
+    globals[INSTRUCTION_BX(i)] = r[i.a];
+    VM_NEXT();
+  }
+
+  // Integers add, subtract and multiply unsigned so overflows wrap
+  VM_CASE(OP_ADD_I32) {
+    r[i.a].i = wrap_i32(r[i.b].i + r[i.c].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_SUB_I32) {
+    r[i.a].i = wrap_i32(r[i.b].i - r[i.c].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_MUL_I32) {
+    r[i.a].i = wrap_i32(r[i.b].i * r[i.c].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_DIV_I32) {
+    if (r[i.c].i == 0)
+      return runtime_error(vm, function, ip, "Division by zero");
+    // Exact in 64 bits, even the smallest integer divided by -1
+    r[i.a].i = wrap_i32((int64_t)r[i.b].i / (int64_t)r[i.c].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_MOD_I32) {
+    if (r[i.c].i == 0)
+      return runtime_error(vm, function, ip, "Division by zero");
+    r[i.a].i = (int64_t)r[i.b].i % (int64_t)r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_POW_I32) {
+    r[i.a].i = wrap_i32(power_i64(r[i.b].i, r[i.c].i));
+    VM_NEXT();
+  }
+  VM_CASE(OP_NEG_I32) {
+    r[i.a].i = wrap_i32(0 - r[i.b].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_ADD_I64) {
+    r[i.a].i = r[i.b].i + r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_SUB_I64) {
+    r[i.a].i = r[i.b].i - r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_MUL_I64) {
+    r[i.a].i = r[i.b].i * r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_DIV_I64) {
+    if (r[i.c].i == 0)
+      return runtime_error(vm, function, ip, "Division by zero");
+    // The smallest integer divided by -1 overflows, it wraps
+    if ((int64_t)r[i.c].i == -1)
+      r[i.a].i = 0 - r[i.b].i;
+    else
+      r[i.a].i = (int64_t)r[i.b].i / (int64_t)r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_MOD_I64) {
+    if (r[i.c].i == 0)
+      return runtime_error(vm, function, ip, "Division by zero");
+    if ((int64_t)r[i.c].i == -1)
+      r[i.a].i = 0;
+    else
+      r[i.a].i = (int64_t)r[i.b].i % (int64_t)r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_POW_I64) {
+    r[i.a].i = power_i64(r[i.b].i, r[i.c].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_NEG_I64) {
+    r[i.a].i = 0 - r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_ADD_F32) {
+    r[i.a].f32 = r[i.b].f32 + r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_SUB_F32) {
+    r[i.a].f32 = r[i.b].f32 - r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_MUL_F32) {
+    r[i.a].f32 = r[i.b].f32 * r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_DIV_F32) {
+    r[i.a].f32 = r[i.b].f32 / r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_POW_F32) {
+    r[i.a].f32 = powf(r[i.b].f32, r[i.c].f32);
+    VM_NEXT();
+  }
+  VM_CASE(OP_NEG_F32) {
+    r[i.a].f32 = -r[i.b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_ADD_F64) {
+    r[i.a].f64 = r[i.b].f64 + r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_SUB_F64) {
+    r[i.a].f64 = r[i.b].f64 - r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_MUL_F64) {
+    r[i.a].f64 = r[i.b].f64 * r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_DIV_F64) {
+    r[i.a].f64 = r[i.b].f64 / r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_POW_F64) {
+    r[i.a].f64 = pow(r[i.b].f64, r[i.c].f64);
+    VM_NEXT();
+  }
+  VM_CASE(OP_NEG_F64) {
+    r[i.a].f64 = -r[i.b].f64;
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_BITWISE_AND) {
+    r[i.a].i = r[i.b].i & r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_BITWISE_OR) {
+    r[i.a].i = r[i.b].i | r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_BITWISE_XOR) {
+    r[i.a].i = r[i.b].i ^ r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_BITWISE_NOT) {
+    r[i.a].i = ~r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LEFT_SHIFT) {
+    r[i.a].i = r[i.b].i << (r[i.c].i & 63);
+    VM_NEXT();
+  }
+  VM_CASE(OP_RIGHT_SHIFT) {
+    r[i.a].i = (int64_t)r[i.b].i >> (r[i.c].i & 63);
+    VM_NEXT();
+  }
+  VM_CASE(OP_NOT) {
+    r[i.a].i = r[i.b].i == 0;
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_EQ_I64) {
+    r[i.a].i = r[i.b].i == r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_NE_I64) {
+    r[i.a].i = r[i.b].i != r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LT_I64) {
+    r[i.a].i = (int64_t)r[i.b].i < (int64_t)r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LE_I64) {
+    r[i.a].i = (int64_t)r[i.b].i <= (int64_t)r[i.c].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_EQ_F32) {
+    r[i.a].i = r[i.b].f32 == r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_NE_F32) {
+    r[i.a].i = r[i.b].f32 != r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LT_F32) {
+    r[i.a].i = r[i.b].f32 < r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LE_F32) {
+    r[i.a].i = r[i.b].f32 <= r[i.c].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_EQ_F64) {
+    r[i.a].i = r[i.b].f64 == r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_NE_F64) {
+    r[i.a].i = r[i.b].f64 != r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LT_F64) {
+    r[i.a].i = r[i.b].f64 < r[i.c].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_LE_F64) {
+    r[i.a].i = r[i.b].f64 <= r[i.c].f64;
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_WRAP_I8) {
+    r[i.a].i = (int64_t)(int8_t)r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_WRAP_I16) {
+    r[i.a].i = (int64_t)(int16_t)r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_WRAP_I32) {
+    r[i.a].i = wrap_i32(r[i.b].i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_I64_TO_F32) {
+    r[i.a].f32 = (int64_t)r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_I64_TO_F64) {
+    r[i.a].f64 = (int64_t)r[i.b].i;
+    VM_NEXT();
+  }
+  VM_CASE(OP_F32_TO_I64) {
+    r[i.a].i = float_to_integer(r[i.b].f32);
+    VM_NEXT();
+  }
+  VM_CASE(OP_F64_TO_I64) {
+    r[i.a].i = float_to_integer(r[i.b].f64);
+    VM_NEXT();
+  }
+  VM_CASE(OP_F32_TO_F64) {
+    r[i.a].f64 = r[i.b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(OP_F64_TO_F32) {
+    r[i.a].f32 = r[i.b].f64;
+    VM_NEXT();
+  }
+  VM_CASE(OP_TO_BOOLEAN) {
+    r[i.a].i = r[i.b].i != 0;
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_ARRAY) {
+    Array *array = new_array(&vm->objects, i.c);
+    if (array == NULL)
+      return VM_OUT_OF_MEMORY;
+    memcpy(array->items, &r[i.b], sizeof(Value) * i.c);
+    r[i.a].object = &array->object;
+    VM_NEXT();
+  }
+  VM_CASE(OP_NEW_ARRAY) {
+    if ((int64_t)r[i.b].i < 0)
+      return runtime_error(vm, function, ip, "Array size is negative");
+    Array *array = new_array(&vm->objects, r[i.b].i);
+    if (array == NULL)
+      return runtime_error(vm, function, ip, "Array is too large");
+    r[i.a].object = &array->object;
+    VM_NEXT();
+  }
+  // Negative indexes are past the end once unsigned
+  VM_CASE(OP_GET_INDEX) {
+    Object *array = r[i.b].object;
+    if (r[i.c].i >= object_length(array))
+      return runtime_error(vm, function, ip, "Index out of bounds");
+    r[i.a] = ((Array *)array)->items[r[i.c].i];
+    VM_NEXT();
+  }
+  VM_CASE(OP_SET_INDEX) {
+    Object *array = r[i.a].object;
+    if (r[i.b].i >= object_length(array))
+      return runtime_error(vm, function, ip, "Index out of bounds");
+    ((Array *)array)->items[r[i.b].i] = r[i.c];
+    VM_NEXT();
+  }
+  VM_CASE(OP_GET_CHAR) {
+    Object *string = r[i.b].object;
+    if (r[i.c].i >= object_length(string))
+      return runtime_error(vm, function, ip, "Index out of bounds");
+    r[i.a].i = (int64_t)(int8_t)((String *)string)->chars[r[i.c].i];
+    VM_NEXT();
+  }
+  VM_CASE(OP_LENGTH) {
+    r[i.a].i = object_length(r[i.b].object);
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_JUMP) {
+    ip += INSTRUCTION_SBX(i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_JUMP_IF_FALSE) {
+    if (!r[i.a].i)
+      ip += INSTRUCTION_SBX(i);
+    VM_NEXT();
+  }
+  VM_CASE(OP_JUMP_IF_TRUE) {
+    if (r[i.a].i)
+      ip += INSTRUCTION_SBX(i);
+    VM_NEXT();
+  }
+
+  VM_CASE(OP_CALL) {
+    if (frames == VM_MAX_FRAMES)
+      return runtime_error(vm, function, ip, "Stack overflow");
+
+    const Function *callee = &functions[i.b];
+    i64 base = r - vm->stack;
+    if (!reserve_stack(vm, base + i.a + callee->registers))
+      return VM_OUT_OF_MEMORY;
+    vm->frames[frames++] = (Frame){function, ip, base};
+
+    function = callee;
+    r = vm->stack + base + i.a;
+    ip = callee->code;
+    VM_NEXT();
+  }
+  VM_CASE(OP_RETURN) {
+    // The caller reads the result from the register of the first argument
+    r[0] = r[i.a];
+    goto pop_frame;
+  }
+  VM_CASE(OP_RETURN_VOID) {
+    goto pop_frame;
+  }
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+      return runtime_error(vm, function, ip, "Invalid instruction");
+    }
+#endif
+
+pop_frame:
+  if (frames == 0) {
+    *result = r[0];
+    return VM_OK;
+  }
+  {
+    Frame frame = vm->frames[--frames];
+    function = frame.function;
+    ip = frame.ip;
+    r = vm->stack + frame.base;
+  }
+  VM_NEXT();
+
+#ifndef VM_COMPUTED_GOTO
+  }
+#endif
+}
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * Pass the file location and the command line arguments to main as argc
+ * and argv
+ * @param vm
+ * @param arguments
+ * @param length
+ * @return false if there is no memory left
+ */
+static i8 push_arguments(VM *vm, const char **arguments, i64 length) {
+  Array *argv = new_array(&vm->objects, length + 1);
+  if (argv == NULL || !reserve_stack(vm, 2))
+    return 0;
+  for (i64 i = 0; i <= length; i++) {
+    const char *chars = i == 0 ? vm->program->file_location : arguments[i - 1];
+    String *argument = new_string(&vm->objects, chars, strlen(chars));
+    if (argument == NULL)
+      return 0;
+    argv->items[i].object = &argument->object;
+  }
+  vm->stack[0].i = length + 1;
+  vm->stack[1].object = &argv->object;
+  return 1;
+}
+
+/**
+ * Run the top-level statements of a program, then its main function if it
+ * has one
+ * @param program compiled without errors
+ * @param arguments passed to main when it takes argc and argv, after the
+ * file location
+ * @param arguments_length
+ * @param result set to the value main returned, its type is the one of
+ * main, VALUE_VOID without main
+ * @param objects set to the strings and arrays the run created, the result
+ * may be one of them. Released by the caller with free_objects, whatever
+ * the status
+ * @param error set when VM_RUNTIME_ERROR is returned
+ * @return VM_OK, or the error that stopped the program
+ */
+VMStatus run_program(const Program *program, const char **arguments,
+                     i64 arguments_length, Value *result, Object **objects,
+                     Diagnostic *error) {
+  VM vm = {.program = program};
+  VMStatus status = VM_OUT_OF_MEMORY;
+
+  vm.frames = malloc(sizeof(Frame) * VM_MAX_FRAMES);
+  vm.globals = calloc(program->globals_length + 1, sizeof(Value));
+  if (vm.frames == NULL || vm.globals == NULL)
+    goto end;
+
+  status = execute(&vm, 0, result);
+  if (status == VM_OK && program->main != 0) {
+    if (program->functions[program->main].arity == 2 &&
+        !push_arguments(&vm, arguments, arguments_length)) {
+      status = VM_OUT_OF_MEMORY;
+      goto end;
+    }
+    status = execute(&vm, program->main, result);
+  }
+  if (status == VM_RUNTIME_ERROR)
+    *error = vm.error;
+
+end:
+  free(vm.stack);
+  free(vm.frames);
+  free(vm.globals);
+  *objects = vm.objects;
+  return status;
+}
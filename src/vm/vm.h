@@ -0,0 +1,53 @@
+#ifndef VM_H
+#define VM_H
+
+#include "../helper.h"
+#include "../lexer/lexer.h"
+#include "bytecode.h"
+
+// Deepest call nesting before a stack overflow error
+#ifndef VM_MAX_FRAMES
+#define VM_MAX_FRAMES 65536
+#endif
+
+// Dispatch through a table of label addresses where the compiler supports
+// it, one indirect jump per instruction. Build with -DVM_SWITCH_DISPATCH to
+// get the portable switch loop instead
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO
+#endif
+
+typedef enum {
+  VM_OK,
+  VM_RUNTIME_ERROR,
+  VM_OUT_OF_MEMORY,
+} VMStatus;
+
+typedef struct {
+  const Function *function;
+  // Next instruction of the caller
+  const Instruction *ip;
+  // First register of the caller in the stack
+  i64 base;
+} Frame;
+
+typedef struct {
+  const Program *program;
+
+  // Registers of every active frame, a callee frame starts at the register
+  // holding its first argument
+  Value *stack;
+  i64 stack_capacity;
+  Frame *frames;
+  Value *globals;
+  // Strings and arrays created by the run
+  Object *objects;
+
+  Diagnostic error;
+} VM;
+
+VMStatus run_program(const Program *program, const char **arguments,
+                     i64 arguments_length, Value *result, Object **objects,
+                     Diagnostic *error);
+
+#endif
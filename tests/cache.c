@@ -0,0 +1,190 @@
+#define _DEFAULT_SOURCE
+#include "../src/driver/cache.h"
+#include "../src/parser/parser.h"
+#include "../src/utils/hash.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ALIGN(size) (((size) + 7) & ~(i64)7)
+
+static const char source[] =
+    "// Cached\n"
+    "main (argc: int, argv: string[..]): int => {\n"
+    "  s := \"tab\\t and \\\"quotes\\\"\";\n"
+    "  c := '\\n';\n"
+    "  x: i64 = 0x1F + 1e+5i64 + 2.5f32;\n"
+    "  for (i := 0; i < 10; i++) { x += i; }\n"
+    "  return x;\n"
+    "}\n";
+#define SOURCE_LENGTH (sizeof(source) - 1)
+
+static char directory[] = "/tmp/monkc-cache-XXXXXX";
+static char location[sizeof(directory) + 32];
+
+typedef struct {
+  char *data;
+  i64 size;
+} Entry;
+
+static Entry read_entry(void) {
+  Entry entry = {NULL, 0};
+  FILE *file = fopen(location, "rb");
+  if (file == NULL || fseek(file, 0, SEEK_END) != 0)
+    exit(EXIT_FAILURE);
+  entry.size = ftell(file);
+  entry.data = malloc(entry.size);
+  rewind(file);
+  if (entry.data == NULL ||
+      fread(entry.data, 1, entry.size, file) != (size_t)entry.size)
+    exit(EXIT_FAILURE);
+  fclose(file);
+  return entry;
+}
+
+static void write_entry(const char *data, i64 size) {
+  FILE *file = fopen(location, "wb");
+  if (file == NULL || fwrite(data, 1, size, file) != (size_t)size)
+    exit(EXIT_FAILURE);
+  fclose(file);
+}
+
+static i8 load(i64 hash, i64 length) {
+  TokenBuffer *tokens;
+  Ast *ast;
+  if (!cache_load(directory, hash, source, length, &tokens, &ast))
+    return 0;
+  free_token_buffer(tokens);
+  if (ast != NULL)
+    free_ast(ast);
+  return 1;
+}
+
+static i8 same_ast(const Ast *a, const Ast *b) {
+  return a->length == b->length && a->extra_length == b->extra_length &&
+         a->root == b->root &&
+         memcmp(a->nodes, b->nodes, sizeof(Node) * a->length) == 0 &&
+         (a->extra_length == 0 ||
+          memcmp(a->extra, b->extra, sizeof(NodeId) * a->extra_length) == 0);
+}
+
+static void test_round_trip(i64 hash, const TokenBuffer *tokens,
+                            const Ast *ast, const char *name) {
+  CHECK(cache_store(directory, hash, SOURCE_LENGTH, tokens, ast),
+        "%s: store failed", name);
+  TokenBuffer *loaded;
+  Ast *loaded_ast;
+  if (!cache_load(directory, hash, source, SOURCE_LENGTH, &loaded,
+                  &loaded_ast)) {
+    test_failure(__FILE__, __LINE__, "%s: load failed", name);
+    return;
+  }
+  i64 difference;
+  CHECK(same_tokens(loaded, tokens, &difference), "%s: token %ld differs",
+        name, difference);
+  if (ast == NULL)
+    CHECK(loaded_ast == NULL, "%s: loaded a tree", name);
+  else
+    CHECK(loaded_ast != NULL && same_ast(loaded_ast, ast),
+          "%s: tree differs", name);
+  free_token_buffer(loaded);
+  if (loaded_ast != NULL)
+    free_ast(loaded_ast);
+}
+
+// Any damage of the entry is caught by the checksum or the header checks
+static void test_damage(i64 hash, Entry entry) {
+  for (i64 i = 0; i < entry.size; i++) {
+    entry.data[i] ^= 0x10;
+    write_entry(entry.data, entry.size);
+    CHECK(!load(hash, SOURCE_LENGTH), "flipped byte %ld was loaded", i);
+    entry.data[i] ^= 0x10;
+  }
+  for (i64 size = 0; size < entry.size; size += 7) {
+    write_entry(entry.data, size);
+    CHECK(!load(hash, SOURCE_LENGTH), "truncated to %ld bytes was loaded",
+          size);
+  }
+  write_entry(entry.data, entry.size);
+  CHECK(load(hash, SOURCE_LENGTH), "restored entry was rejected");
+  CHECK(!load(hash + 1, SOURCE_LENGTH), "entry of another hash was loaded");
+  CHECK(!load(hash, SOURCE_LENGTH - 1), "entry of another length was loaded");
+}
+
+/**
+ * Change an entry and fix its checksum, as an entry of another build or a
+ * hash collision would look, then check it is rejected
+ * @param entry left unchanged
+ * @param offset of the i32 to replace
+ * @param value
+ * @param name
+ */
+static void test_forged(Entry entry, i64 hash, i64 offset, i32 value,
+                        const char *name) {
+  char *data = malloc(entry.size);
+  memcpy(data, entry.data, entry.size);
+  memcpy(data + offset, &value, sizeof(i32));
+  // Same as entry_checksum in cache.c
+  CacheHeader header;
+  memcpy(&header, data, sizeof(CacheHeader));
+  header.checksum = 0;
+  i64 seed = hash_bytes(&header, sizeof(CacheHeader), 0);
+  header.checksum = hash_bytes(data + sizeof(CacheHeader),
+                               entry.size - sizeof(CacheHeader), seed);
+  memcpy(data, &header, sizeof(CacheHeader));
+  write_entry(data, entry.size);
+  CHECK(!load(hash, SOURCE_LENGTH), "%s: forged entry was loaded", name);
+  free(data);
+}
+
+static void test_forged_entries(i64 hash, Entry entry) {
+  CacheHeader header;
+  memcpy(&header, entry.data, sizeof(CacheHeader));
+  i64 types = sizeof(CacheHeader);
+  i64 offsets = types + ALIGN(header.tokens_length);
+  i64 extra = entry.size - ALIGN(sizeof(NodeId) * header.extra_length);
+  i64 nodes = extra - ALIGN(sizeof(Node) * header.nodes_length);
+
+  test_forged(entry, hash, offsets, SOURCE_LENGTH, "token past the source");
+  // The last token must stay TK_EOF, the type is the low byte
+  test_forged(entry, hash, types + header.tokens_length - 1, 0,
+              "no TK_EOF");
+  test_forged(entry, hash, nodes + sizeof(Node) * header.root, NODE_ERROR + 1,
+              "unknown node kind");
+  test_forged(entry, hash, extra, header.nodes_length, "child out of range");
+  test_forged(entry, hash, extra, header.root, "cycle to the root");
+}
+
+int main(void) {
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  i64 hash = hash_bytes(source, SOURCE_LENGTH, 0);
+  snprintf(location, sizeof(location), "%s/%016lx%s", directory, hash,
+           CACHE_EXTENSION);
+
+  TokenBuffer *tokens = lex_source(source, SOURCE_LENGTH);
+  Parser *parser = create_parser(NULL, tokens);
+  Ast *ast = parser ? parse_program(parser) : NULL;
+  if (ast == NULL)
+    return EXIT_FAILURE;
+  CHECK(parser->diagnostics.length == 0, "the source has syntax errors");
+  CHECK(tokens->numbers_length > 0 && tokens->decoded_length > 0,
+        "the source has no numbers or escapes");
+
+  test_round_trip(hash, tokens, NULL, "tokens only");
+  test_round_trip(hash, tokens, ast, "tokens and tree");
+
+  Entry entry = read_entry();
+  test_damage(hash, entry);
+  test_forged_entries(hash, entry);
+
+  unlink(location);
+  rmdir(directory);
+  free(entry.data);
+  free_ast(ast), free_parser(parser), free_token_buffer(tokens);
+  return finish_tests("cache");
+}
@@ -0,0 +1,90 @@
+#include "../src/lexer/chars.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  TokenType type;
+  const char *value;
+} Expected;
+
+/**
+ * Lex a source and compare its tokens, TK_EOF excluded, with the expected
+ * ones
+ * @param source
+ * @param expected
+ * @param length of expected
+ * @param errors number of diagnostics the lexer must report
+ */
+static void check_tokens(const char *source, const Expected *expected,
+                         i64 length, i64 errors) {
+  Lexer *lexer = create_lexer(NULL, source, strlen(source));
+  TokenBuffer *tokens = lexer ? tokenizer(lexer) : NULL;
+  if (tokens == NULL) {
+    test_failure(__FILE__, __LINE__, "%s: no memory to lex", source);
+    exit(EXIT_FAILURE);
+  }
+
+  CHECK(tokens->length == length + 1, "\"%s\": %ld tokens instead of %ld",
+        source, tokens->length - 1, length);
+  for (i64 i = 0; i < length && i + 1 < tokens->length; i++) {
+    Token token = get_token(tokens, i);
+    CHECK(token.type == expected[i].type &&
+              token.length == strlen(expected[i].value) &&
+              memcmp(token.value, expected[i].value, token.length) == 0,
+          "\"%s\": token %ld is \"%.*s\"", source, i, (int)token.length,
+          token.value);
+  }
+  CHECK(lexer->diagnostics.length == errors,
+        "\"%s\": %ld diagnostics instead of %ld", source,
+        lexer->diagnostics.length, errors);
+  free_token_buffer(tokens), free_lexer(lexer);
+}
+
+// '_' continues identifiers but doesn't start one, as before the class table
+static void test_underscore(void) {
+  Expected a_b[] = {{IDENTIFIER, "a_b"}};
+  check_tokens("a_b", a_b, 1, 0);
+  Expected trailing[] = {{IDENTIFIER, "a1_"}};
+  check_tokens("a1_", trailing, 1, 0);
+  Expected leading[] = {{TK_ERROR, "_"}, {IDENTIFIER, "a"}};
+  check_tokens("_a", leading, 2, 1);
+  Expected separated[] = {{INT_LITERAL, "1_000"}};
+  check_tokens("1_000", separated, 1, 0);
+
+  CHECK(char_start('_') == START_ILLEGAL && (char_class('_') & CHAR_WORD),
+        "'_' is classified as %d", char_class('_'));
+}
+
+static void test_classes(void) {
+  for (int c = 0; c < 256; c++) {
+    i8 letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    i8 digit = c >= '0' && c <= '9';
+    i8 word = letter || digit || c == '_';
+    CHECK(!!(char_class(c) & CHAR_WORD) == word, "byte %d word flag", c);
+    CHECK(!!(char_class(c) & CHAR_DIGIT) == digit, "byte %d digit flag", c);
+    if (letter)
+      CHECK(char_start(c) == START_IDENTIFIER, "byte %d doesn't start an "
+            "identifier", c);
+    if (digit)
+      CHECK(char_start(c) == START_NUMBER, "byte %d doesn't start a number",
+            c);
+    if (c >= 0x80 && c < 0xC2)
+      CHECK(char_class(c) == 0, "byte %d is not illegal", c);
+  }
+}
+
+static void test_utf8(void) {
+  Expected word[] = {{IDENTIFIER, "h\xC3\xA9llo"}};
+  check_tokens("h\xC3\xA9llo", word, 1, 0);
+  Expected invalid[] = {{IDENTIFIER, "a"}, {TK_ERROR, "\xFF"},
+                        {IDENTIFIER, "b"}};
+  check_tokens("a\xFF" "b", invalid, 3, 1);
+}
+
+int main(void) {
+  test_underscore();
+  test_classes();
+  test_utf8();
+  return finish_tests("lexer");
+}
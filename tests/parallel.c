@@ -0,0 +1,112 @@
+#include "../src/lexer/parallel.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Large enough to be split in several chunks of PARALLEL_MIN_CHUNK
+#define SOURCE_SIZE (5 * PARALLEL_MIN_CHUNK)
+
+// Statements with the constructs chunk splits must not cut: multi-line
+// comments and strings, escapes and literals the lexer looks past
+static const char *statements[] = {
+    "x := 1..2;\n",
+    "y: f64 = 1e+5 + 0x1F * 0b101;\n",
+    "/* a comment\n   over lines */\n",
+    "// line comment \"not a string\n",
+    "s := \"a string\\n with \\\"escapes\\\"\";\n",
+    "c := '\\t';\n",
+    "u := \"\xC3\xA9t\xC3\xA9\";\n",
+    "main (): int => { return a_b << 2; }\n",
+    "\r\n",
+    "e := @;\n",
+    "m := \"over\nlines\";\n",
+};
+#define STATEMENTS (sizeof(statements) / sizeof(statements[0]))
+
+static i64 random_state = 0x2545F4914F6CDD1D;
+
+static i64 next_random(i64 bound) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state % bound;
+}
+
+static char *generate_source(i64 *length) {
+  char *source = malloc(SOURCE_SIZE + 64);
+  if (source == NULL)
+    exit(EXIT_FAILURE);
+  *length = 0;
+  while (*length < SOURCE_SIZE) {
+    const char *statement = statements[next_random(STATEMENTS)];
+    i64 size = strlen(statement);
+    memcpy(source + *length, statement, size);
+    *length += size;
+  }
+  source[*length] = '\0';
+  return source;
+}
+
+static i8 same_diagnostics(const Diagnostics *a, const Diagnostics *b) {
+  if (a->length != b->length)
+    return 0;
+  for (i64 i = 0; i < a->length; i++) {
+    const Diagnostic *x = &a->items[i], *y = &b->items[i];
+    if (x->kind != y->kind || x->pos.index != y->pos.index ||
+        x->pos.line != y->pos.line || x->pos.column != y->pos.column ||
+        strcmp(x->details, y->details) != 0)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * Lex a source sequentially and with a number of threads, the tokens and
+ * diagnostics must be the same
+ * @param source
+ * @param length
+ * @param threads
+ * @param name shown when they differ
+ */
+static void check_parallel(const char *source, i64 length, i64 threads,
+                           const char *name) {
+  Lexer *sequential = create_lexer(NULL, source, length);
+  Lexer *parallel = create_lexer(NULL, source, length);
+  TokenBuffer *expected = sequential ? tokenizer(sequential) : NULL;
+  TokenBuffer *tokens = parallel ? tokenizer_parallel(parallel, threads) : NULL;
+  if (expected == NULL || tokens == NULL) {
+    test_failure(__FILE__, __LINE__, "%s: no memory to lex", name);
+    exit(EXIT_FAILURE);
+  }
+
+  i64 difference;
+  CHECK(same_tokens(tokens, expected, &difference),
+        "%s with %ld threads: token %ld differs", name, threads, difference);
+  CHECK(same_diagnostics(&parallel->diagnostics, &sequential->diagnostics),
+        "%s with %ld threads: diagnostics differ", name, threads);
+  free_token_buffer(tokens), free_token_buffer(expected);
+  free_lexer(parallel), free_lexer(sequential);
+}
+
+int main(void) {
+  i64 length;
+  char *source = generate_source(&length);
+  for (i64 threads = 1; threads <= 8; threads++)
+    check_parallel(source, length, threads, "statements");
+
+  // An unterminated string at the start makes the rest of the source one
+  // literal, chunks can't be split inside it
+  source[0] = '"';
+  check_parallel(source, length, 4, "unterminated string");
+  // An unterminated comment in the middle
+  memcpy(source + length / 2, "/*", 2);
+  check_parallel(source, length, 4, "unterminated comment");
+
+  // The lexer stops at a '\0'
+  source[0] = 'x';
+  source[length / 3] = '\0';
+  check_parallel(source, length, 4, "'\\0' in the source");
+
+  free(source);
+  return finish_tests("parallel");
+}
@@ -0,0 +1,141 @@
+#include "../src/lexer/incremental.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_EDITS 3000
+
+// Pieces random sources and edits are made of, with the ones the lexer
+// looks past for: "1..2", "1e+5", comments and unterminated literals
+static const char *fragments[] = {
+    "x", "a_b", "1", "1.", ".", "..", "1..2", "1e+5", "e", "+", "0x1F", "_",
+    " ", "\n", "\r\n", "\t", "=", "==", ":=", "=>", "<<=", "->", ";", "{",
+    "}", "(", ")", "\"", "\"a\\n\"", "'", "'x'", "'\\t'", "\\", "//", "/*",
+    "*/", "// c\n", "/* c */", "if", "while", "return", "main", "i32",
+    "\xC3\xA9", "\xC3", "\xFF", "@", "#",
+};
+#define FRAGMENTS (sizeof(fragments) / sizeof(fragments[0]))
+
+static i64 random_state = 0x9E3779B97F4A7C15;
+
+static i64 next_random(i64 bound) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state % bound;
+}
+
+typedef struct {
+  char *data;
+  i64 length;
+} Source;
+
+static Source edited_source(Source source, SourceEdit edit,
+                            const char *inserted) {
+  Source result = {.length = source.length - edit.removed + edit.inserted};
+  result.data = malloc(result.length + 1);
+  if (result.data == NULL)
+    exit(EXIT_FAILURE);
+  memcpy(result.data, source.data, edit.offset);
+  memcpy(result.data + edit.offset, inserted, edit.inserted);
+  memcpy(result.data + edit.offset + edit.inserted,
+         source.data + edit.offset + edit.removed,
+         source.length - edit.offset - edit.removed);
+  result.data[result.length] = '\0';
+  return result;
+}
+
+/**
+ * Relex an edit of tokens and compare them with a full lex of the edited
+ * source
+ * @param tokens lexed from source, updated in place
+ * @param source freed, replaced by the edited one
+ * @param edit
+ * @param inserted edit.inserted bytes
+ * @param name shown when the tokens differ
+ */
+static void check_edit(TokenBuffer *tokens, Source *source, SourceEdit edit,
+                       const char *inserted, const char *name) {
+  Source edited = edited_source(*source, edit, inserted);
+  if (!relex_tokens(tokens, edited.data, edited.length, edit)) {
+    test_failure(__FILE__, __LINE__, "%s: relex_tokens failed", name);
+    exit(EXIT_FAILURE);
+  }
+  TokenBuffer *expected = lex_source(edited.data, edited.length);
+  i64 difference;
+  CHECK(same_tokens(tokens, expected, &difference),
+        "%s: token %ld differs from a full lex", name, difference);
+  free_token_buffer(expected);
+  free(source->data);
+  *source = edited;
+}
+
+static void test_edit(const char *before, i64 offset, i64 removed,
+                      const char *inserted, const char *name) {
+  Source source = {.length = strlen(before)};
+  source.data = malloc(source.length + 1);
+  memcpy(source.data, before, source.length + 1);
+  TokenBuffer *tokens = lex_source(source.data, source.length);
+  SourceEdit edit = {offset, removed, strlen(inserted)};
+  check_edit(tokens, &source, edit, inserted, name);
+  free_token_buffer(tokens);
+  free(source.data);
+}
+
+// A '\0' inside the source can't come from strlen
+static void test_remove_nul(void) {
+  char before[] = "a := 1;\n\0b := 2;\n";
+  Source source = {.length = sizeof(before) - 1};
+  source.data = malloc(sizeof(before));
+  memcpy(source.data, before, sizeof(before));
+  TokenBuffer *tokens = lex_source(source.data, source.length);
+  SourceEdit edit = {8, 1, 0};
+  check_edit(tokens, &source, edit, "", "removed '\\0'");
+  free_token_buffer(tokens);
+  free(source.data);
+}
+
+// Many edits on the same buffer, each one checked against a full lex
+static void test_random_edits(void) {
+  Source source = {.data = malloc(1), .length = 0};
+  source.data[0] = '\0';
+  TokenBuffer *tokens = lex_source(source.data, source.length);
+  char inserted[64];
+
+  for (i64 i = 0; i < RANDOM_EDITS; i++) {
+    SourceEdit edit = {.offset = next_random(source.length + 1)};
+    if (source.length > 0 && next_random(3) == 0)
+      edit.removed = next_random(source.length - edit.offset + 1) % 8;
+    // Grow the source first, then keep its size around a few kilobytes
+    i64 pieces = next_random(source.length < 4096 ? 6 : 2);
+    inserted[0] = '\0';
+    for (i64 j = 0; j < pieces; j++)
+      strcat(inserted, fragments[next_random(FRAGMENTS)]);
+    edit.inserted = strlen(inserted);
+    check_edit(tokens, &source, edit, inserted, "random edit");
+  }
+  free_token_buffer(tokens);
+  free(source.data);
+}
+
+int main(void) {
+  test_edit("x := 1.2;", 6, 0, ".", "1.2 to 1..2");
+  test_edit("x := 1..2;", 6, 1, "", "1..2 to 1.2");
+  test_edit("x := 1e5;", 6, 0, "+", "1e5 to 1e+5");
+  test_edit("x := 1e+5;", 7, 1, "", "1e+5 to 1e5");
+  test_edit("a := 1;\n\xFF\nb := 2;", 8, 1, "", "removed 0xFF");
+  test_edit("a := 1;\nb := 2;", 8, 0, "\xFF", "inserted 0xFF");
+  test_edit("a := 1;\nb := 2;\nc := 3;", 5, 0, "\"", "opened string");
+  test_edit("a := \"1;\nb := 2;", 5, 1, "", "closed string");
+  test_edit("a := 1;\nb := 2;\nc := 3;", 0, 0, "/*", "opened comment");
+  test_edit("/* a := 1;\nb := 2; */", 0, 2, "", "removed comment");
+  test_edit("a := 1;\nb := 2;", 7, 1, "", "joined lines");
+  test_edit("a := 1; b := 2;", 7, 0, "\n\n", "split lines");
+  test_edit("ab", 1, 0, "_", "a_b");
+  test_edit("x := 1;", 7, 0, " y", "appended");
+  test_edit("x := 1;", 0, 7, "", "removed everything");
+  test_edit("", 0, 0, "x := 1;", "empty source");
+  test_remove_nul();
+  test_random_edits();
+  return finish_tests("relex");
+}
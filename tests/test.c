@@ -0,0 +1,74 @@
+#include "test.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static i64 failures = 0;
+
+void test_failure(const char *file, int line, const char *format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  fprintf(stderr, "%s:%d: ", file, line);
+  vfprintf(stderr, format, arguments);
+  fprintf(stderr, "\n");
+  va_end(arguments);
+  failures++;
+}
+
+/**
+ * Print the summary of a test program
+ * @param name
+ * @return the exit status of the program
+ */
+int finish_tests(const char *name) {
+  if (failures == 0) {
+    printf("%s: ok\n", name);
+    return EXIT_SUCCESS;
+  }
+  printf("%s: %ld failed\n", name, failures);
+  return EXIT_FAILURE;
+}
+
+/**
+ * Lex a whole source sequentially
+ * @param source which must have a '\0' at source[length]
+ * @param length
+ * @return the tokens, the program exits when there is no memory left
+ */
+TokenBuffer *lex_source(const char *source, i64 length) {
+  Lexer *lexer = create_lexer(NULL, source, length);
+  TokenBuffer *tokens = lexer ? tokenizer(lexer) : NULL;
+  if (tokens == NULL) {
+    fprintf(stderr, "MallocError: No memory to allocate\n");
+    exit(EXIT_FAILURE);
+  }
+  free_lexer(lexer);
+  return tokens;
+}
+
+static i8 same_token(Token a, Token b) {
+  if (a.type != b.type || a.length != b.length ||
+      memcmp(a.value, b.value, a.length) != 0 || a.pos.start != b.pos.start ||
+      a.pos.end != b.pos.end || a.pos.line != b.pos.line ||
+      a.pos.column != b.pos.column)
+    return 0;
+  return !is_number_type(a.type) ||
+         memcmp(&a.number, &b.number, sizeof(Number)) == 0;
+}
+
+/**
+ * Compare two token buffers as get_token sees them: types, positions, values
+ * and numbers
+ * @param a
+ * @param b
+ * @param difference set to the index of the first token that differs
+ * @return true if they hold the same tokens
+ */
+i8 same_tokens(const TokenBuffer *a, const TokenBuffer *b, i64 *difference) {
+  i64 length = a->length < b->length ? a->length : b->length;
+  for (*difference = 0; *difference < length; (*difference)++)
+    if (!same_token(get_token(a, *difference), get_token(b, *difference)))
+      return 0;
+  return a->length == b->length;
+}
@@ -0,0 +1,24 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include "../src/helper.h"
+#include "../src/lexer/lexer.h"
+
+// Each tests/<name>.c is linked into bin/test_<name>, make test runs them
+// all. A failed check is reported and the program keeps going, its exit
+// status is the one of finish_tests
+#define CHECK(condition, ...)                                                  \
+  do {                                                                         \
+    if (!(condition))                                                          \
+      test_failure(__FILE__, __LINE__, __VA_ARGS__);                           \
+  } while (0)
+
+void test_failure(const char *file, int line, const char *format, ...);
+
+int finish_tests(const char *name);
+
+TokenBuffer *lex_source(const char *source, i64 length);
+
+i8 same_tokens(const TokenBuffer *a, const TokenBuffer *b, i64 *difference);
+
+#endif
@@ -0,0 +1,236 @@
+#include "../src/parser/parser.h"
+#include "../src/utils/utils.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/vm.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LONG_CHAIN 100000
+
+typedef struct {
+  // Set with the first error when main didn't return
+  i8 failed;
+  Diagnostic error;
+  ValueType type;
+  Value value;
+} Outcome;
+
+/**
+ * Lex, parse, compile and run a source, the way main.c --run does
+ * @param source
+ * @param arguments passed to main after the file location
+ * @param arguments_length
+ * @return the result of main or the first error
+ */
+static Outcome run_source(const char *source, const char **arguments,
+                          i64 arguments_length) {
+  Outcome outcome = {.failed = 1};
+  TokenBuffer *tokens = lex_source(source, strlen(source));
+  Parser *parser = create_parser("test.monkc", tokens);
+  Ast *ast = parser ? parse_program(parser) : NULL;
+  if (ast == NULL)
+    exit(EXIT_FAILURE);
+  if (parser->diagnostics.length > 0) {
+    outcome.error = parser->diagnostics.items[0];
+    free_ast(ast), free_parser(parser), free_token_buffer(tokens);
+    return outcome;
+  }
+
+  Compiler *compiler = create_compiler("test.monkc", tokens, ast);
+  Program *program = compiler ? compile_program(compiler) : NULL;
+  if (program == NULL)
+    exit(EXIT_FAILURE);
+  if (compiler->diagnostics.length > 0) {
+    outcome.error = compiler->diagnostics.items[0];
+  } else {
+    Object *objects;
+    VMStatus status = run_program(program, arguments, arguments_length,
+                                  &outcome.value, &objects, &outcome.error);
+    if (status == VM_OUT_OF_MEMORY)
+      exit(EXIT_FAILURE);
+    outcome.failed = status == VM_RUNTIME_ERROR;
+    outcome.type = program->functions[program->main].type;
+    free_objects(objects);
+  }
+  free_program(program), free_compiler(compiler);
+  free_ast(ast), free_parser(parser), free_token_buffer(tokens);
+  return outcome;
+}
+
+static void check_integer(const char *source, int64_t expected,
+                          const char *name) {
+  Outcome outcome = run_source(source, NULL, 0);
+  if (outcome.failed) {
+    test_failure(__FILE__, __LINE__, "%s: failed", name);
+    print_diagnostic(&outcome.error);
+    return;
+  }
+  CHECK((int64_t)outcome.value.i == expected,
+        "%s: returned %ld instead of %ld", name, (int64_t)outcome.value.i,
+        expected);
+}
+
+static void check_error(const char *source, DiagnosticKind kind,
+                        const char *name) {
+  Outcome outcome = run_source(source, NULL, 0);
+  CHECK(outcome.failed, "%s: returned %ld", name, (int64_t)outcome.value.i);
+  if (outcome.failed && outcome.error.kind != kind) {
+    test_failure(__FILE__, __LINE__, "%s: wrong kind of error", name);
+    print_diagnostic(&outcome.error);
+  }
+}
+
+static void test_expressions(void) {
+  check_integer("main (): i64 => 1 + 2 * 3 - 8 / 2 % 3;", 6, "precedence");
+  check_integer("main (): i64 => (1 + 2) * 3 - -4;", 13, "grouping");
+  check_integer("main (): i64 => 1 << 4 $ 3 & 6 ^ 1;", 19, "bitwise");
+  check_integer("main (): i64 => 2 ** 10 + 3 ** -1 + (-1) ** -3;", 1023,
+                "power");
+  check_integer("main (): i64 => 7 / -2 * 10 + -7 % 3;", -31,
+                "signed division");
+  check_integer("main (): i64 => 1 < 2 && 2 >= 2 && !(1 == 2) ? 1 : 0;", 1,
+                "comparison");
+  check_integer("d (): i64 => 1 / 0;\n"
+                "main (): i64 => 0 == 1 && d() == 0 || 1 == 1 ? 4 : 5;",
+                4, "short circuit");
+  check_integer("g: i32 = 3;\n"
+                "f (a: i32, b: f64): f64 => a + b * 2 - 1;\n"
+                "main (): i64 => {\n"
+                "  x: i32 = 1 + 2 * 3 - 4 / 2 + g % 2;\n"
+                "  y: f64 = x + 1.5 + f(x, 2.0) - 3;\n"
+                "  b: boolean = x < 3 && y > 1.0 || x == 2 && !(y <= 0.5);\n"
+                "  c: i8 = 100;\n"
+                "  c = c + c + 1 << 1 & 7 ^ 1;\n"
+                "  z: i64 = 1 + x + 2 + c >> 1;\n"
+                "  if (b || x != 0 || y >= 2.0) z += 1;\n"
+                "  return z + (b ? 1 : 0) + (2 + x) * 3 + 1 - x;\n"
+                "}",
+                26, "mixed types");
+}
+
+static void test_statements(void) {
+  check_integer("fib (n: i64): i64 => n < 2 ? n : fib(n - 1) + fib(n - 2);\n"
+                "main (): i64 => fib(20);",
+                6765, "recursion");
+  check_integer("main (): i64 => {\n"
+                "  total := 0;\n"
+                "  for (i := 0; i < 100; i++) {\n"
+                "    if (i % 2 == 0) continue;\n"
+                "    if (i > 50) break;\n"
+                "    total += i;\n"
+                "  }\n"
+                "  n := 0;\n"
+                "  while (n < 10) n++;\n"
+                "  do { n--; } while (n > 5);\n"
+                "  return total * 100 + n;\n"
+                "}",
+                62505, "loops");
+  check_integer("main (): i64 => { return later(); }\n"
+                "later (): i64 => 3;",
+                3, "call before declaration");
+}
+
+static void test_arrays(void) {
+  static const char *sum =
+      "sum (values: i64[..]): i64 => {\n"
+      "  total: i64 = 0;\n"
+      "  for (i := 0; i < values::len(); i++)\n"
+      "    total += values[i];\n"
+      "  return total;\n"
+      "}\n"
+      "main (argc: int, argv: string[..]): i64 => {\n"
+      "  a: i64[3];\n"
+      "  a[0] = 5; a[1] += 2; a[2]++; ++a[2];\n"
+      "  b: i64[..] = [1, 2, 3, 4];\n"
+      "  s := \"h\xC3\xA9llo\";\n"
+      "  return sum(a) * 1000 + sum(b) * 100 + argc * 10 + s::len() +\n"
+      "         argv[argc - 1]::len();\n"
+      "}";
+  const char *arguments[] = {"xy"};
+  Outcome outcome = run_source(sum, arguments, 1);
+  CHECK(!outcome.failed && (int64_t)outcome.value.i == 10028,
+        "arrays and arguments: returned %ld", (int64_t)outcome.value.i);
+
+  check_error("main (): i64 => { a := [1, 2]; return a[2]; }", RUNTIME_ERROR,
+              "index out of bounds");
+  check_error("main (): i64 => { n := -1; a: i64[n]; return 0; }",
+              RUNTIME_ERROR, "negative array size");
+}
+
+static void test_errors(void) {
+  check_error("main (): i64 => 1 / (1 - 1);", RUNTIME_ERROR,
+              "division by zero");
+  check_error("f (): i64 => f();\nmain (): i64 => f();", RUNTIME_ERROR,
+              "stack overflow");
+  check_error("main (): i64 => { x: i64 = \"a\"; return x; }", TYPE_ERROR,
+              "mismatched types");
+  check_error("main (): i64 => y;", TYPE_ERROR, "undeclared variable");
+  check_error("main (): i64 => { x := 1; return x.y; }", UNSUPPORTED_FEATURE,
+              "member access");
+  check_error("struct P { x: i64; }\nmain (): i64 => 0;", UNSUPPORTED_FEATURE,
+              "struct");
+  check_error("main (): i64 => { switch; }", SYNTAX_ERROR, "switch");
+}
+
+/**
+ * Build main (): <type> => { return <first><repeated>...; }
+ * @param type
+ * @param first
+ * @param repeated appended count times
+ * @param count
+ * @return the source, to free
+ */
+static char *chain_source(const char *type, const char *first,
+                          const char *repeated, i64 count) {
+  i64 size = 64 + strlen(type) + strlen(first) + strlen(repeated) * count;
+  char *source = malloc(size);
+  if (source == NULL)
+    exit(EXIT_FAILURE);
+  i64 length = sprintf(source, "main (): %s => { return %s", type, first);
+  for (i64 i = 0; i < count; i++)
+    length += sprintf(source + length, "%s", repeated);
+  strcpy(source + length, "; }");
+  return source;
+}
+
+// The parser accepts binary and postfix chains of any length, the compiler
+// used to recurse once per operator and overflow the C stack
+static void test_long_chains(void) {
+  char *source = chain_source("i64", "1", "+1", LONG_CHAIN - 1);
+  check_integer(source, LONG_CHAIN, "long addition chain");
+  free(source);
+
+  source = chain_source("i64", "0", "-1+2", LONG_CHAIN);
+  check_integer(source, LONG_CHAIN, "long mixed chain");
+  free(source);
+
+  source = chain_source("boolean", "1 == 1", " && 1 == 1", LONG_CHAIN);
+  Outcome outcome = run_source(source, NULL, 0);
+  CHECK(!outcome.failed && outcome.value.i == 1,
+        "long logical chain: failed or returned false");
+  free(source);
+
+  source = chain_source("i64", "[1]", "[0]", LONG_CHAIN);
+  check_error(source, UNSUPPORTED_FEATURE, "long index chain");
+  free(source);
+}
+
+static void test_example(void) {
+  SourceFile *file = load_source("code/main.monkc");
+  CHECK(file != NULL, "code/main.monkc could not be read");
+  if (file == NULL)
+    return;
+  check_integer(file->data, 0, "code/main.monkc");
+  free_source(file);
+}
+
+int main(void) {
+  test_expressions();
+  test_statements();
+  test_arrays();
+  test_errors();
+  test_long_chains();
+  test_example();
+  return finish_tests("vm");
+}